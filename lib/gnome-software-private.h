@@ -18,6 +18,6 @@
 #include <gs-app-private.h>
 #include <gs-category-private.h>
 #include <gs-os-release.h>
-#include <gs-plugin-loader.h>
+#include <gs-plugin-loader-private.h>
 #include <gs-plugin-loader-sync.h>
 #include <gs-plugin-private.h>
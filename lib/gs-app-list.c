@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include <glib.h>
+#include <string.h>
 
 #include "gs-app-private.h"
 #include "gs-app-list-private.h"
@@ -29,6 +30,9 @@ struct _GsAppList
 {
 	GObject			 parent_instance;
 	GPtrArray		*array;
+	GHashTable		*hash_by_id;	/* key:id-section, value:GPtrArray of GsApp */
+	GPtrArray		*unindexed;	/* apps with no ID or a wildcard id-section */
+	guint			 id_generation;	/* of the apps when hash_by_id was built */
 	GMutex			 mutex;
 	guint			 size_peak;
 	GsAppListFlags		 flags;
@@ -234,17 +238,134 @@ gs_app_list_get_size_peak (GsAppList *list)
 	return list->size_peak;
 }
 
-static GsApp *
-gs_app_list_lookup_safe (GsAppList *list, const gchar *unique_id)
+/* returns the key used for @unique_id in the hash, or %NULL if the ID section
+ * is a wildcard and the app has to be found with a linear scan */
+static gchar *
+gs_app_list_get_hash_key (const gchar *unique_id)
+{
+	const gchar *start = unique_id;
+	const gchar *end;
+
+	/* not a unique ID, so as_utils_unique_id_equal() uses strcmp */
+	if (!as_utils_unique_id_valid (unique_id))
+		return g_strdup (unique_id);
+
+	/* skip to the ID section */
+	for (guint i = 0; i < 4; i++)
+		start = strchr (start, '/') + 1;
+	end = strchr (start, '/');
+	if (end - start == 1 && start[0] == '*')
+		return NULL;
+	return g_strndup (start, (gsize) (end - start));
+}
+
+static void
+gs_app_list_hash_add (GsAppList *list, GsApp *app)
+{
+	GPtrArray *bucket;
+	const gchar *id = gs_app_get_unique_id (app);
+	g_autofree gchar *key = NULL;
+
+	/* lazy-loaded IDs are matched with a linear scan */
+	if (id != NULL)
+		key = gs_app_list_get_hash_key (id);
+	if (key == NULL) {
+		g_ptr_array_add (list->unindexed, app);
+		return;
+	}
+	bucket = g_hash_table_lookup (list->hash_by_id, key);
+	if (bucket == NULL) {
+		bucket = g_ptr_array_new ();
+		g_hash_table_insert (list->hash_by_id, g_steal_pointer (&key), bucket);
+	}
+	g_ptr_array_add (bucket, app);
+}
+
+static void
+gs_app_list_hash_rebuild (GsAppList *list)
 {
+	g_hash_table_remove_all (list->hash_by_id);
+	g_ptr_array_set_size (list->unindexed, 0);
+	list->id_generation = gs_app_get_id_generation ();
 	for (guint i = 0; i < list->array->len; i++) {
 		GsApp *app = g_ptr_array_index (list->array, i);
+		gs_app_list_hash_add (list, app);
+	}
+}
+
+/* apps given a different ID since they were added are in the wrong bucket */
+static void
+gs_app_list_hash_ensure (GsAppList *list)
+{
+	if (list->id_generation != gs_app_get_id_generation ())
+		gs_app_list_hash_rebuild (list);
+}
+
+static void
+gs_app_list_hash_remove (GsAppList *list, GsApp *app)
+{
+	GPtrArray *bucket;
+	const gchar *id;
+	g_autofree gchar *key = NULL;
+
+	if (g_ptr_array_remove (list->unindexed, app))
+		return;
+	id = gs_app_get_unique_id (app);
+	if (id != NULL)
+		key = gs_app_list_get_hash_key (id);
+
+	/* the ID was changed since the app was added */
+	bucket = key != NULL ? g_hash_table_lookup (list->hash_by_id, key) : NULL;
+	if (bucket == NULL || !g_ptr_array_remove (bucket, app)) {
+		gs_app_list_hash_rebuild (list);
+		return;
+	}
+	if (bucket->len == 0)
+		g_hash_table_remove (list->hash_by_id, key);
+}
+
+/* returns the first app in @apps matching @unique_id */
+static GsApp *
+gs_app_list_lookup_in_array (GPtrArray *apps, const gchar *unique_id)
+{
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
 		if (as_utils_unique_id_equal (gs_app_get_unique_id (app), unique_id))
 			return app;
 	}
 	return NULL;
 }
 
+static GsApp *
+gs_app_list_lookup_safe (GsAppList *list, const gchar *unique_id)
+{
+	GPtrArray *bucket;
+	GsApp *app;
+	GsApp *app_unindexed;
+	guint idx;
+	guint idx_unindexed;
+	g_autofree gchar *key = NULL;
+
+	/* wildcard ID section in the request, so we have to preserve the
+	 * array order of the first match */
+	key = gs_app_list_get_hash_key (unique_id);
+	if (key == NULL)
+		return gs_app_list_lookup_in_array (list->array, unique_id);
+
+	/* buckets and unindexed apps are both kept in array order */
+	gs_app_list_hash_ensure (list);
+	bucket = g_hash_table_lookup (list->hash_by_id, key);
+	app = bucket != NULL ? gs_app_list_lookup_in_array (bucket, unique_id) : NULL;
+	app_unindexed = gs_app_list_lookup_in_array (list->unindexed, unique_id);
+	if (app == NULL)
+		return app_unindexed;
+	if (app_unindexed == NULL)
+		return app;
+	g_ptr_array_find (list->array, app, &idx);
+	g_ptr_array_find (list->array, app_unindexed, &idx_unindexed);
+	return idx < idx_unindexed ? app : app_unindexed;
+}
+
 /**
  * gs_app_list_lookup:
  * @list: A #GsAppList
@@ -306,6 +427,20 @@ gs_app_list_add_flag (GsAppList *list, GsAppListFlags flag)
 	}
 }
 
+/* returns %TRUE if @apps has a wildcard with exactly @unique_id */
+static gboolean
+gs_app_list_has_wildcard (GPtrArray *apps, const gchar *unique_id)
+{
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app_tmp = g_ptr_array_index (apps, i);
+		if (!gs_app_has_quirk (app_tmp, GS_APP_QUIRK_IS_WILDCARD))
+			continue;
+		if (g_strcmp0 (gs_app_get_unique_id (app_tmp), unique_id) == 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
 static gboolean
 gs_app_list_check_for_duplicate (GsAppList *list, GsApp *app)
 {
@@ -314,16 +449,23 @@ gs_app_list_check_for_duplicate (GsAppList *list, GsApp *app)
 
 	/* adding a wildcard */
 	if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD)) {
-		for (guint i = 0; i < list->array->len; i++) {
-			GsApp *app_tmp = g_ptr_array_index (list->array, i);
-			if (!gs_app_has_quirk (app_tmp, GS_APP_QUIRK_IS_WILDCARD))
-				continue;
-			/* not adding exactly the same wildcard */
-			if (g_strcmp0 (gs_app_get_unique_id (app_tmp),
-				       gs_app_get_unique_id (app)) == 0)
+		g_autofree gchar *key = NULL;
+		GPtrArray *candidates = list->array;
+
+		/* exactly the same wildcard will always be in the same bucket,
+		 * unless it was added before it had an ID */
+		id = gs_app_get_unique_id (app);
+		if (id != NULL)
+			key = gs_app_list_get_hash_key (id);
+		if (key != NULL) {
+			gs_app_list_hash_ensure (list);
+			candidates = g_hash_table_lookup (list->hash_by_id, key);
+			if (gs_app_list_has_wildcard (list->unindexed, id))
 				return FALSE;
+			if (candidates == NULL)
+				return TRUE;
 		}
-		return TRUE;
+		return !gs_app_list_has_wildcard (candidates, id);
 	}
 
 	/* does not exist */
@@ -370,12 +512,14 @@ gs_app_list_add_safe (GsAppList *list, GsApp *app, GsAppListAddFlag flag)
 	if (id == NULL) {
 		gs_app_list_maybe_watch_app (list, app);
 		g_ptr_array_add (list->array, g_object_ref (app));
+		g_ptr_array_add (list->unindexed, app);
 		return;
 	}
 
 	/* just use the ref */
 	gs_app_list_maybe_watch_app (list, app);
 	g_ptr_array_add (list->array, g_object_ref (app));
+	gs_app_list_hash_add (list, app);
 
 	/* update the historical max */
 	if (list->array->len > list->size_peak)
@@ -430,7 +574,8 @@ gs_app_list_remove (GsAppList *list, GsApp *app)
 	g_return_if_fail (GS_IS_APP (app));
 
 	locker = g_mutex_locker_new (&list->mutex);
-	g_ptr_array_remove (list->array, app);
+	if (g_ptr_array_remove (list->array, app))
+		gs_app_list_hash_remove (list, app);
 	gs_app_list_maybe_unwatch_app (list, app);
 
 	/* recalculate global state */
@@ -512,6 +657,8 @@ gs_app_list_remove_all_safe (GsAppList *list)
 		gs_app_list_maybe_unwatch_app (list, app);
 	}
 	g_ptr_array_set_size (list->array, 0);
+	g_hash_table_remove_all (list->hash_by_id);
+	g_ptr_array_set_size (list->unindexed, 0);
 	gs_app_list_invalidate_state (list);
 	gs_app_list_invalidate_progress (list);
 }
@@ -602,6 +749,7 @@ gs_app_list_sort (GsAppList *list, GsAppListSortFunc func, gpointer user_data)
 	helper.func = func;
 	helper.user_data = user_data;
 	g_ptr_array_sort_with_data (list->array, gs_app_list_sort_cb, &helper);
+	gs_app_list_hash_rebuild (list);
 }
 
 /**
@@ -634,6 +782,7 @@ gs_app_list_truncate (GsAppList *list, guint length)
 	/* remove the apps in the positions larger than the length */
 	locker = g_mutex_locker_new (&list->mutex);
 	g_ptr_array_set_size (list->array, length);
+	gs_app_list_hash_rebuild (list);
 }
 
 static gint
@@ -690,6 +839,7 @@ gs_app_list_randomize (GsAppList *list)
 		gs_app_set_metadata (app, key, sort_key);
 	}
 	g_ptr_array_sort_with_data (list->array, gs_app_list_randomize_cb, list);
+	gs_app_list_hash_rebuild (list);
 	for (i = 0; i < gs_app_list_length (list); i++) {
 		app = gs_app_list_index (list, i);
 		gs_app_set_metadata (app, key, NULL);
@@ -901,6 +1051,8 @@ gs_app_list_finalize (GObject *object)
 {
 	GsAppList *list = GS_APP_LIST (object);
 	g_ptr_array_unref (list->array);
+	g_hash_table_unref (list->hash_by_id);
+	g_ptr_array_unref (list->unindexed);
 	g_mutex_clear (&list->mutex);
 	G_OBJECT_CLASS (gs_app_list_parent_class)->finalize (object);
 }
@@ -943,6 +1095,10 @@ gs_app_list_init (GsAppList *list)
 {
 	g_mutex_init (&list->mutex);
 	list->array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	list->hash_by_id = g_hash_table_new_full (g_str_hash, g_str_equal,
+						  g_free, (GDestroyNotify) g_ptr_array_unref);
+	list->unindexed = g_ptr_array_new ();
+	list->id_generation = gs_app_get_id_generation ();
 }
 
 /**
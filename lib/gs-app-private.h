@@ -26,5 +26,17 @@ void		 gs_app_set_pending_action	(GsApp		*app,
 						 GsPluginAction	 action);
 gint		 gs_app_compare_priority	(GsApp		*app1,
 						 GsApp		*app2);
+void		 gs_app_queue_thaw_notify	(GsApp		*app);
+gboolean	 gs_app_refine_ledger_covers	(GsApp		*app,
+						 const gchar	*plugin_name,
+						 GsPluginRefineFlags refine_flags,
+						 guint		 generation);
+void		 gs_app_refine_ledger_add	(GsApp		*app,
+						 const gchar	*plugin_name,
+						 GsPluginRefineFlags refine_flags,
+						 guint		 generation);
+void		 gs_app_refine_ledger_clear	(GsApp		*app);
+guint64		 gs_app_get_memory_size		(GsApp		*app);
+guint		 gs_app_get_id_generation	(void);
 
 G_END_DECLS
@@ -118,8 +118,14 @@ typedef struct
 	GsPluginAction		 pending_action;
 	GsAppPermissions         permissions;
 	gboolean		 is_update_downloaded;
+	GHashTable		*refine_ledger;  /* (nullable) plugin name : GsAppRefineLedgerEntry */
 } GsAppPrivate;
 
+typedef struct {
+	GsPluginRefineFlags	 refine_flags;
+	guint			 generation;
+} GsAppRefineLedgerEntry;
+
 enum {
 	PROP_0,
 	PROP_ID,
@@ -142,6 +148,9 @@ enum {
 
 static GParamSpec *obj_props[PROP_LAST] = { NULL, };
 
+/* bumped when an app that already had an ID is given a different one */
+static gint id_generation = 0;	/* atomic */
+
 G_DEFINE_TYPE_WITH_PRIVATE (GsApp, gs_app, G_TYPE_OBJECT)
 
 static gboolean
@@ -665,34 +674,107 @@ gs_app_to_string_append (GsApp *app, GString *str)
 	g_string_append_printf (str, "\n");
 }
 
+/* Property changes are batched so that refining a large list of apps
+ * does not add an idle source to the main context for every property
+ * that changes. All the pending notifications are emitted from a single
+ * idle callback, and repeated changes of the same property are only
+ * notified once. */
 typedef struct {
-	GsApp *app;
-	GParamSpec *pspec;
-} AppNotifyData;
+	GsApp		*app;
+	GPtrArray	*pspecs;	/* (element-type GParamSpec) */
+	guint		 n_thaw;
+} GsAppNotifyEntry;
 
-static gboolean
-notify_idle_cb (gpointer data)
+static GMutex		 notify_mutex;
+static GHashTable	*notify_pending = NULL;	/* GsApp : GsAppNotifyEntry */
+static GPtrArray	*notify_order = NULL;	/* (element-type GsAppNotifyEntry) */
+
+static void
+gs_app_notify_entry_free (GsAppNotifyEntry *entry)
 {
-	AppNotifyData *notify_data = data;
+	g_object_unref (entry->app);
+	g_ptr_array_unref (entry->pspecs);
+	g_free (entry);
+}
 
-	g_object_notify_by_pspec (G_OBJECT (notify_data->app), notify_data->pspec);
+static gboolean
+gs_app_notify_idle_cb (gpointer user_data)
+{
+	g_autoptr(GPtrArray) order = NULL;
 
-	g_object_unref (notify_data->app);
-	g_free (notify_data);
+	/* take the batch; anything queued by the handlers goes in the next */
+	g_mutex_lock (&notify_mutex);
+	order = g_steal_pointer (&notify_order);
+	g_clear_pointer (&notify_pending, g_hash_table_unref);
+	g_mutex_unlock (&notify_mutex);
 
+	for (guint i = 0; i < order->len; i++) {
+		GsAppNotifyEntry *entry = g_ptr_array_index (order, i);
+		for (guint j = 0; j < entry->pspecs->len; j++) {
+			GParamSpec *pspec = g_ptr_array_index (entry->pspecs, j);
+			g_object_notify_by_pspec (G_OBJECT (entry->app), pspec);
+		}
+		for (guint j = 0; j < entry->n_thaw; j++)
+			g_object_thaw_notify (G_OBJECT (entry->app));
+	}
 	return G_SOURCE_REMOVE;
 }
 
+/* must be called with notify_mutex held */
+static GsAppNotifyEntry *
+gs_app_notify_entry_lookup (GsApp *app)
+{
+	GsAppNotifyEntry *entry;
+
+	/* first change since the last dispatch */
+	if (notify_pending == NULL) {
+		notify_pending = g_hash_table_new (g_direct_hash, g_direct_equal);
+		notify_order = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_app_notify_entry_free);
+		g_idle_add (gs_app_notify_idle_cb, NULL);
+	}
+
+	entry = g_hash_table_lookup (notify_pending, app);
+	if (entry == NULL) {
+		entry = g_new0 (GsAppNotifyEntry, 1);
+		entry->app = g_object_ref (app);
+		entry->pspecs = g_ptr_array_new ();
+		g_hash_table_insert (notify_pending, app, entry);
+		g_ptr_array_add (notify_order, entry);
+	}
+	return entry;
+}
+
 static void
 gs_app_queue_notify (GsApp *app, GParamSpec *pspec)
 {
-	AppNotifyData *notify_data;
+	GsAppNotifyEntry *entry;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&notify_mutex);
 
-	notify_data = g_new (AppNotifyData, 1);
-	notify_data->app = g_object_ref (app);
-	notify_data->pspec = pspec;
+	entry = gs_app_notify_entry_lookup (app);
+	for (guint i = 0; i < entry->pspecs->len; i++) {
+		if (g_ptr_array_index (entry->pspecs, i) == pspec)
+			return;
+	}
+	g_ptr_array_add (entry->pspecs, pspec);
+}
 
-	g_idle_add (notify_idle_cb, notify_data);
+/**
+ * gs_app_queue_thaw_notify:
+ * @app: a #GsApp
+ *
+ * Calls g_object_thaw_notify() on @app from the main context, after
+ * any property notifications that are already queued.
+ **/
+void
+gs_app_queue_thaw_notify (GsApp *app)
+{
+	GsAppNotifyEntry *entry;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&notify_mutex);
+
+	g_return_if_fail (GS_IS_APP (app));
+
+	entry = gs_app_notify_entry_lookup (app);
+	entry->n_thaw++;
 }
 
 /**
@@ -727,10 +809,27 @@ gs_app_set_id (GsApp *app, const gchar *id)
 	g_autoptr(GMutexLocker) locker = NULL;
 	g_return_if_fail (GS_IS_APP (app));
 	locker = g_mutex_locker_new (&priv->mutex);
+	if (priv->id != NULL && g_strcmp0 (priv->id, id) != 0)
+		g_atomic_int_inc (&id_generation);
 	if (_g_set_str (&priv->id, id))
 		priv->unique_id_valid = FALSE;
 }
 
+/**
+ * gs_app_get_id_generation:
+ *
+ * Gets a counter that changes whenever an application which already had an
+ * ID is given a different one, so that anything indexing applications by ID
+ * knows it may be out of date.
+ *
+ * Returns: a generation number
+ **/
+guint
+gs_app_get_id_generation (void)
+{
+	return (guint) g_atomic_int_get (&id_generation);
+}
+
 /**
  * gs_app_get_scope:
  * @app: a #GsApp
@@ -1008,6 +1107,10 @@ gs_app_set_state_internal (GsApp *app, AsAppState state)
 
 	priv->state = state;
 
+	/* anything a plugin refined may now be stale */
+	if (priv->refine_ledger != NULL)
+		g_hash_table_remove_all (priv->refine_ledger);
+
 	if (state == AS_APP_STATE_UNKNOWN ||
 	    state == AS_APP_STATE_AVAILABLE_LOCAL ||
 	    state == AS_APP_STATE_AVAILABLE)
@@ -1280,6 +1383,8 @@ gs_app_set_unique_id (GsApp *app, const gchar *unique_id)
 	if (!as_utils_unique_id_valid (unique_id))
 		g_warning ("unique_id %s not valid", unique_id);
 
+	if (priv->id != NULL)
+		g_atomic_int_inc (&id_generation);
 	g_free (priv->unique_id);
 	priv->unique_id = g_strdup (unique_id);
 	priv->unique_id_valid = TRUE;
@@ -2879,6 +2984,10 @@ gs_app_set_management_plugin (GsApp *app, const gchar *management_plugin)
 
 	g_free (priv->management_plugin);
 	priv->management_plugin = g_strdup (management_plugin);
+
+	/* plugins that skipped an unmanaged app have to look again */
+	if (priv->refine_ledger != NULL)
+		g_hash_table_remove_all (priv->refine_ledger);
 }
 
 /**
@@ -4098,6 +4207,138 @@ gs_app_set_pending_action (GsApp *app,
 	gs_app_set_pending_action_internal (app, action);
 }
 
+/**
+ * gs_app_refine_ledger_covers:
+ * @app: a #GsApp
+ * @plugin_name: a plugin name, e.g. "appstream"
+ * @refine_flags: some #GsPluginRefineFlags, e.g. %GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON
+ * @generation: the loader data generation
+ *
+ * Checks if the plugin has already refined @app with all of @refine_flags
+ * since the data generation last changed.
+ *
+ * Returns: %TRUE if calling the plugin again would be redundant
+ **/
+gboolean
+gs_app_refine_ledger_covers (GsApp *app,
+			     const gchar *plugin_name,
+			     GsPluginRefineFlags refine_flags,
+			     guint generation)
+{
+	GsAppPrivate *priv = gs_app_get_instance_private (app);
+	GsAppRefineLedgerEntry *entry;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->mutex);
+
+	if (priv->refine_ledger == NULL)
+		return FALSE;
+	entry = g_hash_table_lookup (priv->refine_ledger, plugin_name);
+	if (entry == NULL || entry->generation != generation)
+		return FALSE;
+	return (entry->refine_flags & refine_flags) == refine_flags;
+}
+
+/**
+ * gs_app_refine_ledger_add:
+ * @app: a #GsApp
+ * @plugin_name: a plugin name, e.g. "appstream"
+ * @refine_flags: some #GsPluginRefineFlags
+ * @generation: the loader data generation
+ *
+ * Records that the plugin successfully refined @app with @refine_flags.
+ * Flags recorded at an older generation are discarded.
+ **/
+void
+gs_app_refine_ledger_add (GsApp *app,
+			  const gchar *plugin_name,
+			  GsPluginRefineFlags refine_flags,
+			  guint generation)
+{
+	GsAppPrivate *priv = gs_app_get_instance_private (app);
+	GsAppRefineLedgerEntry *entry;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->mutex);
+
+	if (priv->refine_ledger == NULL) {
+		priv->refine_ledger = g_hash_table_new_full (g_str_hash, g_str_equal,
+							     g_free, g_free);
+	}
+	entry = g_hash_table_lookup (priv->refine_ledger, plugin_name);
+	if (entry == NULL) {
+		entry = g_new0 (GsAppRefineLedgerEntry, 1);
+		g_hash_table_insert (priv->refine_ledger, g_strdup (plugin_name), entry);
+	}
+	if (entry->generation != generation) {
+		entry->refine_flags = 0;
+		entry->generation = generation;
+	}
+	entry->refine_flags |= refine_flags;
+}
+
+/**
+ * gs_app_refine_ledger_clear:
+ * @app: a #GsApp
+ *
+ * Forgets what every plugin has refined, so the next refine runs in full.
+ **/
+void
+gs_app_refine_ledger_clear (GsApp *app)
+{
+	GsAppPrivate *priv = gs_app_get_instance_private (app);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->mutex);
+	if (priv->refine_ledger != NULL)
+		g_hash_table_remove_all (priv->refine_ledger);
+}
+
+static gsize
+gs_app_strlen0 (const gchar *str)
+{
+	return str != NULL ? strlen (str) + 1 : 0;
+}
+
+/**
+ * gs_app_get_memory_size:
+ * @app: a #GsApp
+ *
+ * Estimates how much memory the app is keeping alive. This only counts the
+ * data owned by @app itself, not any addons, related or history apps, and is
+ * only intended for enforcing cache budgets.
+ *
+ * Returns: an approximate number of bytes
+ **/
+guint64
+gs_app_get_memory_size (GsApp *app)
+{
+	GsAppPrivate *priv = gs_app_get_instance_private (app);
+	guint64 sz = sizeof (GsAppPrivate);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->mutex);
+
+	sz += gs_app_strlen0 (priv->id);
+	sz += gs_app_strlen0 (priv->unique_id);
+	sz += gs_app_strlen0 (priv->branch);
+	sz += gs_app_strlen0 (priv->name);
+	sz += gs_app_strlen0 (priv->summary);
+	sz += gs_app_strlen0 (priv->description);
+	sz += gs_app_strlen0 (priv->developer_name);
+	sz += gs_app_strlen0 (priv->version);
+	sz += gs_app_strlen0 (priv->license);
+	sz += gs_app_strlen0 (priv->origin);
+	sz += gs_app_strlen0 (priv->update_version);
+	sz += gs_app_strlen0 (priv->update_details);
+
+	/* rough per-object costs */
+	sz += priv->icons->len * 128;
+	sz += priv->sources->len * 64;
+	sz += priv->screenshots->len * 256;
+	sz += priv->reviews->len * 512;
+	sz += priv->provides->len * 64;
+	if (priv->metadata != NULL)
+		sz += g_hash_table_size (priv->metadata) * 64;
+
+	/* this is likely to dominate */
+	if (priv->pixbuf != NULL)
+		sz += gdk_pixbuf_get_byte_length (priv->pixbuf);
+	return sz;
+}
+
 static void
 gs_app_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
 {
@@ -4241,6 +4482,8 @@ gs_app_finalize (GObject *object)
 	GsAppPrivate *priv = gs_app_get_instance_private (app);
 
 	g_mutex_clear (&priv->mutex);
+	if (priv->refine_ledger != NULL)
+		g_hash_table_unref (priv->refine_ledger);
 	g_free (priv->id);
 	g_free (priv->unique_id);
 	g_free (priv->branch);
@@ -78,6 +78,63 @@ gs_cmd_show_results_categories (GPtrArray *list)
 	}
 }
 
+static GVariant *
+gs_cmd_get_metrics (GsPluginLoader *plugin_loader)
+{
+	GVariant *metrics = NULL;
+	g_autoptr(GDBusConnection) connection = NULL;
+	g_autoptr(GVariant) retval = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* prefer the running instance, as that has been used interactively */
+	connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+	if (connection != NULL) {
+		retval = g_dbus_connection_call_sync (connection,
+						      "org.ubuntuunity.software",
+						      "/org/ubuntuunity/software",
+						      "org.ubuntuunity.software.Metrics",
+						      "GetMetrics",
+						      NULL,
+						      G_VARIANT_TYPE ("(a(ssau))"),
+						      G_DBUS_CALL_FLAGS_NO_AUTO_START,
+						      -1, NULL, &error);
+	}
+	if (retval != NULL) {
+		g_variant_get (retval, "(@a(ssau))", &metrics);
+		return metrics;
+	}
+	g_print ("Showing metrics for this process: %s\n", error->message);
+	return gs_plugin_loader_get_metrics (plugin_loader);
+}
+
+static void
+gs_cmd_show_metrics (GVariant *metrics)
+{
+	GVariantIter iter;
+	const gchar *plugin_name;
+	const gchar *action;
+	GVariant *buckets_variant;
+	g_autoptr(GString) str = g_string_new (NULL);
+
+	/* each bucket is twice as wide as the last, starting at 1ms */
+	g_string_append_printf (str, "%-20s %-24s %6s", "plugin", "action", "<1ms");
+	for (guint i = 1; i < 16; i++)
+		g_string_append_printf (str, " %6u", 1u << (i - 1));
+	g_print ("%s\n", str->str);
+
+	g_variant_iter_init (&iter, metrics);
+	while (g_variant_iter_next (&iter, "(&s&s@au)", &plugin_name, &action, &buckets_variant)) {
+		gsize n_buckets = 0;
+		const guint32 *buckets = g_variant_get_fixed_array (buckets_variant, &n_buckets, sizeof(guint32));
+		g_string_truncate (str, 0);
+		g_string_append_printf (str, "%-20s %-24s", plugin_name, action);
+		for (gsize i = 0; i < n_buckets; i++)
+			g_string_append_printf (str, " %6u", buckets[i]);
+		g_print ("%s\n", str->str);
+		g_variant_unref (buckets_variant);
+	}
+}
+
 static GsPluginRefineFlags
 gs_cmd_refine_flag_from_string (const gchar *flag, GError **error)
 {
@@ -665,6 +722,10 @@ main (int argc, char **argv)
 						 NULL);
 		ret = gs_plugin_loader_job_action (self->plugin_loader, plugin_job,
 						    NULL, &error);
+	} else if (argc == 2 && g_strcmp0 (argv[1], "dump-metrics") == 0) {
+		g_autoptr(GVariant) metrics = gs_cmd_get_metrics (self->plugin_loader);
+		gs_cmd_show_metrics (metrics);
+		ret = TRUE;
 	} else if (argc >= 1 && g_strcmp0 (argv[1], "user-hash") == 0) {
 		g_autofree gchar *user_hash = gs_utils_get_user_hash (&error);
 		if (user_hash == NULL) {
@@ -682,7 +743,8 @@ main (int argc, char **argv)
 				     "'updates', 'popular', 'get-categories', "
 				     "'get-category-apps', 'get-alternates', 'filename-to-app', "
 				     "'action install', 'action remove', "
-				     "'sources', 'refresh', 'launch' or 'search'");
+				     "'sources', 'refresh', 'launch', 'dump-metrics' "
+				     "or 'search'");
 	}
 	if (!ret) {
 		g_print ("Failed: %s\n", error->message);
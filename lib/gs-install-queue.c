@@ -0,0 +1,374 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2016 Gautham Nair <gautham.nair.2005@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/*
+ * The install queue is stored as a snapshot file with one app ID per line,
+ * plus a journal of the changes made since the snapshot was written:
+ *
+ *   +org.example.App.desktop	enqueued
+ *   -org.example.App.desktop	dequeued by the user
+ *   *org.example.App.desktop	installed
+ *
+ * Records are appended by a single writer thread so callers never block on
+ * disk I/O, and the journal is folded back into the snapshot once it gets
+ * long. Replaying a record is idempotent, so a crash between writing the
+ * snapshot and truncating the journal does not change the result, and a
+ * torn record at the end of the journal is ignored.
+ */
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+#include "gs-install-queue.h"
+#include "gs-utils.h"
+
+/* fold the journal into the snapshot after this many records */
+#define GS_INSTALL_QUEUE_COMPACT_RECORDS	64
+
+struct _GsInstallQueue
+{
+	GObject			 parent_instance;
+	gchar			*filename;
+	gchar			*filename_journal;
+	GThreadPool		*pool;
+
+	/* only touched from the writer thread once loaded */
+	GPtrArray		*ids;
+	GOutputStream		*journal;
+	guint			 journal_records;
+};
+
+G_DEFINE_TYPE (GsInstallQueue, gs_install_queue, G_TYPE_OBJECT)
+
+typedef enum {
+	GS_INSTALL_QUEUE_RECORD_ENQUEUE		= '+',
+	GS_INSTALL_QUEUE_RECORD_DEQUEUE		= '-',
+	GS_INSTALL_QUEUE_RECORD_COMPLETE	= '*',
+	GS_INSTALL_QUEUE_RECORD_COMPACT		= '#',
+	GS_INSTALL_QUEUE_RECORD_SYNC		= '='
+} GsInstallQueueRecordKind;
+
+typedef struct {
+	GsInstallQueueRecordKind kind;
+	gchar			*id;
+	GMutex			*mutex;		/* for SYNC */
+	GCond			*cond;		/* for SYNC */
+	gboolean		*done;		/* for SYNC */
+} GsInstallQueueRecord;
+
+static gboolean
+gs_install_queue_apply (GPtrArray *ids, GsInstallQueueRecordKind kind, const gchar *id)
+{
+	switch (kind) {
+	case GS_INSTALL_QUEUE_RECORD_ENQUEUE:
+		for (guint i = 0; i < ids->len; i++) {
+			if (g_strcmp0 (g_ptr_array_index (ids, i), id) == 0)
+				return TRUE;
+		}
+		g_ptr_array_add (ids, g_strdup (id));
+		return TRUE;
+	case GS_INSTALL_QUEUE_RECORD_DEQUEUE:
+	case GS_INSTALL_QUEUE_RECORD_COMPLETE:
+		for (guint i = 0; i < ids->len; i++) {
+			if (g_strcmp0 (g_ptr_array_index (ids, i), id) == 0) {
+				g_ptr_array_remove_index (ids, i);
+				break;
+			}
+		}
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static void
+gs_install_queue_compact (GsInstallQueue *self)
+{
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GString) str = g_string_new (NULL);
+
+	for (guint i = 0; i < self->ids->len; i++) {
+		g_string_append (str, g_ptr_array_index (self->ids, i));
+		g_string_append_c (str, '\n');
+	}
+
+	/* the snapshot has to be complete before the journal is dropped */
+	if (!gs_mkdir_parent (self->filename, &error)) {
+		g_warning ("failed to create dir for %s: %s",
+			   self->filename, error->message);
+		return;
+	}
+	g_debug ("compacting install queue to %s", self->filename);
+	if (!g_file_set_contents (self->filename, str->str, (gssize) str->len, &error)) {
+		g_warning ("failed to save install queue: %s", error->message);
+		return;
+	}
+	if (self->journal != NULL) {
+		g_output_stream_close (self->journal, NULL, NULL);
+		g_clear_object (&self->journal);
+	}
+	file = g_file_new_for_path (self->filename_journal);
+	if (!g_file_delete (file, NULL, &error) &&
+	    !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+		g_warning ("failed to truncate install queue journal: %s", error->message);
+	self->journal_records = 0;
+}
+
+static void
+gs_install_queue_append (GsInstallQueue *self, GsInstallQueueRecordKind kind, const gchar *id)
+{
+	g_autoptr(GError) error = NULL;
+	g_autofree gchar *line = NULL;
+
+	if (self->journal == NULL) {
+		g_autoptr(GFile) file = g_file_new_for_path (self->filename_journal);
+		if (!gs_mkdir_parent (self->filename_journal, &error)) {
+			g_warning ("failed to create dir for %s: %s",
+				   self->filename_journal, error->message);
+			return;
+		}
+		self->journal = G_OUTPUT_STREAM (g_file_append_to (file, G_FILE_CREATE_NONE,
+								   NULL, &error));
+		if (self->journal == NULL) {
+			g_warning ("failed to open install queue journal: %s", error->message);
+			return;
+		}
+	}
+	line = g_strdup_printf ("%c%s\n", (gchar) kind, id);
+	if (!g_output_stream_write_all (self->journal, line, strlen (line), NULL, NULL, &error) ||
+	    !g_output_stream_flush (self->journal, NULL, &error)) {
+		g_warning ("failed to write install queue journal: %s", error->message);
+		g_clear_object (&self->journal);
+		return;
+	}
+	self->journal_records++;
+}
+
+static void
+gs_install_queue_record_free (GsInstallQueueRecord *record)
+{
+	g_free (record->id);
+	g_slice_free (GsInstallQueueRecord, record);
+}
+
+static void
+gs_install_queue_writer_cb (gpointer data, gpointer user_data)
+{
+	GsInstallQueue *self = GS_INSTALL_QUEUE (user_data);
+	GsInstallQueueRecord *record = (GsInstallQueueRecord *) data;
+
+	switch (record->kind) {
+	case GS_INSTALL_QUEUE_RECORD_COMPACT:
+		gs_install_queue_compact (self);
+		break;
+	case GS_INSTALL_QUEUE_RECORD_SYNC:
+		g_mutex_lock (record->mutex);
+		*record->done = TRUE;
+		g_cond_signal (record->cond);
+		g_mutex_unlock (record->mutex);
+		break;
+	default:
+		gs_install_queue_apply (self->ids, record->kind, record->id);
+		gs_install_queue_append (self, record->kind, record->id);
+		if (self->journal_records >= GS_INSTALL_QUEUE_COMPACT_RECORDS)
+			gs_install_queue_compact (self);
+		break;
+	}
+	gs_install_queue_record_free (record);
+}
+
+static void
+gs_install_queue_push (GsInstallQueue *self, GsInstallQueueRecordKind kind, const gchar *id)
+{
+	GsInstallQueueRecord *record = g_slice_new0 (GsInstallQueueRecord);
+	record->kind = kind;
+	record->id = g_strdup (id);
+	g_thread_pool_push (self->pool, record, NULL);
+}
+
+static gboolean
+gs_install_queue_read_lines (const gchar *filename, gchar ***lines, GError **error)
+{
+	g_autofree gchar *contents = NULL;
+	gsize len = 0;
+
+	*lines = NULL;
+	if (!g_file_test (filename, G_FILE_TEST_EXISTS))
+		return TRUE;
+	if (!g_file_get_contents (filename, &contents, &len, error))
+		return FALSE;
+
+	/* a record without its newline was torn by a crash */
+	if (len > 0 && contents[len - 1] != '\n') {
+		gchar *tmp = g_strrstr (contents, "\n");
+		if (tmp != NULL)
+			tmp[1] = '\0';
+		else
+			contents[0] = '\0';
+	}
+	*lines = g_strsplit (contents, "\n", 0);
+	return TRUE;
+}
+
+/**
+ * gs_install_queue_load:
+ * @self: a #GsInstallQueue
+ * @error: a #GError, or %NULL
+ *
+ * Replays the snapshot and journal. This must be called before any
+ * records are added.
+ *
+ * Returns: (transfer full): the queued app IDs in order
+ **/
+gchar **
+gs_install_queue_load (GsInstallQueue *self, GError **error)
+{
+	g_auto(GStrv) snapshot = NULL;
+	g_auto(GStrv) journal = NULL;
+	GPtrArray *ids_out;
+
+	g_return_val_if_fail (GS_IS_INSTALL_QUEUE (self), NULL);
+
+	if (!gs_install_queue_read_lines (self->filename, &snapshot, error))
+		return NULL;
+	if (!gs_install_queue_read_lines (self->filename_journal, &journal, error))
+		return NULL;
+
+	g_debug ("loading install queue from %s", self->filename);
+	g_ptr_array_set_size (self->ids, 0);
+	for (guint i = 0; snapshot != NULL && snapshot[i] != NULL; i++) {
+		if (snapshot[i][0] == '\0')
+			continue;
+		gs_install_queue_apply (self->ids, GS_INSTALL_QUEUE_RECORD_ENQUEUE, snapshot[i]);
+	}
+	for (guint i = 0; journal != NULL && journal[i] != NULL; i++) {
+		if (journal[i][0] == '\0')
+			continue;
+		if (!gs_install_queue_apply (self->ids, journal[i][0], journal[i] + 1))
+			g_warning ("ignoring invalid install queue record %s", journal[i]);
+	}
+
+	/* start the next session from a short journal */
+	if (journal != NULL)
+		gs_install_queue_push (self, GS_INSTALL_QUEUE_RECORD_COMPACT, NULL);
+
+	ids_out = g_ptr_array_new ();
+	for (guint i = 0; i < self->ids->len; i++)
+		g_ptr_array_add (ids_out, g_strdup (g_ptr_array_index (self->ids, i)));
+	g_ptr_array_add (ids_out, NULL);
+	return (gchar **) g_ptr_array_free (ids_out, FALSE);
+}
+
+void
+gs_install_queue_enqueue (GsInstallQueue *self, const gchar *id)
+{
+	g_return_if_fail (GS_IS_INSTALL_QUEUE (self));
+	gs_install_queue_push (self, GS_INSTALL_QUEUE_RECORD_ENQUEUE, id);
+}
+
+void
+gs_install_queue_dequeue (GsInstallQueue *self, const gchar *id)
+{
+	g_return_if_fail (GS_IS_INSTALL_QUEUE (self));
+	gs_install_queue_push (self, GS_INSTALL_QUEUE_RECORD_DEQUEUE, id);
+}
+
+void
+gs_install_queue_complete (GsInstallQueue *self, const gchar *id)
+{
+	g_return_if_fail (GS_IS_INSTALL_QUEUE (self));
+	gs_install_queue_push (self, GS_INSTALL_QUEUE_RECORD_COMPLETE, id);
+}
+
+/**
+ * gs_install_queue_flush:
+ * @self: a #GsInstallQueue
+ *
+ * Blocks until every record added so far has been written.
+ **/
+void
+gs_install_queue_flush (GsInstallQueue *self)
+{
+	GsInstallQueueRecord *record;
+	GMutex mutex;
+	GCond cond;
+	gboolean done = FALSE;
+
+	g_return_if_fail (GS_IS_INSTALL_QUEUE (self));
+
+	g_mutex_init (&mutex);
+	g_cond_init (&cond);
+	record = g_slice_new0 (GsInstallQueueRecord);
+	record->kind = GS_INSTALL_QUEUE_RECORD_SYNC;
+	record->mutex = &mutex;
+	record->cond = &cond;
+	record->done = &done;
+	g_thread_pool_push (self->pool, record, NULL);
+
+	g_mutex_lock (&mutex);
+	while (!done)
+		g_cond_wait (&cond, &mutex);
+	g_mutex_unlock (&mutex);
+	g_mutex_clear (&mutex);
+	g_cond_clear (&cond);
+}
+
+static void
+gs_install_queue_finalize (GObject *object)
+{
+	GsInstallQueue *self = GS_INSTALL_QUEUE (object);
+
+	/* write out anything still pending */
+	g_thread_pool_free (self->pool, FALSE, TRUE);
+	if (self->journal != NULL)
+		g_output_stream_close (self->journal, NULL, NULL);
+	g_clear_object (&self->journal);
+	g_ptr_array_unref (self->ids);
+	g_free (self->filename);
+	g_free (self->filename_journal);
+
+	G_OBJECT_CLASS (gs_install_queue_parent_class)->finalize (object);
+}
+
+static void
+gs_install_queue_class_init (GsInstallQueueClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gs_install_queue_finalize;
+}
+
+static void
+gs_install_queue_init (GsInstallQueue *self)
+{
+	self->ids = g_ptr_array_new_with_free_func (g_free);
+
+	/* a single thread keeps the records in order */
+	self->pool = g_thread_pool_new (gs_install_queue_writer_cb, self,
+					1, FALSE, NULL);
+}
+
+/**
+ * gs_install_queue_new:
+ * @filename: the snapshot filename, e.g. "~/.local/share/unity-software/install-queue"
+ *
+ * Creates a new install queue store. The journal is kept next to
+ * @filename with a ".journal" suffix.
+ *
+ * Returns: a #GsInstallQueue
+ **/
+GsInstallQueue *
+gs_install_queue_new (const gchar *filename)
+{
+	GsInstallQueue *self = g_object_new (GS_TYPE_INSTALL_QUEUE, NULL);
+	self->filename = g_strdup (filename);
+	self->filename_journal = g_strdup_printf ("%s.journal", filename);
+	return self;
+}
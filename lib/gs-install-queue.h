@@ -0,0 +1,30 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2016 Gautham Nair <gautham.nair.2005@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_INSTALL_QUEUE (gs_install_queue_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsInstallQueue, gs_install_queue, GS, INSTALL_QUEUE, GObject)
+
+GsInstallQueue	*gs_install_queue_new		(const gchar	*filename);
+gchar		**gs_install_queue_load		(GsInstallQueue	*self,
+						 GError		**error);
+void		 gs_install_queue_enqueue	(GsInstallQueue	*self,
+						 const gchar	*id);
+void		 gs_install_queue_dequeue	(GsInstallQueue	*self,
+						 const gchar	*id);
+void		 gs_install_queue_complete	(GsInstallQueue	*self,
+						 const gchar	*id);
+void		 gs_install_queue_flush		(GsInstallQueue	*self);
+
+G_END_DECLS
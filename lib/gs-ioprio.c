@@ -142,6 +142,14 @@ gs_ioprio_init (void)
 	}
 }
 
+/* @level is 0 (highest) to 7 (lowest) within the best-effort class */
+void
+gs_ioprio_set_best_effort (gint level)
+{
+	if (set_io_priority_best_effort (CLAMP (level, 0, 7)) == -1)
+		g_message ("Could not set best effort IO priority of %i", level);
+}
+
 #else  /* __linux__ */
 
 void
@@ -149,4 +157,9 @@ gs_ioprio_init (void)
 {
 }
 
+void
+gs_ioprio_set_best_effort (gint level)
+{
+}
+
 #endif /* __linux__ */
@@ -27,5 +27,6 @@
 G_BEGIN_DECLS
 
 void gs_ioprio_init (void);
+void gs_ioprio_set_best_effort (gint level);
 
 G_END_DECLS
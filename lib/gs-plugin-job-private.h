@@ -25,6 +25,10 @@ void			 gs_plugin_job_add_refine_flags		(GsPluginJob	*self,
 void			 gs_plugin_job_remove_refine_flags	(GsPluginJob	*self,
 								 GsPluginRefineFlags refine_flags);
 gboolean		 gs_plugin_job_get_interactive		(GsPluginJob	*self);
+gboolean		 gs_plugin_job_get_staged_refine	(GsPluginJob	*self);
+void			 gs_plugin_job_partial_result		(GsPluginJob	*self,
+								 GsAppList	*list,
+								 GsPluginRefineFlags refine_flags);
 guint			 gs_plugin_job_get_max_results		(GsPluginJob	*self);
 guint			 gs_plugin_job_get_timeout		(GsPluginJob	*self);
 guint64			 gs_plugin_job_get_age			(GsPluginJob	*self);
@@ -21,6 +21,7 @@ struct _GsPluginJob
 	GsPluginRefineFlags	 filter_flags;
 	GsAppListFilterFlags	 dedupe_flags;
 	gboolean		 interactive;
+	gboolean		 staged_refine;
 	guint			 max_results;
 	guint			 timeout;
 	guint64			 age;
@@ -46,6 +47,7 @@ enum {
 	PROP_FILTER_FLAGS,
 	PROP_DEDUPE_FLAGS,
 	PROP_INTERACTIVE,
+	PROP_STAGED_REFINE,
 	PROP_APP,
 	PROP_LIST,
 	PROP_FILE,
@@ -56,6 +58,13 @@ enum {
 	PROP_LAST
 };
 
+enum {
+	SIGNAL_PARTIAL_RESULT,
+	SIGNAL_LAST
+};
+
+static guint signals [SIGNAL_LAST] = { 0 };
+
 G_DEFINE_TYPE (GsPluginJob, gs_plugin_job, G_TYPE_OBJECT)
 
 gchar *
@@ -81,6 +90,8 @@ gs_plugin_job_to_string (GsPluginJob *self)
 	}
 	if (self->interactive)
 		g_string_append_printf (str, " with interactive=True");
+	if (self->staged_refine)
+		g_string_append_printf (str, " with staged-refine=True");
 	if (self->timeout > 0)
 		g_string_append_printf (str, " with timeout=%u", self->timeout);
 	if (self->max_results > 0)
@@ -211,6 +222,65 @@ gs_plugin_job_get_interactive (GsPluginJob *self)
 	return self->interactive;
 }
 
+void
+gs_plugin_job_set_staged_refine (GsPluginJob *self, gboolean staged_refine)
+{
+	g_return_if_fail (GS_IS_PLUGIN_JOB (self));
+	self->staged_refine = staged_refine;
+}
+
+gboolean
+gs_plugin_job_get_staged_refine (GsPluginJob *self)
+{
+	g_return_val_if_fail (GS_IS_PLUGIN_JOB (self), FALSE);
+	return self->staged_refine;
+}
+
+typedef struct {
+	GsPluginJob		*job;
+	GsAppList		*list;
+	GsPluginRefineFlags	 refine_flags;
+} GsPluginJobPartialHelper;
+
+static void
+gs_plugin_job_partial_helper_free (GsPluginJobPartialHelper *helper)
+{
+	g_object_unref (helper->job);
+	g_object_unref (helper->list);
+	g_slice_free (GsPluginJobPartialHelper, helper);
+}
+
+static gboolean
+gs_plugin_job_partial_result_cb (gpointer user_data)
+{
+	GsPluginJobPartialHelper *helper = (GsPluginJobPartialHelper *) user_data;
+	g_signal_emit (helper->job, signals[SIGNAL_PARTIAL_RESULT], 0,
+		       helper->list, (guint64) helper->refine_flags);
+	return G_SOURCE_REMOVE;
+}
+
+/* called from the worker thread once a refine stage has completed; the
+ * signal is always emitted in the default main context so handlers can
+ * touch widgets directly */
+void
+gs_plugin_job_partial_result (GsPluginJob *self,
+			      GsAppList *list,
+			      GsPluginRefineFlags refine_flags)
+{
+	GsPluginJobPartialHelper *helper;
+
+	g_return_if_fail (GS_IS_PLUGIN_JOB (self));
+	g_return_if_fail (GS_IS_APP_LIST (list));
+
+	helper = g_slice_new0 (GsPluginJobPartialHelper);
+	helper->job = g_object_ref (self);
+	helper->list = gs_app_list_copy (list);
+	helper->refine_flags = refine_flags;
+	g_main_context_invoke_full (NULL, G_PRIORITY_DEFAULT,
+				    gs_plugin_job_partial_result_cb, helper,
+				    (GDestroyNotify) gs_plugin_job_partial_helper_free);
+}
+
 void
 gs_plugin_job_set_max_results (GsPluginJob *self, guint max_results)
 {
@@ -424,6 +494,9 @@ gs_plugin_job_get_property (GObject *obj, guint prop_id, GValue *value, GParamSp
 	case PROP_INTERACTIVE:
 		g_value_set_boolean (value, self->interactive);
 		break;
+	case PROP_STAGED_REFINE:
+		g_value_set_boolean (value, self->staged_refine);
+		break;
 	case PROP_SEARCH:
 		g_value_set_string (value, self->search);
 		break;
@@ -478,6 +551,9 @@ gs_plugin_job_set_property (GObject *obj, guint prop_id, const GValue *value, GP
 	case PROP_INTERACTIVE:
 		gs_plugin_job_set_interactive (self, g_value_get_boolean (value));
 		break;
+	case PROP_STAGED_REFINE:
+		gs_plugin_job_set_staged_refine (self, g_value_get_boolean (value));
+		break;
 	case PROP_SEARCH:
 		gs_plugin_job_set_search (self, g_value_get_string (value));
 		break;
@@ -564,6 +640,17 @@ gs_plugin_job_class_init (GsPluginJobClass *klass)
 
 	g_object_class_install_property (object_class, PROP_INTERACTIVE, pspec);
 
+	/**
+	 * GsPluginJob:staged-refine:
+	 *
+	 * Run the refine in stages, cheapest flags first, emitting
+	 * #GsPluginJob::partial-result as each stage completes.
+	 */
+	pspec = g_param_spec_boolean ("staged-refine", NULL, NULL,
+				      FALSE,
+				      G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_STAGED_REFINE, pspec);
+
 	pspec = g_param_spec_string ("search", NULL, NULL,
 				     NULL,
 				     G_PARAM_READWRITE);
@@ -603,6 +690,20 @@ gs_plugin_job_class_init (GsPluginJobClass *klass)
 				   0, G_MAXUINT, 60,
 				   G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
 	g_object_class_install_property (object_class, PROP_TIMEOUT, pspec);
+
+	/**
+	 * GsPluginJob::partial-result:
+	 * @list: the #GsAppList refined so far
+	 * @refine_flags: the #GsPluginRefineFlags already satisfied
+	 *
+	 * Emitted in the main context after each stage of a staged refine,
+	 * except the last one which completes the job as normal.
+	 */
+	signals [SIGNAL_PARTIAL_RESULT] =
+		g_signal_new ("partial-result",
+			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
+			      0, NULL, NULL, g_cclosure_marshal_generic,
+			      G_TYPE_NONE, 2, GS_TYPE_APP_LIST, G_TYPE_UINT64);
 }
 
 static void
@@ -28,6 +28,8 @@ void		 gs_plugin_job_set_dedupe_flags		(GsPluginJob	*self,
 							 GsAppListFilterFlags dedupe_flags);
 void		 gs_plugin_job_set_interactive		(GsPluginJob	*self,
 							 gboolean	 interactive);
+void		 gs_plugin_job_set_staged_refine	(GsPluginJob	*self,
+							 gboolean	 staged_refine);
 void		 gs_plugin_job_set_max_results		(GsPluginJob	*self,
 							 guint		 max_results);
 void		 gs_plugin_job_set_timeout		(GsPluginJob	*self,
@@ -0,0 +1,26 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2016 Gautham Nair <gautham.nair.2005@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include "gs-plugin-loader.h"
+
+G_BEGIN_DECLS
+
+void		 gs_plugin_loader_app_cache_canonicalize	(GsPluginLoader	*plugin_loader,
+								 GsAppList	*list);
+void		 gs_plugin_loader_app_cache_update		(GsPluginLoader	*plugin_loader,
+								 GsAppList	*list);
+void		 gs_plugin_loader_get_app_cache_stats		(GsPluginLoader	*plugin_loader,
+								 guint		*n_apps,
+								 guint64	*size,
+								 guint		*hits,
+								 guint		*misses,
+								 guint		*evictions);
+
+G_END_DECLS
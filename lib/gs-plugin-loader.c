@@ -22,8 +22,9 @@
 #include "gs-app-private.h"
 #include "gs-app-list-private.h"
 #include "gs-category-private.h"
+#include "gs-install-queue.h"
 #include "gs-ioprio.h"
-#include "gs-plugin-loader.h"
+#include "gs-plugin-loader-private.h"
 #include "gs-plugin.h"
 #include "gs-plugin-event.h"
 #include "gs-plugin-job-private.h"
@@ -46,20 +47,44 @@ typedef struct
 
 	GMutex			 pending_apps_mutex;
 	GPtrArray		*pending_apps;
+	GsInstallQueue		*install_queue;
+	GsAppList		*install_queue_unrefined;	/* (nullable), under pending_apps_mutex */
 
 	GThreadPool		*queued_ops_pool;
+	gint			 queued_ops_seq;	/* atomic */
+	GMutex			 queued_ops_mutex;
+	GPtrArray		*queued_ops_running;	/* of GsPluginLoaderAttempt, under queued_ops_mutex */
+	GThreadPool		*results_pool;
+	gint			 results_pool_busy;	/* atomic */
 
 	GSettings		*settings;
 
 	GMutex			 events_by_id_mutex;
 	GHashTable		*events_by_id;		/* unique-id : GsPluginEvent */
 
+	GHashTable		*metrics;		/* GsPlugin : GsPluginLoaderMetrics */
+
+	GMutex			 flights_mutex;
+	GHashTable		*flights;		/* fingerprint : GsPluginLoaderFlight */
+	guint			 flights_hits;
+	guint			 flights_misses;
+
+	GMutex			 app_cache_mutex;
+	GHashTable		*app_cache;		/* unique-id : GList link in app_cache_lru */
+	GQueue			 app_cache_lru;		/* of GsPluginLoaderAppCacheItem, newest first */
+	guint64			 app_cache_size;
+	guint64			 app_cache_size_max;
+	guint			 app_cache_hits;
+	guint			 app_cache_misses;
+	guint			 app_cache_evictions;
+
 	gchar			**compatible_projects;
 	guint			 scale;
 
 	guint			 updates_changed_id;
 	guint			 updates_changed_cnt;
 	guint			 reload_id;
+	gint			 refine_generation;	/* atomic */
 	GHashTable		*disallow_updates;	/* GsPlugin : const char *name */
 
 	GNetworkMonitor		*network_monitor;
@@ -72,9 +97,21 @@ typedef struct
 #endif
 } GsPluginLoaderPrivate;
 
+/* vfunc latency histogram buckets: the first is for calls under 1ms, then
+ * each bucket doubles, and the last also holds anything over ~16 seconds */
+#define GS_PLUGIN_LOADER_METRICS_BUCKETS	16
+
+typedef struct {
+	gint		 buckets[GS_PLUGIN_ACTION_LAST][GS_PLUGIN_LOADER_METRICS_BUCKETS];
+} GsPluginLoaderMetrics;
+
 static void gs_plugin_loader_monitor_network (GsPluginLoader *plugin_loader);
 static void add_app_to_install_queue (GsPluginLoader *plugin_loader, GsApp *app);
+static void gs_plugin_loader_process_install_queue (GsPluginLoader *plugin_loader, gboolean install);
 static void gs_plugin_loader_process_in_thread_pool_cb (gpointer data, gpointer user_data);
+static gint gs_plugin_loader_queued_ops_sort_cb (gconstpointer a, gconstpointer b, gpointer user_data);
+static void gs_plugin_loader_app_cache_clear (GsPluginLoader *plugin_loader);
+static void gs_plugin_loader_app_cache_set_size_max (GsPluginLoader *plugin_loader);
 
 G_DEFINE_TYPE_WITH_PRIVATE (GsPluginLoader, gs_plugin_loader, G_TYPE_OBJECT)
 
@@ -182,6 +219,13 @@ typedef gboolean	 (*GsPluginGetLangPacksFunc)	(GsPlugin	*plugin,
 							 GError		**error);
 
 
+/* priority lanes for the queued operations thread pool */
+typedef enum {
+	GS_PLUGIN_LOADER_LANE_INTERACTIVE,
+	GS_PLUGIN_LOADER_LANE_NORMAL,
+	GS_PLUGIN_LOADER_LANE_BACKGROUND,
+} GsPluginLoaderLane;
+
 /* async helper */
 typedef struct {
 	GsPluginLoader			*plugin_loader;
@@ -192,10 +236,14 @@ typedef struct {
 	const gchar			*function_name_parent;
 	GPtrArray			*catlist;
 	GsPluginJob			*plugin_job;
-	gboolean			 anything_ran;
+	gint				 anything_ran;	/* atomic */
 	guint				 timeout_id;
 	gboolean			 timeout_triggered;
+	gboolean			 in_parallel;
+	gint				 vfunc_failed;	/* atomic */
 	gchar				**tokens;
+	GsPluginLoaderLane		 lane;
+	guint				 seq;
 } GsPluginLoaderHelper;
 
 static GsPluginLoaderHelper *
@@ -498,6 +546,25 @@ gs_plugin_loader_review_score_sort_cb (gconstpointer a, gconstpointer b)
 	return 0;
 }
 
+static void
+gs_plugin_loader_metrics_add (GsPluginLoaderPrivate *priv,
+			      GsPlugin *plugin,
+			      GsPluginAction action,
+			      gdouble elapsed)
+{
+	GsPluginLoaderMetrics *metrics;
+	gulong msecs = (gulong) (elapsed * 1000);
+	guint bucket;
+
+	/* only modified when the plugins are opened */
+	metrics = g_hash_table_lookup (priv->metrics, plugin);
+	if (metrics == NULL || action >= GS_PLUGIN_ACTION_LAST)
+		return;
+	bucket = msecs > 0 ? g_bit_storage (msecs) : 0;
+	bucket = MIN (bucket, GS_PLUGIN_LOADER_METRICS_BUCKETS - 1);
+	g_atomic_int_inc (&metrics->buckets[action][bucket]);
+}
+
 static gboolean
 gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 			     GsPlugin *plugin,
@@ -507,9 +574,7 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 			     GCancellable *cancellable,
 			     GError **error)
 {
-#ifdef HAVE_SYSPROF
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
-#endif
 	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
 	gboolean ret = TRUE;
 	gpointer func = NULL;
@@ -532,8 +597,10 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 	if (refine_flags == GS_PLUGIN_REFINE_FLAGS_DEFAULT)
 		refine_flags = gs_plugin_job_get_refine_flags (helper->plugin_job);
 
-	/* set what plugin is running on the job */
-	gs_plugin_job_set_plugin (helper->plugin_job, plugin);
+	/* set what plugin is running on the job; this is meaningless when
+	 * several plugins are running at the same time */
+	if (!helper->in_parallel)
+		gs_plugin_job_set_plugin (helper->plugin_job, plugin);
 
 	/* run the correct vfunc */
 	if (gs_plugin_job_get_interactive (helper->plugin_job))
@@ -740,6 +807,7 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 				     "too long to return results",
 				     gs_plugin_get_name (plugin));
 		}
+		g_atomic_int_set (&helper->vfunc_failed, TRUE);
 		return gs_plugin_error_handle_failure (helper,
 							plugin,
 							error_local,
@@ -770,6 +838,10 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 	}
 #endif  /* HAVE_SYSPROF */
 
+	/* record the latency */
+	gs_plugin_loader_metrics_add (priv, plugin, action,
+				      g_timer_elapsed (timer, NULL));
+
 	/* check the plugin didn't take too long */
 	if (g_timer_elapsed (timer, NULL) > 1.0f) {
 		GLogLevelFlags log_level;
@@ -798,7 +870,7 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 	}
 
 	/* success */
-	helper->anything_ran = TRUE;
+	g_atomic_int_set (&helper->anything_ran, TRUE);
 	return TRUE;
 }
 
@@ -808,6 +880,52 @@ gs_plugin_loader_app_is_non_wildcard (GsApp *app, gpointer user_data)
 	return !gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD);
 }
 
+/* returns the apps in @list that @plugin has not already refined with
+ * @refine_flags at the current data generation */
+static GsAppList *
+gs_plugin_loader_refine_ledger_filter (GsAppList *list,
+				       GsPlugin *plugin,
+				       GsPluginRefineFlags refine_flags,
+				       guint generation)
+{
+	GsAppList *list_todo = gs_app_list_new ();
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		if (!gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD) &&
+		    gs_app_refine_ledger_covers (app, gs_plugin_get_name (plugin),
+						 refine_flags, generation))
+			continue;
+		gs_app_list_add (list_todo, app);
+	}
+	return list_todo;
+}
+
+/* the plugin may have added or removed apps from the subset it was given,
+ * so mirror those changes back onto the full list */
+static void
+gs_plugin_loader_refine_ledger_merge (GsAppList *list,
+				      GsAppList *list_before,
+				      GsAppList *list_after)
+{
+	g_autoptr(GHashTable) before = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_autoptr(GHashTable) after = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	for (guint i = 0; i < gs_app_list_length (list_before); i++)
+		g_hash_table_add (before, gs_app_list_index (list_before, i));
+	for (guint i = 0; i < gs_app_list_length (list_after); i++)
+		g_hash_table_add (after, gs_app_list_index (list_after, i));
+	for (guint i = 0; i < gs_app_list_length (list_before); i++) {
+		GsApp *app = gs_app_list_index (list_before, i);
+		if (!g_hash_table_contains (after, app))
+			gs_app_list_remove (list, app);
+	}
+	for (guint i = 0; i < gs_app_list_length (list_after); i++) {
+		GsApp *app = gs_app_list_index (list_after, i);
+		if (!g_hash_table_contains (before, app))
+			gs_app_list_add (list, app);
+	}
+}
+
 static gboolean
 gs_plugin_loader_run_refine_filter (GsPluginLoaderHelper *helper,
 				    GsAppList *list,
@@ -816,18 +934,45 @@ gs_plugin_loader_run_refine_filter (GsPluginLoaderHelper *helper,
 				    GError **error)
 {
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
+	guint generation = (guint) g_atomic_int_get (&priv->refine_generation);
+
+	if (refine_flags == GS_PLUGIN_REFINE_FLAGS_DEFAULT)
+		refine_flags = gs_plugin_job_get_refine_flags (helper->plugin_job);
 
 	/* run each plugin */
 	for (guint i = 0; i < priv->plugins->len; i++) {
 		GsPlugin *plugin = g_ptr_array_index (priv->plugins, i);
+		guint plugin_generation = generation + gs_plugin_get_refine_generation (plugin);
 		g_autoptr(GsAppList) app_list = NULL;
+		g_autoptr(GsAppList) list_todo = NULL;
+		g_autoptr(GsAppList) list_before = NULL;
+
+		/* skip apps this plugin has already refined with these flags */
+		list_todo = gs_plugin_loader_refine_ledger_filter (list, plugin,
+								   refine_flags,
+								   plugin_generation);
+		if (gs_app_list_length (list_todo) == 0) {
+			g_debug ("skipping %s refine as all %u apps are covered",
+				 gs_plugin_get_name (plugin),
+				 gs_app_list_length (list));
+			continue;
+		}
+		if (gs_app_list_length (list_todo) == gs_app_list_length (list)) {
+			g_clear_object (&list_todo);
+			list_todo = g_object_ref (list);
+		} else {
+			list_before = gs_app_list_copy (list_todo);
+		}
 
 		/* run the batched plugin symbol then refine wildcards per-app */
 		helper->function_name = "gs_plugin_refine";
-		if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, list,
+		g_atomic_int_set (&helper->vfunc_failed, FALSE);
+		if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, list_todo,
 						  refine_flags, cancellable, error)) {
 			return FALSE;
 		}
+		if (list_before != NULL)
+			gs_plugin_loader_refine_ledger_merge (list, list_before, list_todo);
 
 		if (gs_plugin_get_symbol (plugin, "gs_plugin_refine_wildcard") != NULL) {
 			/* use a copy of the list for the loop because a function called
@@ -847,6 +992,17 @@ gs_plugin_loader_run_refine_filter (GsPluginLoaderHelper *helper,
 			}
 		}
 
+		/* only record what actually succeeded so failures get retried */
+		if (!g_atomic_int_get (&helper->vfunc_failed)) {
+			for (guint j = 0; j < gs_app_list_length (list_todo); j++) {
+				GsApp *app = gs_app_list_index (list_todo, j);
+				if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD))
+					continue;
+				gs_app_refine_ledger_add (app, gs_plugin_get_name (plugin),
+							  refine_flags, plugin_generation);
+			}
+		}
+
 		gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
 	}
 
@@ -966,15 +1122,6 @@ gs_plugin_loader_run_refine_internal (GsPluginLoaderHelper *helper,
 	return TRUE;
 }
 
-static gboolean
-app_thaw_notify_idle (gpointer data)
-{
-	GsApp *app = GS_APP (data);
-	g_object_thaw_notify (G_OBJECT (app));
-	g_object_unref (app);
-	return G_SOURCE_REMOVE;
-}
-
 static gboolean
 gs_plugin_loader_run_refine (GsPluginLoaderHelper *helper,
 			     GsAppList *list,
@@ -1041,8 +1188,74 @@ out:
 	/* now emit all the changed signals */
 	for (guint i = 0; i < gs_app_list_length (freeze_list); i++) {
 		GsApp *app = gs_app_list_index (freeze_list, i);
-		g_idle_add (app_thaw_notify_idle, g_object_ref (app));
+		gs_app_queue_thaw_notify (app);
+	}
+	return ret;
+}
+
+/* refine flags grouped by how expensive they usually are to satisfy */
+#define GS_PLUGIN_LOADER_REFINE_TIER_NETWORK	(GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS | \
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEW_RATINGS)
+#define GS_PLUGIN_LOADER_REFINE_TIER_SYSTEM	(GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE | \
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING | \
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_HISTORY | \
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS | \
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_SEVERITY | \
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_KEY_COLORS | \
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_PERMISSIONS | \
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN_HOSTNAME | \
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN_UI)
+#define GS_PLUGIN_LOADER_REFINE_MODIFIERS	(GS_PLUGIN_REFINE_FLAGS_ALLOW_PACKAGES | \
+						 GS_PLUGIN_REFINE_FLAGS_USE_HISTORY)
+
+/* runs the refine once per cost tier, local metadata first, then disk and
+ * D-Bus, then network, so the caller can render partial results early */
+static gboolean
+gs_plugin_loader_run_refine_staged (GsPluginLoaderHelper *helper,
+				    GsAppList *list,
+				    GCancellable *cancellable,
+				    GError **error)
+{
+	GsPluginRefineFlags refine_flags;
+	GsPluginRefineFlags modifiers;
+	GsPluginRefineFlags refine_flags_done = 0;
+	GsPluginRefineFlags tiers[3];
+	guint tiers_len = 0;
+	gboolean ret = TRUE;
+
+	refine_flags = gs_plugin_job_get_refine_flags (helper->plugin_job);
+	modifiers = refine_flags & GS_PLUGIN_LOADER_REFINE_MODIFIERS;
+	tiers[0] = refine_flags & ~(GS_PLUGIN_LOADER_REFINE_TIER_SYSTEM |
+				    GS_PLUGIN_LOADER_REFINE_TIER_NETWORK |
+				    GS_PLUGIN_LOADER_REFINE_MODIFIERS);
+	tiers[1] = refine_flags & GS_PLUGIN_LOADER_REFINE_TIER_SYSTEM;
+	tiers[2] = refine_flags & GS_PLUGIN_LOADER_REFINE_TIER_NETWORK;
+
+	/* drop empty tiers so the last stage is known up front */
+	for (guint i = 0; i < G_N_ELEMENTS (tiers); i++) {
+		if (tiers[i] != 0)
+			tiers[tiers_len++] = tiers[i];
+	}
+	if (tiers_len <= 1)
+		return gs_plugin_loader_run_refine (helper, list, cancellable, error);
+
+	for (guint i = 0; i < tiers_len; i++) {
+		gs_plugin_job_set_refine_flags (helper->plugin_job, tiers[i] | modifiers);
+		ret = gs_plugin_loader_run_refine (helper, list, cancellable, error);
+		if (!ret)
+			break;
+		refine_flags_done |= tiers[i] | modifiers;
+		if (i + 1 < tiers_len) {
+			g_autofree gchar *tmp = gs_plugin_refine_flags_to_string (tiers[i]);
+			g_debug ("staged refine of %s done, %u stage(s) remaining",
+				 tmp, tiers_len - i - 1);
+			gs_plugin_job_partial_result (helper->plugin_job, list,
+						      refine_flags_done);
+		}
 	}
+
+	/* restore the refine flags so that gs_app_list_filter sees the right thing */
+	gs_plugin_job_set_refine_flags (helper->plugin_job, refine_flags);
 	return ret;
 }
 
@@ -1101,30 +1314,295 @@ gs_plugin_loader_job_sorted_truncation (GsPluginLoaderHelper *helper)
 	gs_app_list_truncate (list, max_results);
 }
 
+/* a plugin scheduled as part of a concurrent batch */
+typedef struct _GsPluginLoaderNode GsPluginLoaderNode;
+
+typedef struct {
+	GsPluginLoaderHelper	*helper;
+	GCancellable		*cancellable;
+	GThreadPool		*pool;
+	gint			*pool_busy;	/* atomic */
+	GMutex			 mutex;
+	GCond			 cond;
+	GQueue			 inline_nodes;	/* to run in the waiting thread */
+	guint			 n_running;	/* pushed, not finished */
+	GError			*error;		/* first fatal error, if any */
+} GsPluginLoaderBatch;
+
+struct _GsPluginLoaderNode {
+	GsPluginLoaderBatch	*batch;
+	GsPlugin		*plugin;
+	GsAppList		*list;		/* private results for this plugin */
+	GPtrArray		*dependents;	/* of GsPluginLoaderNode */
+	guint			 n_deps;	/* unfinished dependencies */
+};
+
+static void
+gs_plugin_loader_node_free (GsPluginLoaderNode *node)
+{
+	g_object_unref (node->plugin);
+	g_object_unref (node->list);
+	g_ptr_array_unref (node->dependents);
+	g_slice_free (GsPluginLoaderNode, node);
+}
+
+/* only the actions that add to a list they do not otherwise read */
+static gboolean
+gs_plugin_loader_action_supports_parallel (GsPluginAction action)
+{
+	switch (action) {
+	case GS_PLUGIN_ACTION_GET_ALTERNATES:
+	case GS_PLUGIN_ACTION_GET_CATEGORY_APPS:
+	case GS_PLUGIN_ACTION_GET_FEATURED:
+	case GS_PLUGIN_ACTION_GET_INSTALLED:
+	case GS_PLUGIN_ACTION_GET_POPULAR:
+	case GS_PLUGIN_ACTION_GET_RECENT:
+	case GS_PLUGIN_ACTION_GET_SOURCES:
+	case GS_PLUGIN_ACTION_GET_UPDATES:
+	case GS_PLUGIN_ACTION_GET_UPDATES_HISTORICAL:
+	case GS_PLUGIN_ACTION_SEARCH:
+	case GS_PLUGIN_ACTION_SEARCH_FILES:
+	case GS_PLUGIN_ACTION_SEARCH_PROVIDES:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* does @plugin have to wait for @dep to finish */
+static gboolean
+gs_plugin_loader_plugin_runs_after (GsPlugin *plugin, GsPlugin *dep)
+{
+	GPtrArray *rules;
+
+	rules = gs_plugin_get_rules (plugin, GS_PLUGIN_RULE_RUN_AFTER);
+	for (guint i = 0; i < rules->len; i++) {
+		if (g_strcmp0 (g_ptr_array_index (rules, i), gs_plugin_get_name (dep)) == 0)
+			return TRUE;
+	}
+	rules = gs_plugin_get_rules (dep, GS_PLUGIN_RULE_RUN_BEFORE);
+	for (guint i = 0; i < rules->len; i++) {
+		if (g_strcmp0 (g_ptr_array_index (rules, i), gs_plugin_get_name (plugin)) == 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* called with batch->mutex held; when every thread in the pool is busy the
+ * node is run by the thread waiting on the batch instead, as the busy threads
+ * may themselves be blocked on a nested job that needs the pool */
+static void
+gs_plugin_loader_batch_push (GsPluginLoaderBatch *batch, GsPluginLoaderNode *node)
+{
+	batch->n_running++;
+	if (g_atomic_int_get (batch->pool_busy) >= g_thread_pool_get_max_threads (batch->pool)) {
+		g_queue_push_tail (&batch->inline_nodes, node);
+		g_cond_signal (&batch->cond);
+		return;
+	}
+	g_atomic_int_inc (batch->pool_busy);
+	g_thread_pool_push (batch->pool, node, NULL);
+}
+
+static void
+gs_plugin_loader_run_results_node_cb (gpointer data, gpointer user_data)
+{
+	GsPluginLoaderNode *node = (GsPluginLoaderNode *) data;
+	GsPluginLoaderBatch *batch = node->batch;
+	gboolean ret;
+	g_autoptr(GError) error_local = NULL;
+
+	if (g_cancellable_set_error_if_cancelled (batch->cancellable, &error_local)) {
+		gs_utils_error_convert_gio (&error_local);
+		ret = FALSE;
+	} else {
+		ret = gs_plugin_loader_call_vfunc (batch->helper, node->plugin,
+						   NULL, node->list,
+						   GS_PLUGIN_REFINE_FLAGS_DEFAULT,
+						   batch->cancellable, &error_local);
+		gs_plugin_status_update (node->plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
+	}
+
+	g_mutex_lock (&batch->mutex);
+	if (!ret && batch->error == NULL)
+		batch->error = g_steal_pointer (&error_local);
+
+	/* start anything that was only waiting for this plugin */
+	for (guint i = 0; i < node->dependents->len; i++) {
+		GsPluginLoaderNode *dependent = g_ptr_array_index (node->dependents, i);
+		if (--dependent->n_deps == 0 && batch->error == NULL)
+			gs_plugin_loader_batch_push (batch, dependent);
+	}
+	batch->n_running--;
+	g_cond_signal (&batch->cond);
+	g_mutex_unlock (&batch->mutex);
+}
+
+static void
+gs_plugin_loader_run_results_pool_cb (gpointer data, gpointer user_data)
+{
+	GsPluginLoaderNode *node = (GsPluginLoaderNode *) data;
+	gint *pool_busy = node->batch->pool_busy;
+
+	/* the batch may be gone as soon as the node has finished */
+	gs_plugin_loader_run_results_node_cb (node, user_data);
+	g_atomic_int_add (pool_busy, -1);
+}
+
+/* runs @plugins concurrently, each into a private list, honouring any
+ * RUN_AFTER and RUN_BEFORE rules between them, and then merges the
+ * results into @list in plugin order so the output is deterministic */
+static gboolean
+gs_plugin_loader_run_results_parallel (GsPluginLoaderHelper *helper,
+				       GPtrArray *plugins,
+				       GsAppList *list,
+				       GCancellable *cancellable,
+				       GError **error)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
+	GsPluginLoaderBatch batch = {
+		.helper = helper,
+		.cancellable = cancellable,
+		.pool = priv->results_pool,
+		.pool_busy = &priv->results_pool_busy,
+	};
+	g_autoptr(GPtrArray) nodes = NULL;
+
+	/* build the DAG; dependencies are always earlier in the plugin order */
+	nodes = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_plugin_loader_node_free);
+	for (guint i = 0; i < plugins->len; i++) {
+		GsPluginLoaderNode *node = g_slice_new0 (GsPluginLoaderNode);
+		node->batch = &batch;
+		node->plugin = g_object_ref (g_ptr_array_index (plugins, i));
+		node->list = gs_app_list_new ();
+		node->dependents = g_ptr_array_new ();
+		for (guint j = 0; j < i; j++) {
+			GsPluginLoaderNode *dep = g_ptr_array_index (nodes, j);
+			if (gs_plugin_loader_plugin_runs_after (node->plugin, dep->plugin)) {
+				g_ptr_array_add (dep->dependents, node);
+				node->n_deps++;
+			}
+		}
+		g_ptr_array_add (nodes, node);
+	}
+
+	/* start all the roots, then wait for everything to finish */
+	g_mutex_init (&batch.mutex);
+	g_cond_init (&batch.cond);
+	g_queue_init (&batch.inline_nodes);
+	helper->in_parallel = TRUE;
+	g_mutex_lock (&batch.mutex);
+	for (guint i = 0; i < nodes->len; i++) {
+		GsPluginLoaderNode *node = g_ptr_array_index (nodes, i);
+		if (node->n_deps == 0)
+			gs_plugin_loader_batch_push (&batch, node);
+	}
+	while (batch.n_running > 0) {
+		GsPluginLoaderNode *node = g_queue_pop_head (&batch.inline_nodes);
+		if (node == NULL) {
+			g_cond_wait (&batch.cond, &batch.mutex);
+			continue;
+		}
+		g_mutex_unlock (&batch.mutex);
+		gs_plugin_loader_run_results_node_cb (node, NULL);
+		g_mutex_lock (&batch.mutex);
+	}
+	g_mutex_unlock (&batch.mutex);
+	helper->in_parallel = FALSE;
+	g_mutex_clear (&batch.mutex);
+	g_cond_clear (&batch.cond);
+
+	if (batch.error != NULL) {
+		g_propagate_error (error, batch.error);
+		return FALSE;
+	}
+
+	/* merge in plugin order */
+	for (guint i = 0; i < nodes->len; i++) {
+		GsPluginLoaderNode *node = g_ptr_array_index (nodes, i);
+		gs_app_list_add_list (list, node->list);
+	}
+	return TRUE;
+}
+
+static gboolean
+gs_plugin_loader_run_results_plugin (GsPluginLoaderHelper *helper,
+				     GsPlugin *plugin,
+				     GCancellable *cancellable,
+				     GError **error)
+{
+	if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+		gs_utils_error_convert_gio (error);
+		return FALSE;
+	}
+	if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, NULL,
+					  GS_PLUGIN_REFINE_FLAGS_DEFAULT,
+					  cancellable, error)) {
+		return FALSE;
+	}
+	gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
+	return TRUE;
+}
+
+static gboolean
+gs_plugin_loader_run_results_flush (GsPluginLoaderHelper *helper,
+				    GPtrArray *batch,
+				    GCancellable *cancellable,
+				    GError **error)
+{
+	g_autoptr(GPtrArray) plugins = g_ptr_array_new ();
+
+	for (guint i = 0; i < batch->len; i++)
+		g_ptr_array_add (plugins, g_ptr_array_index (batch, i));
+	g_ptr_array_set_size (batch, 0);
+	if (plugins->len == 0)
+		return TRUE;
+	if (plugins->len == 1) {
+		return gs_plugin_loader_run_results_plugin (helper,
+							    g_ptr_array_index (plugins, 0),
+							    cancellable, error);
+	}
+	return gs_plugin_loader_run_results_parallel (helper, plugins,
+						      gs_plugin_job_get_list (helper->plugin_job),
+						      cancellable, error);
+}
+
 static gboolean
 gs_plugin_loader_run_results (GsPluginLoaderHelper *helper,
 			      GCancellable *cancellable,
 			      GError **error)
 {
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
+	gboolean parallel;
+	g_autoptr(GPtrArray) batch = g_ptr_array_new ();
 #ifdef HAVE_SYSPROF
 	gint64 begin_time_nsec G_GNUC_UNUSED = SYSPROF_CAPTURE_CURRENT_TIME;
 #endif
 
-	/* run each plugin */
+	parallel = gs_plugin_job_get_list (helper->plugin_job) != NULL &&
+		   gs_plugin_loader_action_supports_parallel (gs_plugin_job_get_action (helper->plugin_job));
+
+	/* run each plugin; consecutive plugins which are safe to run at the
+	 * same time are batched, and the batch is flushed before running any
+	 * plugin that might need to see the results of the previous ones */
 	for (guint i = 0; i < priv->plugins->len; i++) {
 		GsPlugin *plugin = g_ptr_array_index (priv->plugins, i);
-		if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
-			gs_utils_error_convert_gio (error);
-			return FALSE;
+
+		/* plugins that do not implement the action cannot split a batch */
+		if (gs_plugin_get_symbol (plugin, helper->function_name) == NULL)
+			continue;
+		if (parallel &&
+		    gs_plugin_has_flags (plugin, GS_PLUGIN_FLAGS_PARALLEL_RESULTS)) {
+			g_ptr_array_add (batch, plugin);
+			continue;
 		}
-		if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, NULL,
-						  GS_PLUGIN_REFINE_FLAGS_DEFAULT,
-						  cancellable, error)) {
+		if (!gs_plugin_loader_run_results_flush (helper, batch, cancellable, error))
+			return FALSE;
+		if (!gs_plugin_loader_run_results_plugin (helper, plugin, cancellable, error))
 			return FALSE;
-		}
-		gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
 	}
+	if (!gs_plugin_loader_run_results_flush (helper, batch, cancellable, error))
+		return FALSE;
 
 #ifdef HAVE_SYSPROF
 	if (priv->sysprof_writer != NULL) {
@@ -1748,95 +2226,48 @@ static gboolean
 load_install_queue (GsPluginLoader *plugin_loader, GError **error)
 {
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
-	g_autofree gchar *contents = NULL;
 	g_autofree gchar *file = NULL;
 	g_auto(GStrv) names = NULL;
 	g_autoptr(GsAppList) list = NULL;
 
-	/* load from file */
+	/* replay the snapshot and journal */
 	file = g_build_filename (g_get_user_data_dir (),
 				 "unity-software",
 				 "install-queue",
 				 NULL);
-	if (!g_file_test (file, G_FILE_TEST_EXISTS))
-		return TRUE;
-	g_debug ("loading install queue from %s", file);
-	if (!g_file_get_contents (file, &contents, NULL, error))
+	g_clear_object (&priv->install_queue);
+	priv->install_queue = gs_install_queue_new (file);
+	names = gs_install_queue_load (priv->install_queue, error);
+	if (names == NULL)
 		return FALSE;
 
 	/* add to GsAppList, deduplicating if required */
 	list = gs_app_list_new ();
-	names = g_strsplit (contents, "\n", 0);
 	for (guint i = 0; names[i] != NULL; i++) {
-		g_autoptr(GsApp) app = NULL;
-		if (strlen (names[i]) == 0)
-			continue;
-		app = gs_app_new (names[i]);
+		g_autoptr(GsApp) app = gs_app_new (names[i]);
 		gs_app_set_state (app, AS_APP_STATE_QUEUED_FOR_INSTALL);
 		gs_app_list_add (list, app);
 	}
+	if (gs_app_list_length (list) == 0)
+		return TRUE;
 
-	/* add to pending list */
+	/* add to pending list; these are only refined once there is a
+	 * network to install them over, so startup is not held up */
 	g_mutex_lock (&priv->pending_apps_mutex);
 	for (guint i = 0; i < gs_app_list_length (list); i++) {
 		GsApp *app = gs_app_list_index (list, i);
 		g_debug ("adding pending app %s", gs_app_get_unique_id (app));
 		g_ptr_array_add (priv->pending_apps, g_object_ref (app));
 	}
+	g_set_object (&priv->install_queue_unrefined, list);
 	g_mutex_unlock (&priv->pending_apps_mutex);
+	g_idle_add (emit_pending_apps_idle, g_object_ref (plugin_loader));
 
-	/* refine */
-	if (gs_app_list_length (list) > 0) {
-		g_autoptr(GsPluginLoaderHelper) helper = NULL;
-		g_autoptr(GsPluginJob) plugin_job = NULL;
-		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE, NULL);
-		helper = gs_plugin_loader_helper_new (plugin_loader, plugin_job);
-		if (!gs_plugin_loader_run_refine (helper, list, NULL, error))
-			return FALSE;
-	}
+	if (gs_plugin_loader_get_network_available (plugin_loader))
+		gs_plugin_loader_process_install_queue (plugin_loader, FALSE);
 	return TRUE;
 }
 
-static void
-save_install_queue (GsPluginLoader *plugin_loader)
-{
-	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
-	GPtrArray *pending_apps;
-	gboolean ret;
-	gint i;
-	g_autoptr(GError) error = NULL;
-	g_autoptr(GString) s = NULL;
-	g_autofree gchar *file = NULL;
-
-	s = g_string_new ("");
-	pending_apps = priv->pending_apps;
-	g_mutex_lock (&priv->pending_apps_mutex);
-	for (i = (gint) pending_apps->len - 1; i >= 0; i--) {
-		GsApp *app;
-		app = g_ptr_array_index (pending_apps, i);
-		if (gs_app_get_state (app) == AS_APP_STATE_QUEUED_FOR_INSTALL) {
-			g_string_append (s, gs_app_get_id (app));
-			g_string_append_c (s, '\n');
-		}
-	}
-	g_mutex_unlock (&priv->pending_apps_mutex);
-
-	/* save file */
-	file = g_build_filename (g_get_user_data_dir (),
-				 "unity-software",
-				 "install-queue",
-				 NULL);
-	if (!gs_mkdir_parent (file, &error)) {
-		g_warning ("failed to create dir for %s: %s",
-			   file, error->message);
-		return;
-	}
-	g_debug ("saving install queue to %s", file);
-	ret = g_file_set_contents (file, s->str, (gssize) s->len, &error);
-	if (!ret)
-		g_warning ("failed to save install queue: %s", error->message);
-}
-
 static void
 add_app_to_install_queue (GsPluginLoader *plugin_loader, GsApp *app)
 {
@@ -1853,7 +2284,8 @@ add_app_to_install_queue (GsPluginLoader *plugin_loader, GsApp *app)
 	gs_app_set_state (app, AS_APP_STATE_QUEUED_FOR_INSTALL);
 	id = g_idle_add (emit_pending_apps_idle, g_object_ref (plugin_loader));
 	g_source_set_name_by_id (id, "[unity-software] emit_pending_apps_idle");
-	save_install_queue (plugin_loader);
+	if (priv->install_queue != NULL)
+		gs_install_queue_enqueue (priv->install_queue, gs_app_get_id (app));
 
 	/* recursively queue any addons */
 	addons = gs_app_get_addons (app);
@@ -1881,7 +2313,8 @@ remove_app_from_install_queue (GsPluginLoader *plugin_loader, GsApp *app)
 		gs_app_set_state (app, AS_APP_STATE_AVAILABLE);
 		id = g_idle_add (emit_pending_apps_idle, g_object_ref (plugin_loader));
 		g_source_set_name_by_id (id, "[unity-software] emit_pending_apps_idle");
-		save_install_queue (plugin_loader);
+		if (priv->install_queue != NULL)
+			gs_install_queue_dequeue (priv->install_queue, gs_app_get_id (app));
 
 		/* recursively remove any queued addons */
 		addons = gs_app_get_addons (app);
@@ -2133,6 +2566,9 @@ gs_plugin_loader_job_actions_changed_cb (GsPlugin *plugin, GsPluginLoader *plugi
 {
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
 	priv->updates_changed_cnt++;
+
+	/* anything refined before this point may be stale */
+	g_atomic_int_inc (&priv->refine_generation);
 }
 
 static void
@@ -2167,6 +2603,8 @@ gs_plugin_loader_reload_cb (GsPlugin *plugin,
 			    GsPluginLoader *plugin_loader)
 {
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	g_atomic_int_inc (&priv->refine_generation);
+	gs_plugin_loader_app_cache_clear (plugin_loader);
 	if (priv->reload_id != 0)
 		return;
 	priv->reload_id =
@@ -2216,6 +2654,7 @@ gs_plugin_loader_open_plugin (GsPluginLoader *plugin_loader,
 
 	/* add to array */
 	g_ptr_array_add (priv->plugins, plugin);
+	g_hash_table_insert (priv->metrics, plugin, g_new0 (GsPluginLoaderMetrics, 1));
 }
 
 void
@@ -2683,6 +3122,61 @@ gs_plugin_loader_dump_state (GsPluginLoader *plugin_loader)
 		g_string_truncate (str_disabled, str_disabled->len - 2);
 	g_info ("enabled plugins: %s", str_enabled->str);
 	g_info ("disabled plugins: %s", str_disabled->str);
+	g_mutex_lock (&priv->app_cache_mutex);
+	g_info ("app cache: %u apps, %" G_GUINT64_FORMAT " bytes, "
+		"%u hits, %u misses, %u evictions",
+		g_queue_get_length (&priv->app_cache_lru), priv->app_cache_size,
+		priv->app_cache_hits, priv->app_cache_misses,
+		priv->app_cache_evictions);
+	g_mutex_unlock (&priv->app_cache_mutex);
+}
+
+/**
+ * gs_plugin_loader_get_metrics:
+ * @plugin_loader: a #GsPluginLoader
+ *
+ * Gets a snapshot of how long each plugin has taken for each action.
+ *
+ * Each entry is the plugin name, the action name and a histogram of the
+ * number of vfunc calls, where the first bucket counts calls that took under
+ * 1ms and each following bucket is twice as wide as the previous one. Plugins
+ * and actions that were never called are omitted.
+ *
+ * Returns: (transfer full): a #GVariant of type `a(ssau)`
+ */
+GVariant *
+gs_plugin_loader_get_metrics (GsPluginLoader *plugin_loader)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	GVariantBuilder builder;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssau)"));
+	for (guint i = 0; priv->plugins != NULL && i < priv->plugins->len; i++) {
+		GsPlugin *plugin = g_ptr_array_index (priv->plugins, i);
+		GsPluginLoaderMetrics *metrics = g_hash_table_lookup (priv->metrics, plugin);
+
+		if (metrics == NULL)
+			continue;
+		for (guint action = 0; action < GS_PLUGIN_ACTION_LAST; action++) {
+			guint32 buckets[GS_PLUGIN_LOADER_METRICS_BUCKETS];
+			guint cnt = 0;
+
+			for (guint j = 0; j < GS_PLUGIN_LOADER_METRICS_BUCKETS; j++) {
+				buckets[j] = (guint32) g_atomic_int_get (&metrics->buckets[action][j]);
+				cnt += buckets[j];
+			}
+			if (cnt == 0)
+				continue;
+			g_variant_builder_add (&builder, "(ss@au)",
+					       gs_plugin_get_name (plugin),
+					       gs_plugin_action_to_string (action),
+					       g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+									  buckets,
+									  GS_PLUGIN_LOADER_METRICS_BUCKETS,
+									  sizeof(guint32)));
+		}
+	}
+	return g_variant_ref_sink (g_variant_builder_end (&builder));
 }
 
 static void
@@ -2761,10 +3255,17 @@ gs_plugin_loader_dispose (GObject *object)
 		g_thread_pool_free (priv->queued_ops_pool, TRUE, TRUE);
 		priv->queued_ops_pool = NULL;
 	}
+	if (priv->results_pool != NULL) {
+		g_thread_pool_free (priv->results_pool, TRUE, TRUE);
+		priv->results_pool = NULL;
+	}
 	g_clear_object (&priv->network_monitor);
 	g_clear_object (&priv->soup_session);
 	g_clear_object (&priv->settings);
 	g_clear_pointer (&priv->pending_apps, g_ptr_array_unref);
+	g_clear_object (&priv->install_queue_unrefined);
+	g_clear_object (&priv->install_queue);
+	gs_plugin_loader_app_cache_clear (plugin_loader);
 #ifdef HAVE_SYSPROF
 	g_clear_pointer (&priv->sysprof_writer, sysprof_capture_writer_unref);
 #endif
@@ -2785,8 +3286,15 @@ gs_plugin_loader_finalize (GObject *object)
 	g_ptr_array_unref (priv->file_monitors);
 	g_hash_table_unref (priv->events_by_id);
 	g_hash_table_unref (priv->disallow_updates);
+	g_hash_table_unref (priv->metrics);
+	g_hash_table_unref (priv->flights);
+	g_hash_table_unref (priv->app_cache);
 
 	g_mutex_clear (&priv->pending_apps_mutex);
+	g_mutex_clear (&priv->flights_mutex);
+	g_mutex_clear (&priv->app_cache_mutex);
+	g_mutex_clear (&priv->queued_ops_mutex);
+	g_ptr_array_unref (priv->queued_ops_running);
 	g_mutex_clear (&priv->events_by_id_mutex);
 
 	G_OBJECT_CLASS (gs_plugin_loader_parent_class)->finalize (object);
@@ -2875,6 +3383,8 @@ gs_plugin_loader_settings_changed_cb (GSettings *settings,
 {
 	if (g_strcmp0 (key, "allow-updates") == 0)
 		gs_plugin_loader_allow_updates_recheck (plugin_loader);
+	else if (g_strcmp0 (key, "app-cache-size") == 0)
+		gs_plugin_loader_app_cache_set_size_max (plugin_loader);
 }
 
 static gint
@@ -2902,17 +3412,34 @@ gs_plugin_loader_init (GsPluginLoader *plugin_loader)
 
 	priv->scale = 1;
 	priv->plugins = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	priv->metrics = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					       NULL, g_free);
+	priv->flights = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->app_cache = g_hash_table_new (g_str_hash, g_str_equal);
+	g_queue_init (&priv->app_cache_lru);
 	priv->pending_apps = g_ptr_array_new_with_free_func ((GFreeFunc) g_object_unref);
 	priv->queued_ops_pool = g_thread_pool_new (gs_plugin_loader_process_in_thread_pool_cb,
-						   NULL,
+						   plugin_loader,
 						   get_max_parallel_ops (),
 						   FALSE,
 						   NULL);
+	g_thread_pool_set_sort_function (priv->queued_ops_pool,
+					 gs_plugin_loader_queued_ops_sort_cb,
+					 NULL);
+	priv->queued_ops_running = g_ptr_array_new ();
+
+	/* batches overflow into the thread waiting on them when this is full */
+	priv->results_pool = g_thread_pool_new (gs_plugin_loader_run_results_pool_cb,
+						NULL,
+						get_max_parallel_ops (),
+						FALSE,
+						NULL);
 	priv->file_monitors = g_ptr_array_new_with_free_func ((GFreeFunc) g_object_unref);
 	priv->locations = g_ptr_array_new_with_free_func (g_free);
 	priv->settings = g_settings_new ("org.ubuntuunity.software");
 	g_signal_connect (priv->settings, "changed",
 			  G_CALLBACK (gs_plugin_loader_settings_changed_cb), plugin_loader);
+	priv->app_cache_size_max = g_settings_get_uint (priv->settings, "app-cache-size");
 	priv->events_by_id = g_hash_table_new_full ((GHashFunc) as_utils_unique_id_hash,
 					            (GEqualFunc) as_utils_unique_id_equal,
 						    g_free,
@@ -2983,6 +3510,7 @@ gs_plugin_loader_app_installed_cb (GObject *source,
 				   gpointer user_data)
 {
 	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source);
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
 	gboolean ret;
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsApp) app = GS_APP (user_data);
@@ -2994,37 +3522,122 @@ gs_plugin_loader_app_installed_cb (GObject *source,
 		remove_app_from_install_queue (plugin_loader, app);
 		g_warning ("failed to install %s: %s",
 			   gs_app_get_unique_id (app), error->message);
+		return;
 	}
-}
 
-gboolean
-gs_plugin_loader_get_network_available (GsPluginLoader *plugin_loader)
-{
-	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
-	if (priv->network_monitor == NULL) {
-		g_debug ("no network monitor, so returning network-available=TRUE");
-		return TRUE;
+	/* drop the app and any addons installed with it from the journal */
+	if (priv->install_queue != NULL) {
+		GsAppList *addons = gs_app_get_addons (app);
+		gs_install_queue_complete (priv->install_queue, gs_app_get_id (app));
+		for (guint i = 0; i < gs_app_list_length (addons); i++) {
+			GsApp *addon = gs_app_list_index (addons, i);
+			if (gs_app_get_state (addon) == AS_APP_STATE_INSTALLED)
+				gs_install_queue_complete (priv->install_queue, gs_app_get_id (addon));
+		}
 	}
-	return g_network_monitor_get_network_available (priv->network_monitor);
 }
 
-gboolean
-gs_plugin_loader_get_network_metered (GsPluginLoader *plugin_loader)
+static void
+gs_plugin_loader_install_queued (GsPluginLoader *plugin_loader)
 {
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
-	if (priv->network_monitor == NULL) {
-		g_debug ("no network monitor, so returning network-metered=FALSE");
-		return FALSE;
+	g_autoptr(GsAppList) queue = NULL;
+
+	g_mutex_lock (&priv->pending_apps_mutex);
+	queue = gs_app_list_new ();
+	for (guint i = 0; i < priv->pending_apps->len; i++) {
+		GsApp *app = g_ptr_array_index (priv->pending_apps, i);
+		if (gs_app_get_state (app) == AS_APP_STATE_QUEUED_FOR_INSTALL)
+			gs_app_list_add (queue, app);
+	}
+	g_mutex_unlock (&priv->pending_apps_mutex);
+	for (guint i = 0; i < gs_app_list_length (queue); i++) {
+		GsApp *app = gs_app_list_index (queue, i);
+		g_autoptr(GsPluginJob) plugin_job = NULL;
+		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_INSTALL,
+						 "app", app,
+						 NULL);
+		gs_plugin_loader_job_process_async (plugin_loader, plugin_job,
+						    NULL,
+						    gs_plugin_loader_app_installed_cb,
+						    g_object_ref (app));
 	}
-	return g_network_monitor_get_network_metered (priv->network_monitor);
 }
 
 static void
-gs_plugin_loader_network_changed_cb (GNetworkMonitor *monitor,
-				     gboolean available,
-				     GsPluginLoader *plugin_loader)
+gs_plugin_loader_install_queue_refine_cb (GObject *source,
+					  GAsyncResult *res,
+					  gpointer user_data)
 {
-	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source);
+	gboolean install = GPOINTER_TO_INT (user_data);
+	g_autoptr(GError) error = NULL;
+
+	if (!gs_plugin_loader_job_action_finish (plugin_loader, res, &error))
+		g_warning ("failed to refine install queue: %s", error->message);
+	if (install)
+		gs_plugin_loader_install_queued (plugin_loader);
+}
+
+/* refines any apps replayed from the journal, and then optionally installs
+ * everything that is queued */
+static void
+gs_plugin_loader_process_install_queue (GsPluginLoader *plugin_loader, gboolean install)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	g_autoptr(GsAppList) unrefined = NULL;
+
+	g_mutex_lock (&priv->pending_apps_mutex);
+	unrefined = g_steal_pointer (&priv->install_queue_unrefined);
+	g_mutex_unlock (&priv->pending_apps_mutex);
+
+	if (unrefined != NULL) {
+		g_autoptr(GsPluginJob) plugin_job = NULL;
+		g_debug ("refining %u apps replayed from the install queue",
+			 gs_app_list_length (unrefined));
+		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
+						 "list", unrefined,
+						 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_SETUP_ACTION |
+								 GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+						 NULL);
+		gs_plugin_loader_job_process_async (plugin_loader, plugin_job,
+						    NULL,
+						    gs_plugin_loader_install_queue_refine_cb,
+						    GINT_TO_POINTER (install));
+		return;
+	}
+	if (install)
+		gs_plugin_loader_install_queued (plugin_loader);
+}
+
+gboolean
+gs_plugin_loader_get_network_available (GsPluginLoader *plugin_loader)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	if (priv->network_monitor == NULL) {
+		g_debug ("no network monitor, so returning network-available=TRUE");
+		return TRUE;
+	}
+	return g_network_monitor_get_network_available (priv->network_monitor);
+}
+
+gboolean
+gs_plugin_loader_get_network_metered (GsPluginLoader *plugin_loader)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	if (priv->network_monitor == NULL) {
+		g_debug ("no network monitor, so returning network-metered=FALSE");
+		return FALSE;
+	}
+	return g_network_monitor_get_network_metered (priv->network_monitor);
+}
+
+static void
+gs_plugin_loader_network_changed_cb (GNetworkMonitor *monitor,
+				     gboolean available,
+				     GsPluginLoader *plugin_loader)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
 	gboolean metered = g_network_monitor_get_network_metered (priv->network_monitor);
 
 	g_debug ("network status change: %s [%s]",
@@ -3034,28 +3647,8 @@ gs_plugin_loader_network_changed_cb (GNetworkMonitor *monitor,
 	g_object_notify (G_OBJECT (plugin_loader), "network-available");
 	g_object_notify (G_OBJECT (plugin_loader), "network-metered");
 
-	if (available && !metered) {
-		g_autoptr(GsAppList) queue = NULL;
-		g_mutex_lock (&priv->pending_apps_mutex);
-		queue = gs_app_list_new ();
-		for (guint i = 0; i < priv->pending_apps->len; i++) {
-			GsApp *app = g_ptr_array_index (priv->pending_apps, i);
-			if (gs_app_get_state (app) == AS_APP_STATE_QUEUED_FOR_INSTALL)
-				gs_app_list_add (queue, app);
-		}
-		g_mutex_unlock (&priv->pending_apps_mutex);
-		for (guint i = 0; i < gs_app_list_length (queue); i++) {
-			GsApp *app = gs_app_list_index (queue, i);
-			g_autoptr(GsPluginJob) plugin_job = NULL;
-			plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_INSTALL,
-							 "app", app,
-							 NULL);
-			gs_plugin_loader_job_process_async (plugin_loader, plugin_job,
-							    NULL,
-							    gs_plugin_loader_app_installed_cb,
-							    g_object_ref (app));
-		}
-	}
+	if (available && !metered)
+		gs_plugin_loader_process_install_queue (plugin_loader, TRUE);
 }
 
 static void
@@ -3186,7 +3779,7 @@ gs_plugin_loader_generic_update (GsPluginLoader *plugin_loader,
 				}
 			}
 		}
-		helper->anything_ran = TRUE;
+		g_atomic_int_set (&helper->anything_ran, TRUE);
 		gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
 	}
 
@@ -3194,6 +3787,261 @@ gs_plugin_loader_generic_update (GsPluginLoader *plugin_loader,
 	return TRUE;
 }
 
+typedef struct {
+	gchar		*unique_id;
+	GsApp		*app;
+	guint64		 size;
+} GsPluginLoaderAppCacheItem;
+
+static void
+gs_plugin_loader_app_cache_item_free (GsPluginLoaderAppCacheItem *item)
+{
+	g_free (item->unique_id);
+	g_object_unref (item->app);
+	g_slice_free (GsPluginLoaderAppCacheItem, item);
+}
+
+/* must hold app_cache_mutex */
+static void
+gs_plugin_loader_app_cache_trim (GsPluginLoader *plugin_loader)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	while (priv->app_cache_size > priv->app_cache_size_max &&
+	       !g_queue_is_empty (&priv->app_cache_lru)) {
+		GsPluginLoaderAppCacheItem *item = g_queue_pop_tail (&priv->app_cache_lru);
+		g_hash_table_remove (priv->app_cache, item->unique_id);
+		priv->app_cache_size -= item->size;
+		priv->app_cache_evictions++;
+		gs_plugin_loader_app_cache_item_free (item);
+	}
+}
+
+static void
+gs_plugin_loader_app_cache_clear (GsPluginLoader *plugin_loader)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	GsPluginLoaderAppCacheItem *item;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->app_cache_mutex);
+
+	g_hash_table_remove_all (priv->app_cache);
+	while ((item = g_queue_pop_head (&priv->app_cache_lru)) != NULL)
+		gs_plugin_loader_app_cache_item_free (item);
+	priv->app_cache_size = 0;
+}
+
+static void
+gs_plugin_loader_app_cache_set_size_max (GsPluginLoader *plugin_loader)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->app_cache_mutex);
+	priv->app_cache_size_max = g_settings_get_uint (priv->settings, "app-cache-size");
+	gs_plugin_loader_app_cache_trim (plugin_loader);
+}
+
+/* only apps that can be told apart from every other app can be shared */
+static gboolean
+gs_plugin_loader_app_cache_is_cacheable (GsApp *app)
+{
+	const gchar *unique_id;
+	g_auto(GStrv) split = NULL;
+
+	if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD))
+		return FALSE;
+	unique_id = gs_app_get_unique_id (app);
+	if (unique_id == NULL)
+		return FALSE;
+	split = g_strsplit (unique_id, "/", -1);
+	if (g_strv_length (split) != 6)
+		return FALSE;
+
+	/* the branch is allowed to be unset */
+	for (guint i = 0; i < 5; i++) {
+		if (g_strcmp0 (split[i], "*") == 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* returns %TRUE if @app has version or update data that @app_cached lacks */
+static gboolean
+gs_plugin_loader_app_cache_is_newer (GsApp *app, GsApp *app_cached)
+{
+	if (gs_app_get_version (app) != NULL &&
+	    g_strcmp0 (gs_app_get_version (app), gs_app_get_version (app_cached)) != 0)
+		return TRUE;
+	if (gs_app_get_update_version (app) != NULL &&
+	    g_strcmp0 (gs_app_get_update_version (app), gs_app_get_update_version (app_cached)) != 0)
+		return TRUE;
+	if (gs_app_get_update_details (app) != NULL &&
+	    g_strcmp0 (gs_app_get_update_details (app), gs_app_get_update_details (app_cached)) != 0)
+		return TRUE;
+	if (gs_app_get_size_download (app) != GS_APP_SIZE_UNKNOWABLE &&
+	    gs_app_get_size_download (app) != 0 &&
+	    gs_app_get_size_download (app) != gs_app_get_size_download (app_cached))
+		return TRUE;
+	return FALSE;
+}
+
+/* must hold app_cache_mutex; returns the canonical instance for @app */
+static GsApp *
+gs_plugin_loader_app_cache_lookup_or_add (GsPluginLoader *plugin_loader, GsApp *app)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	GsPluginLoaderAppCacheItem *item;
+	const gchar *unique_id = gs_app_get_unique_id (app);
+	GList *link;
+
+	link = g_hash_table_lookup (priv->app_cache, unique_id);
+	if (link != NULL) {
+		item = link->data;
+
+		/* the ID of the cached app may have become more specific, and
+		 * a plugin reporting a different state or version is more up
+		 * to date */
+		if (item->app == app ||
+		    (g_strcmp0 (gs_app_get_unique_id (item->app), unique_id) == 0 &&
+		     (gs_app_get_state (app) == AS_APP_STATE_UNKNOWN ||
+		      gs_app_get_state (app) == gs_app_get_state (item->app)) &&
+		     !gs_plugin_loader_app_cache_is_newer (app, item->app))) {
+			priv->app_cache_hits++;
+			g_queue_unlink (&priv->app_cache_lru, link);
+			g_queue_push_head_link (&priv->app_cache_lru, link);
+			if (item->app != app) {
+				gs_app_subsume_metadata (item->app, app);
+				priv->app_cache_size -= item->size;
+				item->size = gs_app_get_memory_size (item->app);
+				priv->app_cache_size += item->size;
+			}
+			return item->app;
+		}
+		g_hash_table_remove (priv->app_cache, item->unique_id);
+		g_queue_delete_link (&priv->app_cache_lru, link);
+		priv->app_cache_size -= item->size;
+		gs_plugin_loader_app_cache_item_free (item);
+	}
+
+	priv->app_cache_misses++;
+	item = g_slice_new0 (GsPluginLoaderAppCacheItem);
+	item->unique_id = g_strdup (unique_id);
+	item->app = g_object_ref (app);
+	item->size = gs_app_get_memory_size (app);
+	g_queue_push_head (&priv->app_cache_lru, item);
+	g_hash_table_insert (priv->app_cache, item->unique_id, priv->app_cache_lru.head);
+	priv->app_cache_size += item->size;
+	return app;
+}
+
+/* replace apps in @list with instances that earlier jobs already returned,
+ * so that work done refining them is not repeated and all the pages share
+ * the same objects */
+void
+gs_plugin_loader_app_cache_canonicalize (GsPluginLoader *plugin_loader, GsAppList *list)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	gboolean changed = FALSE;
+	g_autoptr(GsAppList) list_new = gs_app_list_new ();
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->app_cache_mutex);
+
+	if (priv->app_cache_size_max == 0)
+		return;
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		GsApp *app_tmp = app;
+		if (gs_plugin_loader_app_cache_is_cacheable (app))
+			app_tmp = gs_plugin_loader_app_cache_lookup_or_add (plugin_loader, app);
+		if (app_tmp != app)
+			changed = TRUE;
+		gs_app_list_add (list_new, app_tmp);
+	}
+	gs_plugin_loader_app_cache_trim (plugin_loader);
+	g_debug ("app cache: %u apps using %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+		 " bytes (%u hits, %u misses, %u evictions)",
+		 g_queue_get_length (&priv->app_cache_lru),
+		 priv->app_cache_size, priv->app_cache_size_max,
+		 priv->app_cache_hits, priv->app_cache_misses,
+		 priv->app_cache_evictions);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+
+	if (!changed)
+		return;
+	gs_app_list_remove_all (list);
+	gs_app_list_add_list (list, list_new);
+}
+
+/* cached apps grow as they are refined, so measure them again once a job has
+ * finished refining @list and drop whatever no longer fits in the budget */
+void
+gs_plugin_loader_app_cache_update (GsPluginLoader *plugin_loader, GsAppList *list)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->app_cache_mutex);
+
+	if (priv->app_cache_size_max == 0)
+		return;
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		GsPluginLoaderAppCacheItem *item;
+		const gchar *unique_id = gs_app_get_unique_id (app);
+		GList *link;
+
+		if (unique_id == NULL)
+			continue;
+		link = g_hash_table_lookup (priv->app_cache, unique_id);
+		if (link == NULL)
+			continue;
+		item = link->data;
+		if (item->app != app)
+			continue;
+		priv->app_cache_size -= item->size;
+		item->size = gs_app_get_memory_size (app);
+		priv->app_cache_size += item->size;
+	}
+	gs_plugin_loader_app_cache_trim (plugin_loader);
+}
+
+void
+gs_plugin_loader_get_app_cache_stats (GsPluginLoader *plugin_loader,
+				      guint *n_apps,
+				      guint64 *size,
+				      guint *hits,
+				      guint *misses,
+				      guint *evictions)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->app_cache_mutex);
+
+	if (n_apps != NULL)
+		*n_apps = g_queue_get_length (&priv->app_cache_lru);
+	if (size != NULL)
+		*size = priv->app_cache_size;
+	if (hits != NULL)
+		*hits = priv->app_cache_hits;
+	if (misses != NULL)
+		*misses = priv->app_cache_misses;
+	if (evictions != NULL)
+		*evictions = priv->app_cache_evictions;
+}
+
+static gboolean
+gs_plugin_loader_action_uses_app_cache (GsPluginAction action)
+{
+	switch (action) {
+	case GS_PLUGIN_ACTION_SEARCH:
+	case GS_PLUGIN_ACTION_SEARCH_FILES:
+	case GS_PLUGIN_ACTION_SEARCH_PROVIDES:
+	case GS_PLUGIN_ACTION_GET_ALTERNATES:
+	case GS_PLUGIN_ACTION_GET_CATEGORY_APPS:
+	case GS_PLUGIN_ACTION_GET_FEATURED:
+	case GS_PLUGIN_ACTION_GET_INSTALLED:
+	case GS_PLUGIN_ACTION_GET_POPULAR:
+	case GS_PLUGIN_ACTION_GET_RECENT:
+	case GS_PLUGIN_ACTION_GET_SOURCES:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
 static void
 gs_plugin_loader_process_thread_cb (GTask *task,
 				    gpointer object,
@@ -3232,7 +4080,13 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 
 	/* run each plugin */
 	if (action != GS_PLUGIN_ACTION_REFINE) {
-		if (!gs_plugin_loader_run_results (helper, cancellable, &error)) {
+		gboolean ret = gs_plugin_loader_run_results (helper, cancellable, &error);
+
+		/* even a partial refresh may have changed what refine returns */
+		if (action == GS_PLUGIN_ACTION_REFRESH)
+			g_atomic_int_inc (&priv->refine_generation);
+
+		if (!ret) {
 			if (add_to_pending_array) {
 				gs_app_set_state_recover (gs_plugin_job_get_app (helper->plugin_job));
 				gs_plugin_loader_pending_apps_remove (plugin_loader, helper);
@@ -3283,7 +4137,7 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 	case GS_PLUGIN_ACTION_SEARCH:
 	case GS_PLUGIN_ACTION_SETUP:
 	case GS_PLUGIN_ACTION_UPDATE:
-		if (!helper->anything_ran) {
+		if (!g_atomic_int_get (&helper->anything_ran)) {
 			g_set_error (&error,
 				     GS_PLUGIN_ERROR,
 				     GS_PLUGIN_ERROR_NOT_SUPPORTED,
@@ -3296,7 +4150,7 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 	case GS_PLUGIN_ACTION_REFINE:
 		break;
 	default:
-		if (!helper->anything_ran) {
+		if (!g_atomic_int_get (&helper->anything_ran)) {
 			g_debug ("no plugin could handle %s",
 				 gs_plugin_action_to_string (action));
 		}
@@ -3326,6 +4180,10 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 		break;
 	}
 
+	/* share apps that earlier jobs have already returned and refined */
+	if (gs_plugin_loader_action_uses_app_cache (action))
+		gs_plugin_loader_app_cache_canonicalize (helper->plugin_loader, list);
+
 	/* refine with enough data so that the sort_func in
 	 * gs_plugin_loader_job_sorted_truncation() can do what it needs */
 	filter_flags = gs_plugin_job_get_filter_flags (helper->plugin_job);
@@ -3379,11 +4237,19 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 
 	/* run refine() on each one if required */
 	if (gs_plugin_job_get_refine_flags (helper->plugin_job) != 0) {
-		if (!gs_plugin_loader_run_refine (helper, list, cancellable, &error)) {
+		gboolean ret;
+		if (gs_plugin_job_get_staged_refine (helper->plugin_job))
+			ret = gs_plugin_loader_run_refine_staged (helper, list, cancellable, &error);
+		else
+			ret = gs_plugin_loader_run_refine (helper, list, cancellable, &error);
+		if (!ret) {
 			gs_utils_error_convert_gio (&error);
 			g_task_return_error (task, error);
 			return;
 		}
+
+		/* account for anything the refine added to shared apps */
+		gs_plugin_loader_app_cache_update (plugin_loader, list);
 	} else {
 		g_debug ("no refine flags set for transaction");
 	}
@@ -3532,18 +4398,159 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 	g_task_return_pointer (task, g_object_ref (list), (GDestroyNotify) g_object_unref);
 }
 
+/* one run of a queued operation, which can be abandoned and retried */
+typedef struct {
+	GsPluginLoaderHelper	*helper;
+	GCancellable		*cancellable;
+	gboolean		 preempted;
+} GsPluginLoaderAttempt;
+
+static gint
+gs_plugin_loader_queued_ops_sort_cb (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	GsPluginLoaderHelper *helper1 = g_task_get_task_data (G_TASK (a));
+	GsPluginLoaderHelper *helper2 = g_task_get_task_data (G_TASK (b));
+
+	/* most urgent lane first, then in the order they were scheduled */
+	if (helper1->lane != helper2->lane)
+		return helper1->lane < helper2->lane ? -1 : 1;
+	if (helper1->seq != helper2->seq)
+		return helper1->seq < helper2->seq ? -1 : 1;
+	return 0;
+}
+
+static GsPluginLoaderLane
+gs_plugin_loader_get_lane (GsPluginJob *plugin_job)
+{
+	if (gs_plugin_job_get_interactive (plugin_job))
+		return GS_PLUGIN_LOADER_LANE_INTERACTIVE;
+	switch (gs_plugin_job_get_action (plugin_job)) {
+	case GS_PLUGIN_ACTION_UPDATE:
+	case GS_PLUGIN_ACTION_DOWNLOAD:
+	case GS_PLUGIN_ACTION_UPGRADE_DOWNLOAD:
+		/* kicked off automatically, e.g. by the update monitor */
+		return GS_PLUGIN_LOADER_LANE_BACKGROUND;
+	default:
+		return GS_PLUGIN_LOADER_LANE_NORMAL;
+	}
+}
+
+static void
+gs_plugin_loader_attempt_cancelled_cb (GCancellable *cancellable,
+				       GsPluginLoaderAttempt *attempt)
+{
+	g_cancellable_cancel (attempt->cancellable);
+}
+
+/* jobs for several apps, such as those started by the update monitor, can
+ * only be abandoned if every app can be; the list is checked first as the job
+ * app is only set to each entry in turn while the per-app vfuncs run */
+static gboolean
+gs_plugin_loader_job_get_allow_cancel (GsPluginJob *plugin_job)
+{
+	GsAppList *list = gs_plugin_job_get_list (plugin_job);
+	GsApp *app;
+
+	if (list != NULL) {
+		if (gs_app_list_length (list) == 0)
+			return FALSE;
+		for (guint i = 0; i < gs_app_list_length (list); i++) {
+			if (!gs_app_get_allow_cancel (gs_app_list_index (list, i)))
+				return FALSE;
+		}
+		return TRUE;
+	}
+	app = gs_plugin_job_get_app (plugin_job);
+	return app != NULL && gs_app_get_allow_cancel (app);
+}
+
+/* cancels a running background operation so an interactive one can start;
+ * only operations the plugin says can be cancelled are considered */
+static void
+gs_plugin_loader_preempt_background (GsPluginLoader *plugin_loader)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->queued_ops_mutex);
+
+	if ((gint) priv->queued_ops_running->len < g_thread_pool_get_max_threads (priv->queued_ops_pool))
+		return;
+	for (guint i = priv->queued_ops_running->len; i > 0; i--) {
+		GsPluginLoaderAttempt *attempt = g_ptr_array_index (priv->queued_ops_running, i - 1);
+		if (attempt->helper->lane != GS_PLUGIN_LOADER_LANE_BACKGROUND ||
+		    attempt->preempted)
+			continue;
+		if (!gs_plugin_loader_job_get_allow_cancel (attempt->helper->plugin_job))
+			continue;
+		g_debug ("preempting background %s",
+			 gs_plugin_action_to_string (gs_plugin_job_get_action (attempt->helper->plugin_job)));
+		attempt->preempted = TRUE;
+		g_cancellable_cancel (attempt->cancellable);
+		return;
+	}
+}
+
 static void
 gs_plugin_loader_process_in_thread_pool_cb (gpointer data,
 					    gpointer user_data)
 {
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (user_data);
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
 	GTask *task = data;
 	gpointer source_object = g_task_get_source_object (task);
-	gpointer task_data = g_task_get_task_data (task);
-	GCancellable *cancellable = g_task_get_cancellable (task);
+	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
+	GsPluginLoaderAttempt attempt = { helper, NULL, FALSE };
+	g_autoptr(GTask) task_attempt = NULL;
+	g_autoptr(GError) error = NULL;
+	GsAppList *list;
+	gulong cancellable_id;
 
-	gs_ioprio_init ();
+	/* pool threads are reused, so set the priority for this lane */
+	switch (helper->lane) {
+	case GS_PLUGIN_LOADER_LANE_INTERACTIVE:
+		gs_ioprio_set_best_effort (0);
+		break;
+	case GS_PLUGIN_LOADER_LANE_NORMAL:
+		gs_ioprio_set_best_effort (4);
+		break;
+	default:
+		gs_ioprio_init ();
+		break;
+	}
 
-	gs_plugin_loader_process_thread_cb (task, source_object, task_data, cancellable);
+	/* run on a task of its own so that a preempted run can be retried
+	 * without completing the caller's task */
+	attempt.cancellable = g_cancellable_new ();
+	cancellable_id = g_cancellable_connect (helper->cancellable,
+						G_CALLBACK (gs_plugin_loader_attempt_cancelled_cb),
+						&attempt, NULL);
+	task_attempt = g_task_new (source_object, attempt.cancellable, NULL, NULL);
+	g_task_set_check_cancellable (task_attempt, FALSE);
+	g_mutex_lock (&priv->queued_ops_mutex);
+	g_ptr_array_add (priv->queued_ops_running, &attempt);
+	g_mutex_unlock (&priv->queued_ops_mutex);
+
+	gs_plugin_loader_process_thread_cb (task_attempt, source_object, helper,
+					    attempt.cancellable);
+
+	g_mutex_lock (&priv->queued_ops_mutex);
+	g_ptr_array_remove_fast (priv->queued_ops_running, &attempt);
+	g_mutex_unlock (&priv->queued_ops_mutex);
+	g_cancellable_disconnect (helper->cancellable, cancellable_id);
+	g_object_unref (attempt.cancellable);
+
+	/* go back in the queue behind the interactive work */
+	if (attempt.preempted && !g_cancellable_is_cancelled (helper->cancellable)) {
+		g_debug ("requeueing preempted %s",
+			 gs_plugin_action_to_string (gs_plugin_job_get_action (helper->plugin_job)));
+		g_thread_pool_push (priv->queued_ops_pool, task, NULL);
+		return;
+	}
+
+	list = g_task_propagate_pointer (task_attempt, &error);
+	if (list == NULL)
+		g_task_return_error (task, g_steal_pointer (&error));
+	else
+		g_task_return_pointer (task, list, (GDestroyNotify) g_object_unref);
 	g_object_unref (task);
 }
 
@@ -3585,9 +4592,233 @@ gs_plugin_loader_schedule_task (GsPluginLoader *plugin_loader,
 		GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
 		gs_app_set_pending_action (app, action);
 	}
+	helper->lane = gs_plugin_loader_get_lane (helper->plugin_job);
+	helper->seq = (guint) g_atomic_int_add (&priv->queued_ops_seq, 1);
+	if (helper->lane == GS_PLUGIN_LOADER_LANE_INTERACTIVE)
+		gs_plugin_loader_preempt_background (plugin_loader);
 	g_thread_pool_push (priv->queued_ops_pool, g_object_ref (task), NULL);
 }
 
+/* a job pipeline shared by several callers asking for the same thing */
+typedef struct {
+	gint			 ref_count;	/* atomic */
+	GsPluginLoader		*plugin_loader;	/* not owned */
+	gchar			*fingerprint;
+	GCancellable		*cancellable;
+	GPtrArray		*waiters;	/* of GsPluginLoaderFlightWaiter, under flights_mutex */
+} GsPluginLoaderFlight;
+
+typedef struct {
+	GsPluginLoaderFlight	*flight;	/* owned */
+	GTask			*task;
+	GCancellable		*cancellable;
+	gulong			 cancellable_id;
+} GsPluginLoaderFlightWaiter;
+
+static GsPluginLoaderFlight *
+gs_plugin_loader_flight_ref (GsPluginLoaderFlight *flight)
+{
+	g_atomic_int_inc (&flight->ref_count);
+	return flight;
+}
+
+static void
+gs_plugin_loader_flight_unref (GsPluginLoaderFlight *flight)
+{
+	if (!g_atomic_int_dec_and_test (&flight->ref_count))
+		return;
+	g_free (flight->fingerprint);
+	g_object_unref (flight->cancellable);
+	g_ptr_array_unref (flight->waiters);
+	g_slice_free (GsPluginLoaderFlight, flight);
+}
+
+static void
+gs_plugin_loader_flight_waiter_free (GsPluginLoaderFlightWaiter *waiter)
+{
+	if (waiter->cancellable_id != 0)
+		g_cancellable_disconnect (waiter->cancellable, waiter->cancellable_id);
+	g_clear_object (&waiter->cancellable);
+	g_object_unref (waiter->task);
+	gs_plugin_loader_flight_unref (waiter->flight);
+	g_slice_free (GsPluginLoaderFlightWaiter, waiter);
+}
+
+/* only read-only actions that produce a fresh list can be shared, and only
+ * when nothing caller-specific is attached to the job */
+static gchar *
+gs_plugin_loader_job_fingerprint (GsPluginJob *plugin_job)
+{
+	GsCategory *category = gs_plugin_job_get_category (plugin_job);
+	GsPluginAction action = gs_plugin_job_get_action (plugin_job);
+	g_autofree gchar *category_id = NULL;
+
+	switch (action) {
+	case GS_PLUGIN_ACTION_GET_UPDATES:
+	case GS_PLUGIN_ACTION_GET_DISTRO_UPDATES:
+	case GS_PLUGIN_ACTION_GET_SOURCES:
+	case GS_PLUGIN_ACTION_GET_INSTALLED:
+	case GS_PLUGIN_ACTION_GET_POPULAR:
+	case GS_PLUGIN_ACTION_GET_FEATURED:
+	case GS_PLUGIN_ACTION_GET_RECENT:
+	case GS_PLUGIN_ACTION_GET_UPDATES_HISTORICAL:
+	case GS_PLUGIN_ACTION_GET_CATEGORY_APPS:
+	case GS_PLUGIN_ACTION_SEARCH:
+	case GS_PLUGIN_ACTION_SEARCH_FILES:
+	case GS_PLUGIN_ACTION_SEARCH_PROVIDES:
+		break;
+	default:
+		return NULL;
+	}
+	if (gs_app_list_length (gs_plugin_job_get_list (plugin_job)) > 0 ||
+	    gs_plugin_job_get_staged_refine (plugin_job))
+		return NULL;
+
+	/* subcategory IDs such as "all" are only unique within the parent */
+	if (category != NULL) {
+		GsCategory *parent = gs_category_get_parent (category);
+		category_id = g_strdup_printf ("%s/%s",
+					       parent != NULL ? gs_category_get_id (parent) : "",
+					       gs_category_get_id (category));
+	}
+
+	return g_strdup_printf ("%s|%s|%s|%" G_GUINT64_FORMAT "|%" G_GUINT64_FORMAT "|%u|%u|%u|%" G_GUINT64_FORMAT "|%p|%p",
+				gs_plugin_action_to_string (action),
+				gs_plugin_job_get_search (plugin_job) != NULL ?
+					gs_plugin_job_get_search (plugin_job) : "",
+				category_id != NULL ? category_id : "",
+				gs_plugin_job_get_refine_flags (plugin_job),
+				gs_plugin_job_get_filter_flags (plugin_job),
+				(guint) gs_plugin_job_get_dedupe_flags (plugin_job),
+				gs_plugin_job_get_max_results (plugin_job),
+				(guint) gs_plugin_job_get_interactive (plugin_job),
+				gs_plugin_job_get_age (plugin_job),
+				gs_plugin_job_get_sort_func (plugin_job),
+				gs_plugin_job_get_sort_func_data (plugin_job));
+}
+
+typedef struct {
+	GsPluginLoaderFlight	*flight;
+	GTask			*task;
+} GsPluginLoaderFlightCancel;
+
+/* runs in the context of the waiting task, never inside the cancellable handler */
+static gboolean
+gs_plugin_loader_flight_waiter_cancelled_idle_cb (gpointer user_data)
+{
+	GsPluginLoaderFlightCancel *cancel = (GsPluginLoaderFlightCancel *) user_data;
+	GsPluginLoaderFlight *flight = cancel->flight;
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (flight->plugin_loader);
+	GsPluginLoaderFlightWaiter *waiter = NULL;
+	gboolean cancel_flight = FALSE;
+
+	g_mutex_lock (&priv->flights_mutex);
+	for (guint i = 0; i < flight->waiters->len; i++) {
+		GsPluginLoaderFlightWaiter *tmp = g_ptr_array_index (flight->waiters, i);
+		if (tmp->task == cancel->task) {
+			waiter = g_ptr_array_remove_index (flight->waiters, i);
+			break;
+		}
+	}
+	if (waiter != NULL && flight->waiters->len == 0) {
+		if (g_hash_table_lookup (priv->flights, flight->fingerprint) == flight)
+			g_hash_table_remove (priv->flights, flight->fingerprint);
+		cancel_flight = TRUE;
+	}
+	g_mutex_unlock (&priv->flights_mutex);
+
+	/* already completed */
+	if (waiter != NULL) {
+		g_task_return_new_error (waiter->task,
+					 GS_PLUGIN_ERROR,
+					 GS_PLUGIN_ERROR_CANCELLED,
+					 "cancelled by the caller");
+		gs_plugin_loader_flight_waiter_free (waiter);
+	}
+
+	/* nobody is waiting for this any more */
+	if (cancel_flight) {
+		g_debug ("cancelling shared job %s", flight->fingerprint);
+		g_cancellable_cancel (flight->cancellable);
+	}
+
+	gs_plugin_loader_flight_unref (cancel->flight);
+	g_object_unref (cancel->task);
+	g_slice_free (GsPluginLoaderFlightCancel, cancel);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+gs_plugin_loader_flight_waiter_cancelled_cb (GCancellable *cancellable,
+					     GsPluginLoaderFlightWaiter *waiter)
+{
+	GsPluginLoaderFlightCancel *cancel = g_slice_new0 (GsPluginLoaderFlightCancel);
+	g_autoptr(GSource) source = g_idle_source_new ();
+
+	/* the waiter cannot be disconnected from inside its own handler */
+	cancel->flight = gs_plugin_loader_flight_ref (waiter->flight);
+	cancel->task = g_object_ref (waiter->task);
+	g_source_set_callback (source, gs_plugin_loader_flight_waiter_cancelled_idle_cb,
+			       cancel, NULL);
+	g_source_attach (source, g_task_get_context (waiter->task));
+}
+
+/* flights_mutex must be held */
+static void
+gs_plugin_loader_flight_add_waiter (GsPluginLoaderFlight *flight,
+				    GTask *task,
+				    GCancellable *cancellable)
+{
+	GsPluginLoaderFlightWaiter *waiter = g_slice_new0 (GsPluginLoaderFlightWaiter);
+	waiter->flight = gs_plugin_loader_flight_ref (flight);
+	waiter->task = g_object_ref (task);
+	g_ptr_array_add (flight->waiters, waiter);
+	if (cancellable != NULL) {
+		waiter->cancellable = g_object_ref (cancellable);
+		waiter->cancellable_id =
+			g_cancellable_connect (cancellable,
+					       G_CALLBACK (gs_plugin_loader_flight_waiter_cancelled_cb),
+					       waiter, NULL);
+	}
+}
+
+static void
+gs_plugin_loader_flight_done_cb (GObject *source,
+				 GAsyncResult *res,
+				 gpointer user_data)
+{
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source);
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	GsPluginLoaderFlight *flight = (GsPluginLoaderFlight *) user_data;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) waiters = NULL;
+
+	list = gs_plugin_loader_job_process_finish (plugin_loader, res, &error);
+
+	/* later identical jobs start a new pipeline from here on */
+	g_mutex_lock (&priv->flights_mutex);
+	if (g_hash_table_lookup (priv->flights, flight->fingerprint) == flight)
+		g_hash_table_remove (priv->flights, flight->fingerprint);
+	waiters = flight->waiters;
+	flight->waiters = g_ptr_array_new ();
+	g_mutex_unlock (&priv->flights_mutex);
+
+	/* every caller gets its own list of the shared apps */
+	for (guint i = 0; i < waiters->len; i++) {
+		GsPluginLoaderFlightWaiter *waiter = g_ptr_array_index (waiters, i);
+		if (list == NULL) {
+			g_task_return_error (waiter->task, g_error_copy (error));
+		} else {
+			g_task_return_pointer (waiter->task,
+					       gs_app_list_copy (list),
+					       (GDestroyNotify) g_object_unref);
+		}
+		gs_plugin_loader_flight_waiter_free (waiter);
+	}
+	gs_plugin_loader_flight_unref (flight);
+}
+
 /**
  * gs_plugin_loader_job_process_async:
  * @plugin_loader: A #GsPluginLoader
@@ -3610,6 +4841,7 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
 	g_autoptr(GTask) task = NULL;
 	g_autoptr(GCancellable) cancellable_job = g_cancellable_new ();
+	g_autofree gchar *fingerprint = NULL;
 #if GLIB_CHECK_VERSION(2, 60, 0)
 	g_autofree gchar *task_name = NULL;
 #endif
@@ -3783,6 +5015,47 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 		break;
 	}
 
+	/* share the result of an identical job that is already running */
+	fingerprint = gs_plugin_loader_job_fingerprint (plugin_job);
+	if (fingerprint != NULL) {
+		GsPluginLoaderFlight *flight;
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->flights_mutex);
+
+		flight = g_hash_table_lookup (priv->flights, fingerprint);
+		if (flight != NULL) {
+			priv->flights_hits++;
+			g_debug ("attaching to in-flight %s job (%u hits, %u misses)",
+				 gs_plugin_action_to_string (action),
+				 priv->flights_hits, priv->flights_misses);
+			gs_plugin_loader_flight_add_waiter (flight, task, cancellable);
+			return;
+		}
+		priv->flights_misses++;
+		g_debug ("starting shared %s job (%u hits, %u misses)",
+			 gs_plugin_action_to_string (action),
+			 priv->flights_hits, priv->flights_misses);
+		flight = g_slice_new0 (GsPluginLoaderFlight);
+		flight->ref_count = 1;
+		flight->plugin_loader = plugin_loader;
+		flight->fingerprint = g_steal_pointer (&fingerprint);
+		flight->cancellable = g_cancellable_new ();
+		flight->waiters = g_ptr_array_new ();
+		g_hash_table_insert (priv->flights, flight->fingerprint, flight);
+		gs_plugin_loader_flight_add_waiter (flight, task, cancellable);
+
+		/* the pipeline gets a task of its own so that one caller
+		 * cancelling does not abort it for everyone else */
+		g_object_unref (task);
+		task = g_task_new (plugin_loader, flight->cancellable,
+				   gs_plugin_loader_flight_done_cb, flight);
+#if GLIB_CHECK_VERSION(2, 60, 0)
+		g_task_set_name (task, task_name);
+#endif
+		g_object_unref (cancellable_job);
+		cancellable_job = g_object_ref (flight->cancellable);
+		cancellable = NULL;
+	}
+
 	/* save helper */
 	helper = gs_plugin_loader_helper_new (plugin_loader, plugin_job);
 	g_task_set_task_data (task, helper, (GDestroyNotify) gs_plugin_loader_helper_free);
@@ -3838,6 +5111,7 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 	switch (action) {
 	case GS_PLUGIN_ACTION_INSTALL:
 	case GS_PLUGIN_ACTION_UPDATE:
+	case GS_PLUGIN_ACTION_DOWNLOAD:
 	case GS_PLUGIN_ACTION_UPGRADE_DOWNLOAD:
 		/* these actions must be performed by the thread pool because we
 		 * want to limit the number of them running in parallel */
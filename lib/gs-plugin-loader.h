@@ -65,6 +65,7 @@ gboolean	 gs_plugin_loader_setup			(GsPluginLoader	*plugin_loader,
 							 GCancellable	*cancellable,
 							 GError		**error);
 void		 gs_plugin_loader_dump_state		(GsPluginLoader	*plugin_loader);
+GVariant	*gs_plugin_loader_get_metrics		(GsPluginLoader	*plugin_loader);
 gboolean	 gs_plugin_loader_get_enabled		(GsPluginLoader	*plugin_loader,
 							 const gchar	*plugin_name);
 void		 gs_plugin_loader_add_location		(GsPluginLoader	*plugin_loader,
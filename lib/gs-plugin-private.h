@@ -29,6 +29,7 @@ void		 gs_plugin_clear_data			(GsPlugin	*plugin);
 void		 gs_plugin_set_scale			(GsPlugin	*plugin,
 							 guint		 scale);
 guint		 gs_plugin_get_order			(GsPlugin	*plugin);
+guint		 gs_plugin_get_refine_generation	(GsPlugin	*plugin);
 void		 gs_plugin_set_order			(GsPlugin	*plugin,
 							 guint		 order);
 guint		 gs_plugin_get_priority			(GsPlugin	*plugin);
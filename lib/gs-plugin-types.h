@@ -42,11 +42,13 @@ typedef enum {
  * GsPluginFlags:
  * @GS_PLUGIN_FLAGS_NONE:		No flags set
  * @GS_PLUGIN_FLAGS_INTERACTIVE:	User initiated the job
+ * @GS_PLUGIN_FLAGS_PARALLEL_RESULTS:	Results can be added at the same time as other plugins
  *
  * The flags for the plugin at this point in time.
  **/
-#define GS_PLUGIN_FLAGS_NONE		(0u)
-#define GS_PLUGIN_FLAGS_INTERACTIVE	(1u << 4)
+#define GS_PLUGIN_FLAGS_NONE			(0u)
+#define GS_PLUGIN_FLAGS_INTERACTIVE		(1u << 4)
+#define GS_PLUGIN_FLAGS_PARALLEL_RESULTS	(1u << 5)
 typedef guint64 GsPluginFlags;
 
 /**
@@ -70,6 +70,7 @@ typedef struct
 	guint			 timer_id;
 	GMutex			 timer_mutex;
 	GNetworkMonitor		*network_monitor;
+	gint			 refine_generation;	/* atomic */
 } GsPluginPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (GsPlugin, gs_plugin, G_TYPE_OBJECT)
@@ -995,6 +996,42 @@ gs_plugin_updates_changed (GsPlugin *plugin)
 	g_idle_add (gs_plugin_updates_changed_cb, plugin);
 }
 
+/**
+ * gs_plugin_refine_data_changed:
+ * @plugin: a #GsPlugin
+ *
+ * Tells the plugin loader that the data this plugin refines applications
+ * from has changed, for instance because a metadata silo was rebuilt, so
+ * that applications it has already refined are refined again.
+ *
+ * Unlike gs_plugin_reload() this does not ask the front-end to reload.
+ *
+ * Since: 3.38
+ **/
+void
+gs_plugin_refine_data_changed (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_return_if_fail (GS_IS_PLUGIN (plugin));
+	g_atomic_int_inc (&priv->refine_generation);
+}
+
+/**
+ * gs_plugin_get_refine_generation:
+ * @plugin: a #GsPlugin
+ *
+ * Gets how many times gs_plugin_refine_data_changed() has been called.
+ *
+ * Returns: an integer
+ **/
+guint
+gs_plugin_get_refine_generation (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_return_val_if_fail (GS_IS_PLUGIN (plugin), 0);
+	return (guint) g_atomic_int_get (&priv->refine_generation);
+}
+
 static gboolean
 gs_plugin_reload_cb (gpointer user_data)
 {
@@ -1022,48 +1059,38 @@ gs_plugin_reload (GsPlugin *plugin)
 	g_idle_add (gs_plugin_reload_cb, plugin);
 }
 
+/* read and write in bounded chunks so large downloads never need to be
+ * held in memory as one contiguous response body */
+#define GS_PLUGIN_DOWNLOAD_BUFFER_SIZE		(64 * 1024)
+
+/* only this much of an error page is included in the error message */
+#define GS_PLUGIN_DOWNLOAD_ERROR_BODY_MAX	1024
+
+/* the validator of the partial download, used for If-Range */
+#define GS_PLUGIN_DOWNLOAD_ATTRIBUTE_ETAG	"xattr::unity-software.etag"
+
 typedef struct {
 	GsPlugin	*plugin;
 	GsApp		*app;
-	GCancellable	*cancellable;
+	goffset		 offset;
+	goffset		 total;
+	guint		 percentage;
 } GsPluginDownloadHelper;
 
 static void
-gs_plugin_download_chunk_cb (SoupMessage *msg, SoupBuffer *chunk,
-			     GsPluginDownloadHelper *helper)
+gs_plugin_download_progress (GsPluginDownloadHelper *helper, goffset written)
 {
-	GsPluginPrivate *priv = gs_plugin_get_instance_private (helper->plugin);
 	guint percentage;
-	goffset header_size;
-	goffset body_length;
-
-	/* cancelled? */
-	if (g_cancellable_is_cancelled (helper->cancellable)) {
-		g_debug ("cancelling download of %s",
-			 gs_app_get_id (helper->app));
-		soup_session_cancel_message (priv->soup_session,
-					     msg,
-					     SOUP_STATUS_CANCELLED);
-		return;
-	}
 
-	/* if it's returning "Found" or an error, ignore the percentage */
-	if (msg->status_code != SOUP_STATUS_OK) {
-		g_debug ("ignoring status code %u (%s)",
-			 msg->status_code, msg->reason_phrase);
+	/* no app or size is not known */
+	if (helper->app == NULL || helper->total <= 0)
 		return;
-	}
 
-	/* get data */
-	body_length = msg->response_body->length;
-	header_size = soup_message_headers_get_content_length (msg->response_headers);
-
-	/* size is not known */
-	if (header_size < body_length)
+	/* calculate percentage, only emitting when it changes */
+	percentage = (guint) ((100 * MIN (helper->offset + written, helper->total)) / helper->total);
+	if (percentage == helper->percentage)
 		return;
-
-	/* calculate percentage */
-	percentage = (guint) ((100 * body_length) / header_size);
+	helper->percentage = percentage;
 	g_debug ("%s progress: %u%%", gs_app_get_id (helper->app), percentage);
 	gs_app_set_progress (helper->app, percentage);
 	gs_plugin_status_update (helper->plugin,
@@ -1071,6 +1098,131 @@ gs_plugin_download_chunk_cb (SoupMessage *msg, SoupBuffer *chunk,
 				 GS_PLUGIN_STATUS_DOWNLOADING);
 }
 
+static void
+gs_plugin_download_set_error (GError **error,
+			      GError *error_local,
+			      gint code,
+			      const gchar *prefix)
+{
+	if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_CANCELLED,
+			     "%s: %s", prefix, error_local->message);
+		return;
+	}
+	g_set_error (error,
+		     GS_PLUGIN_ERROR,
+		     code,
+		     "%s: %s", prefix, error_local->message);
+}
+
+/* sends @msg and returns the response body as a stream, or %NULL if the
+ * transfer failed or the server did not reply with 200 or 206 */
+static GInputStream *
+gs_plugin_download_send (GsPlugin *plugin,
+			 SoupMessage *msg,
+			 const gchar *uri,
+			 GCancellable *cancellable,
+			 GError **error)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autofree gchar *prefix = g_strdup_printf ("failed to download %s", uri);
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GInputStream) stream = NULL;
+	g_autoptr(GString) str = NULL;
+	gchar buf[GS_PLUGIN_DOWNLOAD_ERROR_BODY_MAX + 1];
+	gssize len;
+
+	stream = soup_session_send (priv->soup_session, msg, cancellable, &error_local);
+	if (stream == NULL) {
+		gs_plugin_download_set_error (error, error_local,
+					      GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
+					      prefix);
+		return NULL;
+	}
+	if (msg->status_code == SOUP_STATUS_OK ||
+	    msg->status_code == SOUP_STATUS_PARTIAL_CONTENT)
+		return g_steal_pointer (&stream);
+
+	/* include the start of the error page, if any */
+	str = g_string_new (soup_status_get_phrase (msg->status_code));
+	len = g_input_stream_read (stream, buf, GS_PLUGIN_DOWNLOAD_ERROR_BODY_MAX,
+				   cancellable, NULL);
+	if (len > 0) {
+		buf[len] = '\0';
+		if (g_utf8_validate (buf, len, NULL)) {
+			g_string_append (str, ": ");
+			g_string_append (str, buf);
+		}
+	}
+	g_set_error (error,
+		     GS_PLUGIN_ERROR,
+		     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
+		     "%s: %s", prefix, str->str);
+	return NULL;
+}
+
+/* copies @stream to @ostream a buffer at a time, updating the progress */
+static gboolean
+gs_plugin_download_splice (GsPluginDownloadHelper *helper,
+			   GInputStream *stream,
+			   GOutputStream *ostream,
+			   const gchar *uri,
+			   GCancellable *cancellable,
+			   GError **error)
+{
+	goffset written = 0;
+	g_autofree guint8 *buf = g_malloc (GS_PLUGIN_DOWNLOAD_BUFFER_SIZE);
+
+	while (TRUE) {
+		gssize len;
+		g_autoptr(GError) error_local = NULL;
+
+		len = g_input_stream_read (stream, buf,
+					   GS_PLUGIN_DOWNLOAD_BUFFER_SIZE,
+					   cancellable, &error_local);
+		if (len < 0) {
+			g_autofree gchar *prefix = NULL;
+			prefix = g_strdup_printf ("failed to download %s", uri);
+			gs_plugin_download_set_error (error, error_local,
+						      GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
+						      prefix);
+			return FALSE;
+		}
+		if (len == 0)
+			break;
+		if (!g_output_stream_write_all (ostream, buf, (gsize) len, NULL,
+						cancellable, &error_local)) {
+			gs_plugin_download_set_error (error, error_local,
+						      GS_PLUGIN_ERROR_WRITE_FAILED,
+						      "Failed to save file");
+			return FALSE;
+		}
+		written += len;
+		gs_plugin_download_progress (helper, written);
+	}
+	if (!g_input_stream_close (stream, cancellable, NULL))
+		g_debug ("failed to close download stream for %s", uri);
+	return TRUE;
+}
+
+static void
+gs_plugin_download_helper_init (GsPluginDownloadHelper *helper,
+				GsPlugin *plugin,
+				GsApp *app,
+				SoupMessage *msg,
+				goffset offset)
+{
+	helper->plugin = plugin;
+	helper->app = app;
+	helper->offset = offset;
+	helper->total = 0;
+	helper->percentage = G_MAXUINT;
+	if (soup_message_headers_get_encoding (msg->response_headers) == SOUP_ENCODING_CONTENT_LENGTH)
+		helper->total = offset + soup_message_headers_get_content_length (msg->response_headers);
+}
+
 /**
  * gs_plugin_download_data:
  * @plugin: a #GsPlugin
@@ -1094,7 +1246,9 @@ gs_plugin_download_data (GsPlugin *plugin,
 {
 	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
 	GsPluginDownloadHelper helper;
-	guint status_code;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GInputStream) stream = NULL;
+	g_autoptr(GOutputStream) ostream = NULL;
 	g_autoptr(SoupMessage) msg = NULL;
 
 	g_return_val_if_fail (GS_IS_PLUGIN (plugin), NULL);
@@ -1105,7 +1259,6 @@ gs_plugin_download_data (GsPlugin *plugin,
 	if (g_str_has_prefix (uri, "file://")) {
 		gsize length = 0;
 		g_autofree gchar *contents = NULL;
-		g_autoptr(GError) error_local = NULL;
 		g_debug ("copying %s from plugin %s", uri, priv->name);
 		if (!g_file_get_contents (uri + 7, &contents, &length, &error_local)) {
 			g_set_error (error,
@@ -1121,31 +1274,51 @@ gs_plugin_download_data (GsPlugin *plugin,
 	/* remote */
 	g_debug ("downloading %s from plugin %s", uri, priv->name);
 	msg = soup_message_new (SOUP_METHOD_GET, uri);
-	if (app != NULL) {
-		helper.plugin = plugin;
-		helper.app = app;
-		helper.cancellable = cancellable;
-		g_signal_connect (msg, "got-chunk",
-				  G_CALLBACK (gs_plugin_download_chunk_cb),
-				  &helper);
-	}
-	status_code = soup_session_send_message (priv->soup_session, msg);
-	if (status_code != SOUP_STATUS_OK) {
-		g_autoptr(GString) str = g_string_new (NULL);
-		g_string_append (str, soup_status_get_phrase (status_code));
-		if (msg->response_body->data != NULL) {
-			g_string_append (str, ": ");
-			g_string_append (str, msg->response_body->data);
-		}
+	if (msg == NULL) {
 		g_set_error (error,
 			     GS_PLUGIN_ERROR,
 			     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
-			     "failed to download %s: %s",
-			     uri, str->str);
+			     "failed to parse URI %s", uri);
 		return NULL;
 	}
-	return g_bytes_new (msg->response_body->data,
-			    (gsize) msg->response_body->length);
+	stream = gs_plugin_download_send (plugin, msg, uri, cancellable, error);
+	if (stream == NULL)
+		return NULL;
+	gs_plugin_download_helper_init (&helper, plugin, app, msg, 0);
+	ostream = g_memory_output_stream_new_resizable ();
+	if (!gs_plugin_download_splice (&helper, stream, ostream, uri,
+					cancellable, error))
+		return NULL;
+	if (!g_output_stream_close (ostream, cancellable, &error_local)) {
+		gs_plugin_download_set_error (error, error_local,
+					      GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
+					      "failed to finish download");
+		return NULL;
+	}
+	return g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (ostream));
+}
+
+/* returns the size of a partial download that can be resumed, or 0 */
+static goffset
+gs_plugin_download_get_resume_offset (GFile *file_part, gchar **etag)
+{
+	const gchar *tmp;
+	g_autoptr(GFileInfo) info = NULL;
+
+	info = g_file_query_info (file_part,
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+				  GS_PLUGIN_DOWNLOAD_ATTRIBUTE_ETAG,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL, NULL);
+	if (info == NULL)
+		return 0;
+
+	/* without a validator the remote file may have changed */
+	tmp = g_file_info_get_attribute_string (info, GS_PLUGIN_DOWNLOAD_ATTRIBUTE_ETAG);
+	if (tmp == NULL)
+		return 0;
+	*etag = g_strdup (tmp);
+	return g_file_info_get_size (info);
 }
 
 /**
@@ -1159,6 +1332,11 @@ gs_plugin_download_data (GsPlugin *plugin,
  *
  * Downloads data and saves it to a file.
  *
+ * The data is streamed to a temporary file next to @filename which is
+ * renamed into place when the download is complete. If a previous
+ * download was interrupted, and the server supports it, the transfer is
+ * resumed from where it stopped.
+ *
  * Returns: %TRUE for success
  *
  * Since: 3.22
@@ -1173,8 +1351,15 @@ gs_plugin_download_file (GsPlugin *plugin,
 {
 	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
 	GsPluginDownloadHelper helper;
-	guint status_code;
+	const gchar *etag_new;
+	goffset offset = 0;
+	g_autofree gchar *etag = NULL;
+	g_autofree gchar *filename_part = NULL;
 	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GFile) file_part = NULL;
+	g_autoptr(GFileOutputStream) ostream = NULL;
+	g_autoptr(GInputStream) stream = NULL;
 	g_autoptr(SoupMessage) msg = NULL;
 
 	g_return_val_if_fail (GS_IS_PLUGIN (plugin), FALSE);
@@ -1216,40 +1401,116 @@ gs_plugin_download_file (GsPlugin *plugin,
 			     "failed to parse URI %s", uri);
 		return FALSE;
 	}
-	if (app != NULL) {
-		helper.plugin = plugin;
-		helper.app = app;
-		helper.cancellable = cancellable;
-		g_signal_connect (msg, "got-chunk",
-				  G_CALLBACK (gs_plugin_download_chunk_cb),
-				  &helper);
+	if (!gs_mkdir_parent (filename, error))
+		return FALSE;
+
+	/* resume an interrupted download, but only if it is still current */
+	filename_part = g_strdup_printf ("%s.part", filename);
+	file_part = g_file_new_for_path (filename_part);
+	offset = gs_plugin_download_get_resume_offset (file_part, &etag);
+	if (offset > 0) {
+		g_debug ("resuming download of %s at %" G_GOFFSET_FORMAT,
+			 uri, offset);
+		soup_message_headers_set_range (msg->request_headers, offset, -1);
+		soup_message_headers_replace (msg->request_headers, "If-Range", etag);
+	}
+	stream = gs_plugin_download_send (plugin, msg, uri, cancellable, &error_local);
+	if (stream == NULL && offset > 0 &&
+	    msg->status_code == SOUP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE) {
+		/* the partial file is bogus, so start again from scratch */
+		g_debug ("cannot resume %s, restarting", uri);
+		g_clear_error (&error_local);
+		if (!g_file_delete (file_part, cancellable, &error_local)) {
+			gs_plugin_download_set_error (error, error_local,
+						      GS_PLUGIN_ERROR_WRITE_FAILED,
+						      "Failed to remove partial file");
+			return FALSE;
+		}
+		return gs_plugin_download_file (plugin, app, uri, filename,
+						cancellable, error);
 	}
-	status_code = soup_session_send_message (priv->soup_session, msg);
-	if (status_code != SOUP_STATUS_OK) {
-		g_autoptr(GString) str = g_string_new (NULL);
-		g_string_append (str, soup_status_get_phrase (status_code));
-		if (msg->response_body->data != NULL) {
-			g_string_append (str, ": ");
-			g_string_append (str, msg->response_body->data);
+	if (stream == NULL) {
+		g_propagate_error (error, g_steal_pointer (&error_local));
+		return FALSE;
+	}
+
+	/* the server ignored the range, or the file changed */
+	if (offset > 0) {
+		goffset start = 0;
+		if (msg->status_code != SOUP_STATUS_PARTIAL_CONTENT ||
+		    !soup_message_headers_get_content_range (msg->response_headers,
+							     &start, NULL, NULL) ||
+		    start != offset) {
+			g_debug ("server did not resume %s, restarting", uri);
+			offset = 0;
 		}
+	}
+	if (offset == 0 && msg->status_code == SOUP_STATUS_PARTIAL_CONTENT) {
 		g_set_error (error,
 			     GS_PLUGIN_ERROR,
 			     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
-			     "failed to download %s: %s",
-			     uri, str->str);
+			     "failed to download %s: unexpected partial content",
+			     uri);
+		g_file_delete (file_part, NULL, NULL);
 		return FALSE;
 	}
-	if (!gs_mkdir_parent (filename, error))
+	if (offset > 0) {
+		ostream = g_file_append_to (file_part, G_FILE_CREATE_NONE,
+					    cancellable, &error_local);
+	} else {
+		/* write to the partial file itself, as g_file_replace() would
+		 * rename a new file over it and lose the etag set below */
+		if (!g_file_delete (file_part, cancellable, &error_local)) {
+			if (!g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+				gs_plugin_download_set_error (error, error_local,
+							      GS_PLUGIN_ERROR_WRITE_FAILED,
+							      "Failed to remove partial file");
+				return FALSE;
+			}
+			g_clear_error (&error_local);
+		}
+		ostream = g_file_create (file_part, G_FILE_CREATE_NONE,
+					 cancellable, &error_local);
+	}
+	if (ostream == NULL) {
+		gs_plugin_download_set_error (error, error_local,
+					      GS_PLUGIN_ERROR_WRITE_FAILED,
+					      "Failed to save file");
 		return FALSE;
-	if (!g_file_set_contents (filename,
-				  msg->response_body->data,
-				  msg->response_body->length,
-				  &error_local)) {
-		g_set_error (error,
-			     GS_PLUGIN_ERROR,
-			     GS_PLUGIN_ERROR_WRITE_FAILED,
-			     "Failed to save file: %s",
-			     error_local->message);
+	}
+
+	/* remember how to validate the partial file if we are interrupted */
+	etag_new = soup_message_headers_get_one (msg->response_headers, "ETag");
+	if (etag_new == NULL)
+		etag_new = soup_message_headers_get_one (msg->response_headers, "Last-Modified");
+	if (etag_new != NULL && offset == 0) {
+		g_autoptr(GError) error_attr = NULL;
+		if (!g_file_set_attribute_string (file_part,
+						  GS_PLUGIN_DOWNLOAD_ATTRIBUTE_ETAG,
+						  etag_new,
+						  G_FILE_QUERY_INFO_NONE,
+						  cancellable, &error_attr))
+			g_debug ("cannot make %s resumable: %s",
+				 filename_part, error_attr->message);
+	}
+
+	/* stream to the partial file, then atomically move into place */
+	gs_plugin_download_helper_init (&helper, plugin, app, msg, offset);
+	if (!gs_plugin_download_splice (&helper, stream, G_OUTPUT_STREAM (ostream),
+					uri, cancellable, error))
+		return FALSE;
+	if (!g_output_stream_close (G_OUTPUT_STREAM (ostream), cancellable, &error_local)) {
+		gs_plugin_download_set_error (error, error_local,
+					      GS_PLUGIN_ERROR_WRITE_FAILED,
+					      "Failed to save file");
+		return FALSE;
+	}
+	file = g_file_new_for_path (filename);
+	if (!g_file_move (file_part, file, G_FILE_COPY_OVERWRITE,
+			  cancellable, NULL, NULL, &error_local)) {
+		gs_plugin_download_set_error (error, error_local,
+					      GS_PLUGIN_ERROR_WRITE_FAILED,
+					      "Failed to save file");
 		return FALSE;
 	}
 	return TRUE;
@@ -9,8 +9,12 @@
 
 #include "config.h"
 
+#include <glib/gstdio.h>
+#include <string.h>
+
 #include "unity-software-private.h"
 
+#include "gs-install-queue.h"
 #include "gs-test.h"
 
 static gboolean
@@ -238,6 +242,241 @@ gs_utils_parse_evr_func (void)
 	}
 }
 
+typedef struct {
+	GMainContext	*context;
+	GMainLoop	*loop;
+	GThread		*thread;
+	GMutex		 mutex;
+	GCond		 cond;
+	GBytes		*payload;
+	const gchar	*etag;
+	guint		 port;
+	gint		 n_ranged;
+} GsTestServer;
+
+static void
+gs_test_server_handler_cb (SoupServer *server,
+			   SoupMessage *msg,
+			   const char *path,
+			   GHashTable *query,
+			   SoupClientContext *client,
+			   gpointer user_data)
+{
+	GsTestServer *self = (GsTestServer *) user_data;
+	const gchar *data;
+	const gchar *if_range;
+	gint n_ranges = 0;
+	gsize size = 0;
+	SoupRange *ranges = NULL;
+
+	if (g_strcmp0 (path, "/missing") == 0) {
+		soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+		soup_message_set_response (msg, "text/plain", SOUP_MEMORY_STATIC,
+					   "no such file", 12);
+		return;
+	}
+
+	/* honour Range only if the validator still matches */
+	data = g_bytes_get_data (self->payload, &size);
+	soup_message_headers_replace (msg->response_headers, "ETag", self->etag);
+	if_range = soup_message_headers_get_one (msg->request_headers, "If-Range");
+	if (if_range != NULL && g_strcmp0 (if_range, self->etag) != 0)
+		soup_message_headers_remove (msg->request_headers, "Range");
+	if (soup_message_headers_get_ranges (msg->request_headers, size,
+					     &ranges, &n_ranges)) {
+		goffset start = ranges[0].start;
+		goffset end = ranges[0].end;
+		g_atomic_int_inc (&self->n_ranged);
+		soup_message_headers_set_content_range (msg->response_headers,
+							start, end, size);
+		soup_message_set_status (msg, SOUP_STATUS_PARTIAL_CONTENT);
+		soup_message_body_append (msg->response_body, SOUP_MEMORY_COPY,
+					  data + start, (gsize) (end - start + 1));
+		soup_message_headers_free_ranges (msg->request_headers, ranges);
+		return;
+	}
+	soup_message_set_status (msg, SOUP_STATUS_OK);
+	soup_message_body_append (msg->response_body, SOUP_MEMORY_COPY, data, size);
+}
+
+static gpointer
+gs_test_server_thread_cb (gpointer user_data)
+{
+	GsTestServer *self = (GsTestServer *) user_data;
+	GSList *uris;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(SoupServer) server = NULL;
+
+	/* the listening socket is attached to the thread-default context */
+	g_main_context_push_thread_default (self->context);
+	server = soup_server_new (NULL, NULL);
+	soup_server_add_handler (server, NULL, gs_test_server_handler_cb, self, NULL);
+	if (!soup_server_listen_local (server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &error))
+		g_error ("failed to listen: %s", error->message);
+	uris = soup_server_get_uris (server);
+	g_mutex_lock (&self->mutex);
+	self->port = soup_uri_get_port ((SoupURI *) uris->data);
+	g_cond_signal (&self->cond);
+	g_mutex_unlock (&self->mutex);
+	g_slist_free_full (uris, (GDestroyNotify) soup_uri_free);
+
+	g_main_loop_run (self->loop);
+	soup_server_disconnect (server);
+	g_main_context_pop_thread_default (self->context);
+	return NULL;
+}
+
+static GsTestServer *
+gs_test_server_new (GBytes *payload)
+{
+	GsTestServer *self = g_new0 (GsTestServer, 1);
+	self->context = g_main_context_new ();
+	self->loop = g_main_loop_new (self->context, FALSE);
+	self->payload = g_bytes_ref (payload);
+	self->etag = "\"v1\"";
+	g_mutex_init (&self->mutex);
+	g_cond_init (&self->cond);
+	g_mutex_lock (&self->mutex);
+	self->thread = g_thread_new ("gs-test-server", gs_test_server_thread_cb, self);
+	while (self->port == 0)
+		g_cond_wait (&self->cond, &self->mutex);
+	g_mutex_unlock (&self->mutex);
+	return self;
+}
+
+static void
+gs_test_server_free (GsTestServer *self)
+{
+	g_main_loop_quit (self->loop);
+	g_thread_join (self->thread);
+	g_main_loop_unref (self->loop);
+	g_main_context_unref (self->context);
+	g_bytes_unref (self->payload);
+	g_mutex_clear (&self->mutex);
+	g_cond_clear (&self->cond);
+	g_free (self);
+}
+
+static void
+gs_plugin_download_func (void)
+{
+	GsTestServer *server;
+	const gsize size = 1024 * 1024;
+	const gsize size_part = 100 * 1000;
+	gboolean ret;
+	gsize length = 0;
+	g_autofree gchar *contents = NULL;
+	g_autofree gchar *dirpath = NULL;
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *fn_part = NULL;
+	g_autofree gchar *tmpdir = NULL;
+	g_autofree gchar *uri = NULL;
+	g_autofree gchar *uri_missing = NULL;
+	g_autofree guint8 *data = g_malloc (size);
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GBytes) payload = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file_part = NULL;
+	g_autoptr(GRand) rand = g_rand_new_with_seed (42);
+	g_autoptr(GsApp) app = gs_app_new ("download");
+	g_autoptr(GsPlugin) plugin = NULL;
+	g_autoptr(SoupSession) soup_session = soup_session_new ();
+
+	/* serve something bigger than the download buffer */
+	for (gsize i = 0; i < size; i++)
+		data[i] = (guint8) g_rand_int_range (rand, 0, 256);
+	payload = g_bytes_new (data, size);
+	server = gs_test_server_new (payload);
+	uri = g_strdup_printf ("http://127.0.0.1:%u/file.bin", server->port);
+	uri_missing = g_strdup_printf ("http://127.0.0.1:%u/missing", server->port);
+
+	plugin = gs_plugin_new ();
+	gs_plugin_set_name (plugin, "self-test");
+	gs_plugin_set_soup_session (plugin, soup_session);
+	tmpdir = g_dir_make_tmp ("gs-self-test-XXXXXX", &error);
+	g_assert_no_error (error);
+	dirpath = g_build_filename (tmpdir, "download", NULL);
+	fn = g_build_filename (dirpath, "file.bin", NULL);
+	fn_part = g_strdup_printf ("%s.part", fn);
+	file_part = g_file_new_for_path (fn_part);
+
+	/* to memory */
+	bytes = gs_plugin_download_data (plugin, NULL, uri, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (g_bytes_equal (bytes, payload));
+
+	/* to a file, with progress */
+	ret = gs_plugin_download_file (plugin, app, uri, fn, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (gs_app_get_progress (app), ==, 100);
+	g_assert (!g_file_test (fn_part, G_FILE_TEST_EXISTS));
+	ret = g_file_get_contents (fn, &contents, &length, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (length, ==, size);
+	g_assert (memcmp (contents, data, size) == 0);
+	g_clear_pointer (&contents, g_free);
+	g_unlink (fn);
+
+	/* errors are reported and nothing is left behind */
+	ret = gs_plugin_download_file (plugin, NULL, uri_missing, fn, NULL, &error);
+	g_assert_error (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_DOWNLOAD_FAILED);
+	g_assert (!ret);
+	g_assert (!g_file_test (fn, G_FILE_TEST_EXISTS));
+	g_clear_error (&error);
+
+	/* resume an interrupted download */
+	ret = g_file_set_contents (fn_part, (const gchar *) data, size_part, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	if (!g_file_set_attribute_string (file_part, "xattr::unity-software.etag",
+					  server->etag, G_FILE_QUERY_INFO_NONE,
+					  NULL, &error)) {
+		g_unlink (fn_part);
+		g_rmdir (dirpath);
+		g_rmdir (tmpdir);
+		gs_test_server_free (server);
+		g_test_skip (error->message);
+		return;
+	}
+	ret = gs_plugin_download_file (plugin, app, uri, fn, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (g_atomic_int_get (&server->n_ranged), ==, 1);
+	ret = g_file_get_contents (fn, &contents, &length, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (length, ==, size);
+	g_assert (memcmp (contents, data, size) == 0);
+	g_clear_pointer (&contents, g_free);
+	g_unlink (fn);
+
+	/* a partial file from an older version is thrown away */
+	ret = g_file_set_contents (fn_part, "stale", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = g_file_set_attribute_string (file_part, "xattr::unity-software.etag",
+					   "\"v0\"", G_FILE_QUERY_INFO_NONE,
+					   NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = gs_plugin_download_file (plugin, app, uri, fn, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (g_atomic_int_get (&server->n_ranged), ==, 1);
+	ret = g_file_get_contents (fn, &contents, &length, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (length, ==, size);
+	g_assert (memcmp (contents, data, size) == 0);
+
+	g_unlink (fn);
+	g_rmdir (dirpath);
+	g_rmdir (tmpdir);
+	gs_test_server_free (server);
+}
+
 static void
 gs_plugin_download_rewrite_func (void)
 {
@@ -599,6 +838,303 @@ gs_app_thread_func (void)
 	g_setenv ("G_MESSAGES_DEBUG", "all", TRUE);
 }
 
+static void
+gs_app_notify_count_cb (GObject *object, GParamSpec *pspec, gpointer user_data)
+{
+	guint *cnt = (guint *) user_data;
+	(*cnt)++;
+}
+
+static void
+gs_app_notify_func (void)
+{
+	guint cnt_rating = 0;
+	guint cnt_state = 0;
+	g_autoptr(GsApp) app = gs_app_new ("gimp.desktop");
+
+	g_signal_connect (app, "notify::rating",
+			  G_CALLBACK (gs_app_notify_count_cb), &cnt_rating);
+	g_signal_connect (app, "notify::state",
+			  G_CALLBACK (gs_app_notify_count_cb), &cnt_state);
+
+	/* repeated changes are only notified once */
+	gs_app_set_rating (app, 10);
+	gs_app_set_rating (app, 20);
+	gs_app_set_rating (app, 30);
+	gs_app_set_state (app, AS_APP_STATE_AVAILABLE);
+	g_assert_cmpint (cnt_rating, ==, 0);
+	g_assert_cmpint (cnt_state, ==, 0);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (cnt_rating, ==, 1);
+	g_assert_cmpint (cnt_state, ==, 1);
+
+	/* notifications are held back until the queued thaw */
+	g_object_freeze_notify (G_OBJECT (app));
+	gs_app_set_rating (app, 40);
+	gs_app_queue_thaw_notify (app);
+	g_assert_cmpint (cnt_rating, ==, 1);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (cnt_rating, ==, 2);
+
+	/* a new batch is started after the dispatch */
+	gs_app_set_rating (app, 50);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (cnt_rating, ==, 3);
+}
+
+static void
+gs_app_memory_size_func (void)
+{
+	g_autoptr(GsApp) app = gs_app_new ("gimp.desktop");
+	g_autoptr(GdkPixbuf) pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 64, 64);
+	guint64 sz;
+
+	/* strings are counted */
+	sz = gs_app_get_memory_size (app);
+	g_assert_cmpint (sz, >, 0);
+	gs_app_set_description (app, GS_APP_QUALITY_NORMAL,
+				"A long description that takes up some space");
+	g_assert_cmpint (gs_app_get_memory_size (app), >, sz);
+
+	/* the pixbuf dominates */
+	sz = gs_app_get_memory_size (app);
+	gs_app_set_pixbuf (app, pixbuf);
+	g_assert_cmpint (gs_app_get_memory_size (app), >=, sz + 64 * 64 * 4);
+}
+
+static void
+gs_app_refine_ledger_func (void)
+{
+	g_autoptr(GsApp) app = gs_app_new ("gimp.desktop");
+
+	/* nothing recorded yet */
+	g_assert (!gs_app_refine_ledger_covers (app, "appstream",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON, 0));
+
+	/* flags accumulate within a generation */
+	gs_app_refine_ledger_add (app, "appstream", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON, 0);
+	gs_app_refine_ledger_add (app, "appstream", GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING, 0);
+	g_assert (gs_app_refine_ledger_covers (app, "appstream",
+					       GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON |
+					       GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING, 0));
+	g_assert (!gs_app_refine_ledger_covers (app, "appstream",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON |
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_SCREENSHOTS, 0));
+	g_assert (!gs_app_refine_ledger_covers (app, "odrs",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON, 0));
+
+	/* a new generation makes the old record stale */
+	g_assert (!gs_app_refine_ledger_covers (app, "appstream",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON, 1));
+	gs_app_refine_ledger_add (app, "appstream", GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE, 1);
+	g_assert (!gs_app_refine_ledger_covers (app, "appstream",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON, 1));
+	g_assert (gs_app_refine_ledger_covers (app, "appstream",
+					       GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE, 1));
+
+	/* changing state forgets everything */
+	gs_app_set_state (app, AS_APP_STATE_AVAILABLE);
+	g_assert (!gs_app_refine_ledger_covers (app, "appstream",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE, 1));
+	gs_app_refine_ledger_add (app, "appstream", GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE, 1);
+	gs_app_refine_ledger_clear (app);
+	g_assert (!gs_app_refine_ledger_covers (app, "appstream",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE, 1));
+}
+
+static void
+gs_plugin_refine_generation_func (void)
+{
+	g_autoptr(GsPlugin) plugin = gs_plugin_new ();
+
+	/* each change to the data refine uses is counted */
+	g_assert_cmpint (gs_plugin_get_refine_generation (plugin), ==, 0);
+	gs_plugin_refine_data_changed (plugin);
+	gs_plugin_refine_data_changed (plugin);
+	g_assert_cmpint (gs_plugin_get_refine_generation (plugin), ==, 2);
+}
+
+static void
+gs_plugin_loader_app_cache_func (void)
+{
+	guint n_apps = 0;
+	guint hits = 0;
+	guint misses = 0;
+	guint evictions = 0;
+	guint64 sz = 0;
+	guint64 sz_tmp = 0;
+	g_autoptr(GSettings) settings = g_settings_new ("org.ubuntuunity.software");
+	g_autoptr(GsPluginLoader) plugin_loader = NULL;
+	g_autoptr(GsApp) app1 = gs_app_new_from_unique_id ("system/package/fedora/desktop/gimp.desktop/*");
+	g_autoptr(GsApp) app2 = gs_app_new_from_unique_id ("system/package/fedora/desktop/gimp.desktop/*");
+	g_autoptr(GsApp) app3 = gs_app_new_from_unique_id ("system/package/fedora/desktop/gimp.desktop/*");
+	g_autoptr(GsApp) app4 = gs_app_new_from_unique_id ("system/package/fedora/desktop/inkscape.desktop/*");
+	g_autoptr(GsApp) app5 = gs_app_new_from_unique_id ("system/package/fedora/desktop/inkscape.desktop/*");
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GdkPixbuf) pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 64, 64);
+
+	g_settings_set_uint (settings, "app-cache-size", 1024 * 1024);
+	plugin_loader = gs_plugin_loader_new ();
+
+	/* the first app is added */
+	gs_app_list_add (list, app1);
+	gs_plugin_loader_app_cache_canonicalize (plugin_loader, list);
+	g_assert (gs_app_list_index (list, 0) == app1);
+	gs_plugin_loader_get_app_cache_stats (plugin_loader, &n_apps, &sz, &hits, &misses, NULL);
+	g_assert_cmpint (n_apps, ==, 1);
+	g_assert_cmpint (sz, ==, gs_app_get_memory_size (app1));
+	g_assert_cmpint (hits, ==, 0);
+	g_assert_cmpint (misses, ==, 1);
+
+	/* a copy with nothing new to say is replaced by the cached app */
+	gs_app_list_remove_all (list);
+	gs_app_list_add (list, app2);
+	gs_plugin_loader_app_cache_canonicalize (plugin_loader, list);
+	g_assert (gs_app_list_index (list, 0) == app1);
+	gs_plugin_loader_get_app_cache_stats (plugin_loader, &n_apps, NULL, &hits, &misses, NULL);
+	g_assert_cmpint (n_apps, ==, 1);
+	g_assert_cmpint (hits, ==, 1);
+	g_assert_cmpint (misses, ==, 1);
+
+	/* a copy in a different state replaces the cached app */
+	gs_app_set_state (app3, AS_APP_STATE_AVAILABLE);
+	gs_app_list_remove_all (list);
+	gs_app_list_add (list, app3);
+	gs_plugin_loader_app_cache_canonicalize (plugin_loader, list);
+	g_assert (gs_app_list_index (list, 0) == app3);
+	gs_plugin_loader_get_app_cache_stats (plugin_loader, &n_apps, &sz, &hits, &misses, NULL);
+	g_assert_cmpint (n_apps, ==, 1);
+	g_assert_cmpint (sz, ==, gs_app_get_memory_size (app3));
+	g_assert_cmpint (hits, ==, 1);
+	g_assert_cmpint (misses, ==, 2);
+
+	/* fill the budget, with the older app last in line */
+	gs_app_list_remove_all (list);
+	gs_app_list_add (list, app4);
+	gs_plugin_loader_app_cache_canonicalize (plugin_loader, list);
+	gs_plugin_loader_get_app_cache_stats (plugin_loader, &n_apps, &sz, NULL, NULL, NULL);
+	g_assert_cmpint (n_apps, ==, 2);
+	g_settings_set_uint (settings, "app-cache-size", sz + 1024);
+	gs_test_flush_main_context ();
+	gs_plugin_loader_get_app_cache_stats (plugin_loader, &n_apps, NULL, NULL, NULL, &evictions);
+	g_assert_cmpint (n_apps, ==, 2);
+	g_assert_cmpint (evictions, ==, 0);
+
+	/* refining the older app grows it out of the budget */
+	sz_tmp = gs_app_get_memory_size (app4);
+	gs_app_set_pixbuf (app3, pixbuf);
+	gs_app_list_remove_all (list);
+	gs_app_list_add (list, app3);
+	gs_plugin_loader_app_cache_update (plugin_loader, list);
+	gs_plugin_loader_get_app_cache_stats (plugin_loader, &n_apps, &sz, NULL, NULL, &evictions);
+	g_assert_cmpint (n_apps, ==, 1);
+	g_assert_cmpint (sz, ==, sz_tmp);
+	g_assert_cmpint (evictions, ==, 1);
+
+	/* so it is no longer shared */
+	gs_plugin_loader_app_cache_canonicalize (plugin_loader, list);
+	g_assert (gs_app_list_index (list, 0) == app3);
+	gs_plugin_loader_get_app_cache_stats (plugin_loader, NULL, NULL, NULL, &misses, NULL);
+	g_assert_cmpint (misses, ==, 4);
+
+	/* a copy with a different version replaces the cached app */
+	g_settings_set_uint (settings, "app-cache-size", 1024 * 1024);
+	gs_test_flush_main_context ();
+	gs_app_list_remove_all (list);
+	gs_app_list_add (list, app4);
+	gs_plugin_loader_app_cache_canonicalize (plugin_loader, list);
+	g_assert (gs_app_list_index (list, 0) == app4);
+	gs_app_set_version (app5, "1.2.3");
+	gs_app_list_remove_all (list);
+	gs_app_list_add (list, app5);
+	gs_plugin_loader_app_cache_canonicalize (plugin_loader, list);
+	g_assert (gs_app_list_index (list, 0) == app5);
+
+	g_settings_reset (settings, "app-cache-size");
+}
+
+static void
+gs_install_queue_func (void)
+{
+	gboolean ret;
+	g_autofree gchar *tmpdir = NULL;
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *fn_journal = NULL;
+	g_autofree gchar *contents = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsInstallQueue) queue = NULL;
+	g_auto(GStrv) ids = NULL;
+
+	tmpdir = g_dir_make_tmp ("gs-self-test-XXXXXX", &error);
+	g_assert_no_error (error);
+	fn = g_build_filename (tmpdir, "install-queue", NULL);
+	fn_journal = g_strdup_printf ("%s.journal", fn);
+
+	/* an old-style snapshot with no journal */
+	ret = g_file_set_contents (fn, "gimp.desktop\ninkscape.desktop\n", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	queue = gs_install_queue_new (fn);
+	ids = gs_install_queue_load (queue, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (g_strv_length (ids), ==, 2);
+	g_assert_cmpstr (ids[0], ==, "gimp.desktop");
+	g_assert_cmpstr (ids[1], ==, "inkscape.desktop");
+	g_clear_pointer (&ids, g_strfreev);
+
+	/* changes only go to the journal */
+	gs_install_queue_enqueue (queue, "krita.desktop");
+	gs_install_queue_dequeue (queue, "gimp.desktop");
+	gs_install_queue_complete (queue, "inkscape.desktop");
+	gs_install_queue_flush (queue);
+	ret = g_file_get_contents (fn_journal, &contents, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpstr (contents, ==, "+krita.desktop\n-gimp.desktop\n*inkscape.desktop\n");
+	g_clear_pointer (&contents, g_free);
+	g_clear_object (&queue);
+
+	/* a torn record from a crash is ignored on replay */
+	ret = g_file_set_contents (fn_journal,
+				   "+krita.desktop\n-gimp.desktop\n*inkscape.desktop\n+blen",
+				   -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	queue = gs_install_queue_new (fn);
+	ids = gs_install_queue_load (queue, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (g_strv_length (ids), ==, 1);
+	g_assert_cmpstr (ids[0], ==, "krita.desktop");
+	g_clear_pointer (&ids, g_strfreev);
+
+	/* the replayed journal is folded into the snapshot */
+	gs_install_queue_flush (queue);
+	g_assert (!g_file_test (fn_journal, G_FILE_TEST_EXISTS));
+	ret = g_file_get_contents (fn, &contents, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpstr (contents, ==, "krita.desktop\n");
+	g_clear_pointer (&contents, g_free);
+
+	/* a long journal is compacted automatically */
+	for (guint i = 0; i < 100; i++) {
+		gs_install_queue_enqueue (queue, "blender.desktop");
+		gs_install_queue_dequeue (queue, "blender.desktop");
+	}
+	gs_install_queue_flush (queue);
+	g_clear_object (&queue);
+	queue = gs_install_queue_new (fn);
+	ids = gs_install_queue_load (queue, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (g_strv_length (ids), ==, 1);
+	g_assert_cmpstr (ids[0], ==, "krita.desktop");
+	g_clear_object (&queue);
+
+	g_unlink (fn_journal);
+	g_unlink (fn);
+	g_rmdir (tmpdir);
+}
+
 static void
 gs_app_unique_id_func (void)
 {
@@ -725,6 +1261,39 @@ gs_app_list_wildcard_dedupe_func (void)
 	g_assert_cmpint (gs_app_list_length (list), ==, 1);
 }
 
+static void
+gs_app_list_lookup_changed_id_func (void)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsApp) app1 = gs_app_new (NULL);
+	g_autoptr(GsApp) app2 = gs_app_new ("old.desktop");
+	g_autoptr(GsApp) app3 = gs_app_new ("app3.desktop");
+	g_autoptr(GsApp) app4 = gs_app_new (NULL);
+
+	/* the ID is set after the app is added */
+	gs_app_list_add (list, app1);
+	gs_app_set_id (app1, "app1.desktop");
+	g_assert (gs_app_list_lookup (list, "*/*/*/*/app1.desktop/*") == app1);
+
+	/* the ID is changed after the app is added */
+	gs_app_list_add (list, app2);
+	gs_app_set_id (app2, "new.desktop");
+	g_assert (gs_app_list_lookup (list, "*/*/*/*/new.desktop/*") == app2);
+	g_assert_null (gs_app_list_lookup (list, "*/*/*/*/old.desktop/*"));
+
+	/* a wildcard does not stop other apps being found */
+	gs_app_add_quirk (app4, GS_APP_QUIRK_IS_WILDCARD);
+	gs_app_list_add (list, app4);
+	gs_app_list_add (list, app3);
+	g_assert (gs_app_list_lookup (list, "*/*/*/*/app3.desktop/*") == app3);
+
+	/* the first match in the list still wins */
+	gs_app_set_id (app4, "app3.desktop");
+	g_assert (gs_app_list_lookup (list, "*/*/*/*/app3.desktop/*") == app4);
+	gs_app_list_remove (list, app4);
+	g_assert (gs_app_list_lookup (list, "*/*/*/*/app3.desktop/*") == app3);
+}
+
 static void
 gs_app_list_func (void)
 {
@@ -761,11 +1330,12 @@ gs_app_list_performance_func (void)
 {
 	g_autoptr(GPtrArray) apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsAppList) list_copy = NULL;
 	g_autoptr(GTimer) timer = NULL;
 
-	/* create a few apps */
-	for (guint i = 0; i < 500; i++) {
-		g_autofree gchar *id = g_strdup_printf ("%03u.desktop", i);
+	/* create a lot of apps */
+	for (guint i = 0; i < 50000; i++) {
+		g_autofree gchar *id = g_strdup_printf ("%05u.desktop", i);
 		g_ptr_array_add (apps, gs_app_new (id));
 	}
 
@@ -775,7 +1345,41 @@ gs_app_list_performance_func (void)
 		GsApp *app = g_ptr_array_index (apps, i);
 		gs_app_list_add (list, app);
 	}
+	g_assert_cmpint (gs_app_list_length (list), ==, 50000);
 	g_print ("%.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	/* adding them again is a no-op */
+	g_timer_reset (timer);
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		gs_app_list_add (list, app);
+	}
+	g_assert_cmpint (gs_app_list_length (list), ==, 50000);
+	g_print ("%.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	/* look them all up */
+	g_timer_reset (timer);
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		g_assert_true (gs_app_list_lookup (list, gs_app_get_unique_id (app)) == app);
+	}
+	g_print ("%.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	/* copy, then add the whole list to itself */
+	g_timer_reset (timer);
+	list_copy = gs_app_list_copy (list);
+	gs_app_list_add_list (list_copy, list);
+	g_assert_cmpint (gs_app_list_length (list_copy), ==, 50000);
+	g_print ("%.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	/* the index survives a reorder */
+	gs_app_list_randomize (list_copy);
+	gs_app_list_remove (list_copy, g_ptr_array_index (apps, 0));
+	g_assert_null (gs_app_list_lookup (list_copy, "*/*/*/*/00000.desktop/*"));
+	g_assert_nonnull (gs_app_list_lookup (list_copy, "*/*/*/*/00001.desktop/*"));
+
+	/* a wildcard ID section still matches the first app in the list */
+	g_assert_true (gs_app_list_lookup (list, "*/*/*/*/*/*") == g_ptr_array_index (apps, 0));
 }
 
 static void
@@ -824,11 +1428,19 @@ main (int argc, char **argv)
 	g_test_add_func ("/unity-software/lib/app{addons}", gs_app_addons_func);
 	g_test_add_func ("/unity-software/lib/app{unique-id}", gs_app_unique_id_func);
 	g_test_add_func ("/unity-software/lib/app{thread}", gs_app_thread_func);
+	g_test_add_func ("/unity-software/lib/app{notify}", gs_app_notify_func);
+	g_test_add_func ("/unity-software/lib/app{refine-ledger}", gs_app_refine_ledger_func);
+	g_test_add_func ("/unity-software/lib/app{memory-size}", gs_app_memory_size_func);
 	g_test_add_func ("/unity-software/lib/app{list}", gs_app_list_func);
 	g_test_add_func ("/unity-software/lib/app{list-wildcard-dedupe}", gs_app_list_wildcard_dedupe_func);
+	g_test_add_func ("/unity-software/lib/app{list-lookup-changed-id}", gs_app_list_lookup_changed_id_func);
 	g_test_add_func ("/unity-software/lib/app{list-performance}", gs_app_list_performance_func);
 	g_test_add_func ("/unity-software/lib/app{list-related}", gs_app_list_related_func);
+	g_test_add_func ("/unity-software/lib/install-queue", gs_install_queue_func);
+	g_test_add_func ("/unity-software/lib/plugin-loader{app-cache}", gs_plugin_loader_app_cache_func);
 	g_test_add_func ("/unity-software/lib/plugin", gs_plugin_func);
+	g_test_add_func ("/unity-software/lib/plugin{refine-generation}", gs_plugin_refine_generation_func);
+	g_test_add_func ("/unity-software/lib/plugin{download}", gs_plugin_download_func);
 	g_test_add_func ("/unity-software/lib/plugin{download-rewrite}", gs_plugin_download_rewrite_func);
 
 	return g_test_run ();
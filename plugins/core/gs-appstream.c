@@ -10,8 +10,12 @@
 #include "config.h"
 
 #include <unity-software.h>
+#ifdef HAVE_LIBSTEMMER
+#include <libstemmer.h>
+#endif
 
 #include "gs-appstream.h"
+#include "gs-desktop-common.h"
 
 #define	GS_APPSTREAM_MAX_SCREENSHOTS	5
 
@@ -1053,6 +1057,521 @@ gs_appstream_refine_app (GsPlugin *plugin,
 	return TRUE;
 }
 
+/* bump this if the on-disk layout of the search index changes */
+#define	GS_APPSTREAM_SEARCH_INDEX_VERSION	1
+#define	GS_APPSTREAM_SEARCH_INDEX_TYPE		"(usua(sa(uq)))"
+
+/* the inverted index maps each case-folded word found in a searchable field
+ * to a posting list of (component offset, match bitmask) tuples; the tokens
+ * are sorted so that the word-prefix semantics of the `~=` operator can be
+ * answered with a binary search rather than scanning every component */
+struct _GsAppstreamSearchIndex {
+	GPtrArray		*components;	/* of XbNode, by offset */
+	GVariant		*tokens;	/* a(sa(uq)), sorted by token */
+#ifdef HAVE_LIBSTEMMER
+	struct sb_stemmer	*stemmer;
+	GMutex			 stemmer_mutex;
+#endif
+};
+
+typedef struct {
+	guint32			 offset;
+	guint16			 match_value;
+} GsAppstreamSearchPosting;
+
+void
+gs_appstream_search_index_free (GsAppstreamSearchIndex *index)
+{
+	if (index->components != NULL)
+		g_ptr_array_unref (index->components);
+	if (index->tokens != NULL)
+		g_variant_unref (index->tokens);
+#ifdef HAVE_LIBSTEMMER
+	if (index->stemmer != NULL)
+		sb_stemmer_delete (index->stemmer);
+	g_mutex_clear (&index->stemmer_mutex);
+#endif
+	g_free (index);
+}
+
+/* this mirrors xb_string_search(), which matches the search term against the
+ * start of each whitespace-delimited word, ignoring any leading punctuation */
+static void
+gs_appstream_search_index_add_text (GHashTable *tokens,
+				    const gchar *text,
+				    guint16 match_value)
+{
+	g_auto(GStrv) words = NULL;
+
+	if (text == NULL)
+		return;
+	words = g_strsplit_set (text, " \t\n\r\f\v", -1);
+	for (guint i = 0; words[i] != NULL; i++) {
+		const gchar *word = words[i];
+		gchar *token;
+		guint16 match_value_token = match_value;
+		while (*word != '\0' && !g_ascii_isalnum (*word))
+			word++;
+		if (*word == '\0')
+			continue;
+		token = g_ascii_strdown (word, -1);
+		match_value_token |= GPOINTER_TO_UINT (g_hash_table_lookup (tokens, token));
+		g_hash_table_replace (tokens, token, GUINT_TO_POINTER (match_value_token));
+	}
+}
+
+static GVariant *
+gs_appstream_search_index_build (XbSilo *silo,
+				 GPtrArray *components,
+				 GCancellable *cancellable,
+				 GError **error)
+{
+	GVariantBuilder builder;
+	g_autoptr(GHashTable) postings = NULL;
+	g_autoptr(GList) keys = NULL;
+	g_autoptr(GPtrArray) queries = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GArray) match_values = g_array_new (FALSE, FALSE, sizeof(guint16));
+	const struct {
+		AsAppSearchMatch	 match_value;
+		const gchar		*xpath;
+	} fields[] = {
+		{ AS_APP_SEARCH_MATCH_MIMETYPE,	"mimetypes/mimetype" },
+		{ AS_APP_SEARCH_MATCH_PKGNAME,	"pkgname" },
+		{ AS_APP_SEARCH_MATCH_COMMENT,	"summary" },
+		{ AS_APP_SEARCH_MATCH_NAME,	"name" },
+		{ AS_APP_SEARCH_MATCH_KEYWORD,	"keywords/keyword" },
+		{ AS_APP_SEARCH_MATCH_ID,	"id" },
+		{ AS_APP_SEARCH_MATCH_ID,	"launchable" },
+		{ AS_APP_SEARCH_MATCH_NONE,	NULL }
+	};
+
+	/* compile each field query once rather than once per component */
+	for (guint i = 0; fields[i].xpath != NULL; i++) {
+		g_autoptr(GError) error_query = NULL;
+		g_autoptr(XbQuery) query = xb_query_new (silo, fields[i].xpath, &error_query);
+		if (query == NULL) {
+			g_debug ("ignoring: %s", error_query->message);
+			continue;
+		}
+		g_ptr_array_add (queries, g_steal_pointer (&query));
+		g_array_append_val (match_values, fields[i].match_value);
+	}
+
+	/* token -> GArray of GsAppstreamSearchPosting */
+	postings = g_hash_table_new_full (g_str_hash, g_str_equal,
+					  g_free, (GDestroyNotify) g_array_unref);
+	for (guint i = 0; i < components->len; i++) {
+		XbNode *component = g_ptr_array_index (components, i);
+		GHashTableIter iter;
+		gpointer key, value;
+		g_autoptr(GHashTable) tokens = NULL;
+		g_autoptr(XbNode) parent = NULL;
+
+		if (g_cancellable_set_error_if_cancelled (cancellable, error))
+			return NULL;
+
+		/* collect every token of this component with a field bitmask */
+		tokens = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+		for (guint j = 0; j < queries->len; j++) {
+			XbQuery *query = g_ptr_array_index (queries, j);
+			guint16 match_value = g_array_index (match_values, guint16, j);
+			g_autoptr(GPtrArray) nodes = xb_node_query_full (component, query, NULL);
+			for (guint k = 0; nodes != NULL && k < nodes->len; k++) {
+				XbNode *n = g_ptr_array_index (nodes, k);
+				gs_appstream_search_index_add_text (tokens,
+								    xb_node_get_text (n),
+								    match_value);
+			}
+		}
+		parent = xb_node_get_parent (component);
+		if (parent != NULL &&
+		    g_strcmp0 (xb_node_get_element (parent), "components") == 0) {
+			gs_appstream_search_index_add_text (tokens,
+							    xb_node_get_attr (parent, "origin"),
+							    AS_APP_SEARCH_MATCH_ORIGIN);
+		}
+
+		/* add to the posting list for each token */
+		g_hash_table_iter_init (&iter, tokens);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			GsAppstreamSearchPosting posting = {
+				.offset = i,
+				.match_value = GPOINTER_TO_UINT (value),
+			};
+			GArray *array = g_hash_table_lookup (postings, key);
+			if (array == NULL) {
+				array = g_array_new (FALSE, FALSE, sizeof(GsAppstreamSearchPosting));
+				g_hash_table_insert (postings, g_strdup (key), array);
+			}
+			g_array_append_val (array, posting);
+		}
+	}
+
+	/* sort by token so prefixes can be found using a binary search */
+	keys = g_hash_table_get_keys (postings);
+	keys = g_list_sort (keys, (GCompareFunc) g_strcmp0);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa(uq))"));
+	for (GList *l = keys; l != NULL; l = l->next) {
+		const gchar *token = l->data;
+		GArray *array = g_hash_table_lookup (postings, token);
+		g_variant_builder_open (&builder, G_VARIANT_TYPE ("(sa(uq))"));
+		g_variant_builder_add (&builder, "s", token);
+		g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(uq)"));
+		for (guint i = 0; i < array->len; i++) {
+			GsAppstreamSearchPosting *posting;
+			posting = &g_array_index (array, GsAppstreamSearchPosting, i);
+			g_variant_builder_add (&builder, "(uq)",
+					       posting->offset,
+					       posting->match_value);
+		}
+		g_variant_builder_close (&builder);
+		g_variant_builder_close (&builder);
+	}
+	return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static GVariant *
+gs_appstream_search_index_load (GFile *file, const gchar *guid, guint n_components)
+{
+	const gchar *guid_tmp = NULL;
+	guint32 n_components_tmp = 0;
+	guint32 version = 0;
+	g_autofree gchar *fn = g_file_get_path (file);
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GMappedFile) mapped_file = NULL;
+	g_autoptr(GVariant) tokens = NULL;
+	g_autoptr(GVariant) variant = NULL;
+
+	mapped_file = g_mapped_file_new (fn, FALSE, &error_local);
+	if (mapped_file == NULL) {
+		g_debug ("failed to load search index: %s", error_local->message);
+		return NULL;
+	}
+	bytes = g_mapped_file_get_bytes (mapped_file);
+	variant = g_variant_new_from_bytes (G_VARIANT_TYPE (GS_APPSTREAM_SEARCH_INDEX_TYPE),
+					    bytes, FALSE);
+	g_variant_ref_sink (variant);
+	g_variant_get (variant, "(u&su@a(sa(uq)))",
+		       &version, &guid_tmp, &n_components_tmp, &tokens);
+
+	/* out of date */
+	if (version != GS_APPSTREAM_SEARCH_INDEX_VERSION ||
+	    g_strcmp0 (guid_tmp, guid) != 0 ||
+	    n_components_tmp != n_components) {
+		g_debug ("search index %s is invalid, rebuilding", fn);
+		return NULL;
+	}
+	return g_steal_pointer (&tokens);
+}
+
+static void
+gs_appstream_search_index_save (GFile *file,
+				const gchar *guid,
+				guint n_components,
+				GVariant *tokens,
+				GCancellable *cancellable)
+{
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GVariant) variant = NULL;
+
+	variant = g_variant_new ("(usu@a(sa(uq)))",
+				 (guint32) GS_APPSTREAM_SEARCH_INDEX_VERSION,
+				 guid,
+				 (guint32) n_components,
+				 tokens);
+	g_variant_ref_sink (variant);
+	bytes = g_variant_get_data_as_bytes (variant);
+	if (!g_file_replace_contents (file,
+				      g_bytes_get_data (bytes, NULL),
+				      g_bytes_get_size (bytes),
+				      NULL, FALSE,
+				      G_FILE_CREATE_REPLACE_DESTINATION,
+				      NULL, cancellable, &error_local)) {
+		g_warning ("failed to save search index: %s", error_local->message);
+	}
+}
+
+/**
+ * gs_appstream_search_index_new:
+ * @silo: a #XbSilo
+ * @file: (nullable): a #GFile to cache the index in, or %NULL
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Creates an inverted search index for all the components in @silo. If @file
+ * is set and contains an index for the same silo GUID it is mapped rather
+ * than being rebuilt, otherwise the new index is written to @file.
+ *
+ * The index must be freed when @silo is invalidated. If the search terms
+ * cannot be stemmed the same way libxmlb does then %G_IO_ERROR_NOT_SUPPORTED
+ * is returned and the silo should be searched without an index.
+ *
+ * Returns: (transfer full): a #GsAppstreamSearchIndex, or %NULL on error
+ **/
+GsAppstreamSearchIndex *
+gs_appstream_search_index_new (XbSilo *silo,
+			       GFile *file,
+			       GCancellable *cancellable,
+			       GError **error)
+{
+	const gchar *guid = xb_silo_get_guid (silo);
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GsAppstreamSearchIndex) index = NULL;
+	g_autoptr(GTimer) timer = g_timer_new ();
+
+#ifdef HAVE_LIBSTEMMER
+	index = g_new0 (GsAppstreamSearchIndex, 1);
+	g_mutex_init (&index->stemmer_mutex);
+	index->stemmer = sb_stemmer_new ("en", NULL);
+	if (index->stemmer == NULL) {
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_NOT_SUPPORTED,
+				     "no English stemmer available");
+		return NULL;
+	}
+#else
+	/* the search terms could not be stemmed the same way as stem() */
+	g_set_error_literal (error,
+			     G_IO_ERROR,
+			     G_IO_ERROR_NOT_SUPPORTED,
+			     "search index requires libstemmer");
+	return NULL;
+#endif
+
+	/* the offsets in the index refer to this array */
+	index->components = xb_silo_query (silo, "components/component", 0, &error_local);
+	if (index->components == NULL) {
+		if (!g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) &&
+		    !g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT)) {
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			return NULL;
+		}
+		index->components = g_ptr_array_new_with_free_func (g_object_unref);
+	}
+
+	/* try the cached copy first */
+	if (file != NULL) {
+		index->tokens = gs_appstream_search_index_load (file, guid,
+								index->components->len);
+		if (index->tokens != NULL) {
+			g_debug ("loaded search index in %fms",
+				 g_timer_elapsed (timer, NULL) * 1000);
+			return g_steal_pointer (&index);
+		}
+	}
+
+	index->tokens = gs_appstream_search_index_build (silo,
+							 index->components,
+							 cancellable,
+							 error);
+	if (index->tokens == NULL)
+		return NULL;
+	if (file != NULL) {
+		gs_appstream_search_index_save (file, guid,
+						index->components->len,
+						index->tokens,
+						cancellable);
+	}
+	g_debug ("built search index of %" G_GSIZE_FORMAT " tokens in %fms",
+		 g_variant_n_children (index->tokens),
+		 g_timer_elapsed (timer, NULL) * 1000);
+	return g_steal_pointer (&index);
+}
+
+static const gchar *
+gs_appstream_search_index_get_token (GsAppstreamSearchIndex *index, gsize idx)
+{
+	const gchar *token = NULL;
+	g_autoptr(GVariant) child = g_variant_get_child_value (index->tokens, idx);
+	g_variant_get_child (child, 0, "&s", &token);
+	return token;
+}
+
+static gint
+gs_appstream_search_posting_sort_cb (gconstpointer a, gconstpointer b)
+{
+	const GsAppstreamSearchPosting *pa = a;
+	const GsAppstreamSearchPosting *pb = b;
+	if (pa->offset < pb->offset)
+		return -1;
+	if (pa->offset > pb->offset)
+		return 1;
+	return 0;
+}
+
+/* this mirrors stem() in libxmlb, which is applied to the search term given
+ * to the `~=` operator but never to the text being searched; the tokens are
+ * already case-folded so the term is too */
+static gchar *
+gs_appstream_search_index_stem (GsAppstreamSearchIndex *index, const gchar *search)
+{
+	g_autofree gchar *search_down = g_ascii_strdown (search, -1);
+#ifdef HAVE_LIBSTEMMER
+	const sb_symbol *tmp;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&index->stemmer_mutex);
+	tmp = sb_stemmer_stem (index->stemmer,
+			       (const sb_symbol *) search_down,
+			       (gint) strlen (search_down));
+	if (tmp != NULL)
+		return g_strdup ((const gchar *) tmp);
+#endif
+	return g_steal_pointer (&search_down);
+}
+
+/* returns the postings for every token starting with the stem of @search,
+ * sorted by offset with the match values of duplicate components merged */
+static GArray *
+gs_appstream_search_index_lookup (GsAppstreamSearchIndex *index, const gchar *search)
+{
+	gsize lower = 0;
+	gsize upper = g_variant_n_children (index->tokens);
+	guint j = 0;
+	g_autofree gchar *search_down = NULL;
+	g_autoptr(GArray) array = g_array_new (FALSE, FALSE, sizeof(GsAppstreamSearchPosting));
+
+	/* can't possibly match */
+	if (search == NULL || search[0] == '\0')
+		return g_steal_pointer (&array);
+	search_down = gs_appstream_search_index_stem (index, search);
+	if (search_down[0] == '\0')
+		return g_steal_pointer (&array);
+
+	/* find the first token that is not less than the search term */
+	while (lower < upper) {
+		gsize mid = lower + (upper - lower) / 2;
+		if (g_strcmp0 (gs_appstream_search_index_get_token (index, mid), search_down) < 0)
+			lower = mid + 1;
+		else
+			upper = mid;
+	}
+
+	/* all tokens with the prefix are now contiguous */
+	for (gsize i = lower; i < g_variant_n_children (index->tokens); i++) {
+		const gchar *token = NULL;
+		GVariantIter iter;
+		guint32 offset;
+		guint16 match_value;
+		g_autoptr(GVariant) child = g_variant_get_child_value (index->tokens, i);
+		g_autoptr(GVariant) postings = NULL;
+
+		g_variant_get (child, "(&s@a(uq))", &token, &postings);
+		if (!g_str_has_prefix (token, search_down))
+			break;
+		g_variant_iter_init (&iter, postings);
+		while (g_variant_iter_next (&iter, "(uq)", &offset, &match_value)) {
+			GsAppstreamSearchPosting posting = {
+				.offset = offset,
+				.match_value = match_value,
+			};
+			g_array_append_val (array, posting);
+		}
+	}
+
+	/* merge duplicates */
+	g_array_sort (array, gs_appstream_search_posting_sort_cb);
+	for (guint i = 0; i < array->len; i++) {
+		GsAppstreamSearchPosting *src = &g_array_index (array, GsAppstreamSearchPosting, i);
+		GsAppstreamSearchPosting *dest = &g_array_index (array, GsAppstreamSearchPosting, j);
+		if (j > 0 && (dest - 1)->offset == src->offset) {
+			(dest - 1)->match_value |= src->match_value;
+			continue;
+		}
+		*dest = *src;
+		j++;
+	}
+	g_array_set_size (array, j);
+	return g_steal_pointer (&array);
+}
+
+/* keeps only the postings in @results that are also in @array */
+static void
+gs_appstream_search_index_intersect (GArray *results, GArray *array)
+{
+	guint i = 0;
+	guint j = 0;
+	guint k = 0;
+
+	while (i < results->len && j < array->len) {
+		GsAppstreamSearchPosting *a = &g_array_index (results, GsAppstreamSearchPosting, i);
+		GsAppstreamSearchPosting *b = &g_array_index (array, GsAppstreamSearchPosting, j);
+		if (a->offset < b->offset) {
+			i++;
+		} else if (a->offset > b->offset) {
+			j++;
+		} else {
+			GsAppstreamSearchPosting *dest = &g_array_index (results, GsAppstreamSearchPosting, k++);
+			dest->offset = a->offset;
+			dest->match_value = a->match_value | b->match_value;
+			i++;
+			j++;
+		}
+	}
+	g_array_set_size (results, k);
+}
+
+static gboolean
+gs_appstream_search_add_component (GsPlugin *plugin,
+				   XbSilo *silo,
+				   XbNode *component,
+				   guint16 match_value,
+				   GsAppList *list,
+				   GError **error)
+{
+	g_autoptr(GsApp) app = gs_appstream_create_app (plugin, silo, component, error);
+	if (app == NULL)
+		return FALSE;
+	if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD)) {
+		g_debug ("not returning wildcard %s",
+			 gs_app_get_unique_id (app));
+		return TRUE;
+	}
+	g_debug ("add %s", gs_app_get_unique_id (app));
+	gs_app_set_match_value (app, match_value);
+	gs_app_list_add (list, app);
+	return TRUE;
+}
+
+static gboolean
+gs_appstream_search_with_index (GsPlugin *plugin,
+				XbSilo *silo,
+				GsAppstreamSearchIndex *index,
+				const gchar * const *values,
+				GsAppList *list,
+				GCancellable *cancellable,
+				GError **error)
+{
+	g_autoptr(GArray) results = NULL;
+
+	/* do *all* search keywords match */
+	for (guint i = 0; values[i] != NULL; i++) {
+		g_autoptr(GArray) array = gs_appstream_search_index_lookup (index, values[i]);
+		if (results == NULL) {
+			results = g_steal_pointer (&array);
+		} else {
+			gs_appstream_search_index_intersect (results, array);
+		}
+		if (results->len == 0)
+			return TRUE;
+	}
+	if (results == NULL)
+		return TRUE;
+
+	for (guint i = 0; i < results->len; i++) {
+		GsAppstreamSearchPosting *posting;
+		posting = &g_array_index (results, GsAppstreamSearchPosting, i);
+		if (!gs_appstream_search_add_component (plugin, silo,
+							g_ptr_array_index (index->components,
+									   posting->offset),
+							posting->match_value,
+							list, error))
+			return FALSE;
+	}
+	return TRUE;
+}
+
 typedef struct {
 	AsAppSearchMatch	 match_value;
 	XbQuery			*query;
@@ -1097,9 +1616,25 @@ gs_appstream_silo_search_component (GPtrArray *array, XbNode *component, const g
 	return matches_sum;
 }
 
+/**
+ * gs_appstream_search:
+ * @plugin: a #GsPlugin
+ * @silo: a #XbSilo
+ * @index: (nullable): a #GsAppstreamSearchIndex for @silo, or %NULL
+ * @values: search terms, all of which must match
+ * @list: a #GsAppList to add results to
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Searches @silo for components matching all of @values. If @index is %NULL
+ * every component is queried in turn, which is only suitable for small silos.
+ *
+ * Returns: %TRUE for success
+ **/
 gboolean
 gs_appstream_search (GsPlugin *plugin,
 		     XbSilo *silo,
+		     GsAppstreamSearchIndex *index,
 		     const gchar * const *values,
 		     GsAppList *list,
 		     GCancellable *cancellable,
@@ -1124,6 +1659,15 @@ gs_appstream_search (GsPlugin *plugin,
 		{ AS_APP_SEARCH_MATCH_NONE,	NULL }
 	};
 
+	/* use the posting lists where available */
+	if (index != NULL) {
+		if (!gs_appstream_search_with_index (plugin, silo, index, values,
+						     list, cancellable, error))
+			return FALSE;
+		g_debug ("indexed search took %fms", g_timer_elapsed (timer, NULL) * 1000);
+		return TRUE;
+	}
+
 	/* add some weighted queries */
 	for (guint i = 0; queries[i].xpath != NULL; i++) {
 		g_autoptr(GError) error_query = NULL;
@@ -1152,17 +1696,9 @@ gs_appstream_search (GsPlugin *plugin,
 		XbNode *component = g_ptr_array_index (components, i);
 		guint16 match_value = gs_appstream_silo_search_component (array, component, values);
 		if (match_value != 0) {
-			g_autoptr(GsApp) app = gs_appstream_create_app (plugin, silo, component, error);
-			if (app == NULL)
+			if (!gs_appstream_search_add_component (plugin, silo, component,
+								match_value, list, error))
 				return FALSE;
-			if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD)) {
-				g_debug ("not returning wildcard %s",
-					 gs_app_get_unique_id (app));
-				continue;
-			}
-			g_debug ("add %s", gs_app_get_unique_id (app));
-			gs_app_set_match_value (app, match_value);
-			gs_app_list_add (list, app);
 		}
 	}
 	g_debug ("search took %fms", g_timer_elapsed (timer, NULL) * 1000);
@@ -1228,38 +1764,129 @@ gs_appstream_add_category_apps (GsPlugin *plugin,
 	return TRUE;
 }
 
-static guint
-gs_appstream_count_component_for_groups (GsPlugin *plugin, XbSilo *silo, const gchar *desktop_group)
+/* returns the "Sub" names of each "Main::Sub" desktop group, keyed by "Main" */
+static GHashTable *
+gs_appstream_get_desktop_subcategories (void)
 {
-	guint limit = 10;
-	g_autofree gchar *xpath = NULL;
-	g_auto(GStrv) split = g_strsplit (desktop_group, "::", -1);
-	g_autoptr(GPtrArray) array = NULL;
-	g_autoptr(GError) error_local = NULL;
+	static gsize initialized = 0;
+	static GHashTable *subs_by_main = NULL;
+
+	if (g_once_init_enter (&initialized)) {
+		const GsDesktopData *msdata = gs_desktop_get_data ();
+		subs_by_main = g_hash_table_new_full (g_str_hash, g_str_equal,
+						      g_free, (GDestroyNotify) g_hash_table_unref);
+		for (guint i = 0; msdata[i].id != NULL; i++) {
+			for (guint j = 0; msdata[i].mapping[j].id != NULL; j++) {
+				const GsDesktopMap *map = &msdata[i].mapping[j];
+				for (guint k = 0; map->fdo_cats[k] != NULL; k++) {
+					g_auto(GStrv) split = g_strsplit (map->fdo_cats[k], "::", -1);
+					GHashTable *subs;
+					if (g_strv_length (split) != 2)
+						continue;
+					subs = g_hash_table_lookup (subs_by_main, split[0]);
+					if (subs == NULL) {
+						subs = g_hash_table_new_full (g_str_hash, g_str_equal,
+									      g_free, NULL);
+						g_hash_table_insert (subs_by_main, g_strdup (split[0]), subs);
+					}
+					g_hash_table_add (subs, g_strdup (split[1]));
+				}
+			}
+		}
+		g_once_init_leave (&initialized, 1);
+	}
+	return subs_by_main;
+}
 
-	if (g_strv_length (split) == 1) { /* "all" group for a parent category */
-		xpath = g_strdup_printf ("components/component/categories/"
-					 "category[text()='%s']/../..",
-					 split[0]);
-	} else if (g_strv_length (split) == 2) {
-		xpath = g_strdup_printf ("components/component/categories/"
-					 "category[text()='%s']/../"
-					 "category[text()='%s']/../..",
-					 split[0], split[1]);
-	} else {
-		return 0;
+/* adds the categories of @component to @counts, once per desktop group */
+static void
+gs_appstream_count_component_categories (GHashTable *counts, XbNode *component)
+{
+	GHashTable *subs_by_main = gs_appstream_get_desktop_subcategories ();
+	g_autoptr(GPtrArray) categories = g_ptr_array_new ();
+	g_autoptr(XbNode) child = xb_node_get_child (component);
+
+	/* a component may have more than one categories element */
+	while (child != NULL) {
+		XbNode *next;
+		if (g_strcmp0 (xb_node_get_element (child), "categories") == 0) {
+			g_autoptr(XbNode) cat = xb_node_get_child (child);
+			while (cat != NULL) {
+				const gchar *tmp = xb_node_get_text (cat);
+				XbNode *cat_next;
+				if (tmp != NULL &&
+				    g_strcmp0 (xb_node_get_element (cat), "category") == 0 &&
+				    !g_ptr_array_find_with_equal_func (categories, tmp, g_str_equal, NULL))
+					g_ptr_array_add (categories, (gpointer) tmp);
+				cat_next = xb_node_get_next (cat);
+				g_object_unref (cat);
+				cat = cat_next;
+			}
+		}
+		next = xb_node_get_next (child);
+		g_object_unref (child);
+		child = next;
+	}
+
+	/* "Main" and the "Main::Sub" groups that gs-desktop-common.c uses */
+	for (guint i = 0; i < categories->len; i++) {
+		const gchar *cat1 = g_ptr_array_index (categories, i);
+		guint cnt = GPOINTER_TO_UINT (g_hash_table_lookup (counts, cat1));
+		GHashTable *subs = g_hash_table_lookup (subs_by_main, cat1);
+		g_hash_table_replace (counts, g_strdup (cat1), GUINT_TO_POINTER (cnt + 1));
+		if (subs == NULL)
+			continue;
+		for (guint j = 0; j < categories->len; j++) {
+			const gchar *cat2 = g_ptr_array_index (categories, j);
+			g_autofree gchar *key = NULL;
+			if (i == j || !g_hash_table_contains (subs, cat2))
+				continue;
+			key = g_strdup_printf ("%s::%s", cat1, cat2);
+			cnt = GPOINTER_TO_UINT (g_hash_table_lookup (counts, key));
+			g_hash_table_replace (counts, g_steal_pointer (&key), GUINT_TO_POINTER (cnt + 1));
+		}
 	}
+}
 
-	array = xb_silo_query (silo, xpath, limit, &error_local);
-	if (array == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return 0;
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
-			return 0;
-		g_warning ("%s", error_local->message);
-		return 0;
+/* returns the number of components in each desktop group, built in one pass
+ * and cached on the silo so it is rebuilt when the silo is */
+static GHashTable *
+gs_appstream_get_category_counts (XbSilo *silo)
+{
+	static GMutex mutex;
+	GHashTable *counts;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&mutex);
+	g_autoptr(GPtrArray) components = NULL;
+
+	counts = g_object_get_data (G_OBJECT (silo), "GsAppstream::category-counts");
+	if (counts != NULL)
+		return g_hash_table_ref (counts);
+
+	counts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	components = xb_silo_query (silo, "components/component", 0, NULL);
+	if (components != NULL) {
+		for (guint i = 0; i < components->len; i++)
+			gs_appstream_count_component_categories (counts, g_ptr_array_index (components, i));
+	}
+	g_object_set_data_full (G_OBJECT (silo), "GsAppstream::category-counts",
+				g_hash_table_ref (counts),
+				(GDestroyNotify) g_hash_table_unref);
+	return counts;
+}
+
+static guint
+gs_appstream_count_component_for_groups (GHashTable *counts, const gchar *desktop_group)
+{
+	g_auto(GStrv) split = g_strsplit (desktop_group, "::", -1);
+
+	if (g_strv_length (split) == 1) /* "all" group for a parent category */
+		return GPOINTER_TO_UINT (g_hash_table_lookup (counts, split[0]));
+	if (g_strv_length (split) == 2) {
+		if (g_strcmp0 (split[0], split[1]) == 0)
+			return GPOINTER_TO_UINT (g_hash_table_lookup (counts, split[0]));
+		return GPOINTER_TO_UINT (g_hash_table_lookup (counts, desktop_group));
 	}
-	return array->len;
+	return 0;
 }
 
 /* we're not actually adding categories here, we're just setting the number of
@@ -1271,6 +1898,8 @@ gs_appstream_add_categories (GsPlugin *plugin,
 			     GCancellable *cancellable,
 			     GError **error)
 {
+	g_autoptr(GHashTable) counts = gs_appstream_get_category_counts (silo);
+
 	for (guint j = 0; j < list->len; j++) {
 		GsCategory *parent = GS_CATEGORY (g_ptr_array_index (list, j));
 		GPtrArray *children = gs_category_get_children (parent);
@@ -1280,14 +1909,14 @@ gs_appstream_add_categories (GsPlugin *plugin,
 			GPtrArray *groups = gs_category_get_desktop_groups (cat);
 			for (guint k = 0; k < groups->len; k++) {
 				const gchar *group = g_ptr_array_index (groups, k);
-				guint cnt = gs_appstream_count_component_for_groups (plugin, silo, group);
-				for (guint l = 0; l < cnt; l++) {
-					gs_category_increment_size (parent);
-					if (children->len > 1) {
-						/* Parent category has multiple groups, so increment
-						 * each group's size too */
-						gs_category_increment_size (cat);
-					}
+				guint cnt = gs_appstream_count_component_for_groups (counts, group);
+				if (cnt == 0)
+					continue;
+				gs_category_set_size (parent, gs_category_get_size (parent) + cnt);
+				if (children->len > 1) {
+					/* Parent category has multiple groups, so increment
+					 * each group's size too */
+					gs_category_set_size (cat, gs_category_get_size (cat) + cnt);
 				}
 			}
 		}
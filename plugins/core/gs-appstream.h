@@ -13,6 +13,8 @@
 
 G_BEGIN_DECLS
 
+typedef struct _GsAppstreamSearchIndex GsAppstreamSearchIndex;
+
 GsApp		*gs_appstream_create_app		(GsPlugin	*plugin,
 							 XbSilo		*silo,
 							 XbNode		*component,
@@ -23,8 +25,14 @@ gboolean	 gs_appstream_refine_app		(GsPlugin	*plugin,
 							 XbNode		*component,
 							 GsPluginRefineFlags flags,
 							 GError		**error);
+GsAppstreamSearchIndex *gs_appstream_search_index_new	(XbSilo		*silo,
+							 GFile		*file,
+							 GCancellable	*cancellable,
+							 GError		**error);
+void		 gs_appstream_search_index_free		(GsAppstreamSearchIndex *index);
 gboolean	 gs_appstream_search			(GsPlugin	*plugin,
 							 XbSilo		*silo,
+							 GsAppstreamSearchIndex *index,
 							 const gchar * const *values,
 							 GsAppList	*list,
 							 GCancellable	*cancellable,
@@ -73,4 +81,6 @@ void		 gs_appstream_component_add_icon	(XbBuilderNode	*component,
 void		 gs_appstream_component_add_provide	(XbBuilderNode	*component,
 							 const gchar	*str);
 
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GsAppstreamSearchIndex, gs_appstream_search_index_free)
+
 G_END_DECLS
@@ -0,0 +1,215 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2016 Gautham Nair <gautham.nair.2005@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include "gs-key-colors.h"
+
+typedef struct {
+	guint32		 rgb;
+	guint		 cnt;
+} GsKeyColorsPixel;
+
+typedef struct {
+	guint32		 key;
+	guint		 pass;
+	guint		 idx;
+} GsKeyColorsSlot;
+
+typedef struct {
+	guint32		 key;
+	guint64		 red;
+	guint64		 green;
+	guint64		 blue;
+	guint		 cnt;
+} GsKeyColorsBin;
+
+static gint
+gs_key_colors_rgb_sort_cb (gconstpointer a, gconstpointer b)
+{
+	guint32 rgb1 = *((const guint32 *) a);
+	guint32 rgb2 = *((const guint32 *) b);
+	if (rgb1 < rgb2)
+		return -1;
+	if (rgb1 > rgb2)
+		return 1;
+	return 0;
+}
+
+static gint
+gs_key_colors_bin_sort_cb (gconstpointer a, gconstpointer b)
+{
+	const GsKeyColorsBin *s1 = a;
+	const GsKeyColorsBin *s2 = b;
+	if (s1->cnt < s2->cnt)
+		return 1;
+	if (s1->cnt > s2->cnt)
+		return -1;
+	if (s1->key < s2->key)
+		return -1;
+	if (s1->key > s2->key)
+		return 1;
+	return 0;
+}
+
+static inline guint32
+gs_key_colors_quantize (guint32 rgb, guint bin_size)
+{
+	return ((rgb & 0xff) / bin_size) |
+		(((rgb >> 8) & 0xff) / bin_size) << 8 |
+		(((rgb >> 16) & 0xff) / bin_size) << 16;
+}
+
+/* returns the slot for @key, claiming it for @pass if it was unused */
+static inline GsKeyColorsSlot *
+gs_key_colors_slot_lookup (GsKeyColorsSlot *slots, guint mask, guint32 key, guint pass)
+{
+	guint h = (key * 2654435761u) & mask;
+	while (slots[h].pass == pass && slots[h].key != key)
+		h = (h + 1) & mask;
+	return &slots[h];
+}
+
+/**
+ * gs_key_colors_for_pixbuf:
+ * @pb: a #GdkPixbuf with an alpha channel
+ * @number: the minimum number of colors to find
+ *
+ * Finds the most popular colors in @pb by binning each opaque pixel, using the
+ * coarsest even bin size that gives at least @number distinct bins.
+ *
+ * The pixbuf is only read once; the distinct colors are then binned for each
+ * bin size until enough bins are found, which gives the same result as
+ * repeatedly binning every pixel.
+ *
+ * Returns: (transfer container) (element-type GdkRGBA): colors, most popular first
+ **/
+GPtrArray *
+gs_key_colors_for_pixbuf (GdkPixbuf *pb, guint number)
+{
+	GPtrArray *colors = g_ptr_array_new_with_free_func (g_free);
+	gint rowstride, n_channels;
+	gint width, height;
+	guchar *pixels;
+	guint n_rgb = 0;
+	guint n_pixels = 0;
+	guint n_slots = 2;
+	guint bin_size;
+	guint pass = 0;
+	g_autofree guint32 *rgb = NULL;
+	g_autofree GsKeyColorsPixel *uniq = NULL;
+	g_autofree GsKeyColorsSlot *slots = NULL;
+	g_autofree GsKeyColorsBin *bins = NULL;
+
+	n_channels = gdk_pixbuf_get_n_channels (pb);
+	rowstride = gdk_pixbuf_get_rowstride (pb);
+	pixels = gdk_pixbuf_get_pixels (pb);
+	width = gdk_pixbuf_get_width (pb);
+	height = gdk_pixbuf_get_height (pb);
+
+	/* pack every opaque pixel, disregarding any with alpha */
+	rgb = g_new (guint32, (gsize) width * (gsize) height);
+	for (gint y = 0; y < height; y++) {
+		const guchar *row = pixels + y * rowstride;
+		for (gint x = 0; x < width; x++) {
+			const guchar *p = row + x * n_channels;
+			rgb[n_rgb] = (guint32) p[0] |
+				     (guint32) p[1] << 8 |
+				     (guint32) p[2] << 16;
+			n_rgb += n_channels < 4 || p[3] == 255;
+		}
+	}
+
+	/* collapse to distinct colors */
+	qsort (rgb, n_rgb, sizeof(guint32), gs_key_colors_rgb_sort_cb);
+	uniq = g_new (GsKeyColorsPixel, MAX (n_rgb, 1));
+	for (guint i = 0; i < n_rgb; i++) {
+		if (n_pixels > 0 && uniq[n_pixels - 1].rgb == rgb[i]) {
+			uniq[n_pixels - 1].cnt++;
+			continue;
+		}
+		uniq[n_pixels].rgb = rgb[i];
+		uniq[n_pixels].cnt = 1;
+		n_pixels++;
+	}
+
+	/* there can never be more bins than distinct colors */
+	if (n_pixels < number)
+		goto out;
+
+	while (n_slots < n_pixels * 2)
+		n_slots *= 2;
+	slots = g_new0 (GsKeyColorsSlot, n_slots);
+	bins = g_new (GsKeyColorsBin, n_pixels);
+
+	for (bin_size = 250; bin_size > 0; bin_size -= 2) {
+		guint number_of_bins = 0;
+
+		/* count the bins at this size */
+		pass++;
+		for (guint i = 0; i < n_pixels; i++) {
+			guint32 key = gs_key_colors_quantize (uniq[i].rgb, bin_size);
+			GsKeyColorsSlot *slot = gs_key_colors_slot_lookup (slots, n_slots - 1, key, pass);
+			if (slot->pass == pass)
+				continue;
+			slot->pass = pass;
+			slot->key = key;
+			number_of_bins++;
+		}
+		if (number_of_bins < number)
+			continue;
+
+		/* average the colors in each bin */
+		pass++;
+		number_of_bins = 0;
+		for (guint i = 0; i < n_pixels; i++) {
+			guint32 key = gs_key_colors_quantize (uniq[i].rgb, bin_size);
+			GsKeyColorsSlot *slot = gs_key_colors_slot_lookup (slots, n_slots - 1, key, pass);
+			GsKeyColorsBin *s;
+			if (slot->pass != pass) {
+				slot->pass = pass;
+				slot->key = key;
+				slot->idx = number_of_bins++;
+				s = &bins[slot->idx];
+				s->key = key;
+				s->red = s->green = s->blue = 0;
+				s->cnt = 0;
+			} else {
+				s = &bins[slot->idx];
+			}
+			s->red += (guint64) (uniq[i].rgb & 0xff) * uniq[i].cnt;
+			s->green += (guint64) ((uniq[i].rgb >> 8) & 0xff) * uniq[i].cnt;
+			s->blue += (guint64) ((uniq[i].rgb >> 16) & 0xff) * uniq[i].cnt;
+			s->cnt += uniq[i].cnt;
+		}
+
+		/* order by most popular */
+		qsort (bins, number_of_bins, sizeof(GsKeyColorsBin), gs_key_colors_bin_sort_cb);
+		for (guint i = 0; i < number_of_bins; i++) {
+			GdkRGBA *color = g_new0 (GdkRGBA, 1);
+			color->red = (gdouble) bins[i].red / (255.0 * bins[i].cnt);
+			color->green = (gdouble) bins[i].green / (255.0 * bins[i].cnt);
+			color->blue = (gdouble) bins[i].blue / (255.0 * bins[i].cnt);
+			g_ptr_array_add (colors, color);
+		}
+		return colors;
+	}
+out:
+	/* the algorithm failed, so just return a monochrome ramp */
+	for (guint i = 0; i < 3; i++) {
+		GdkRGBA *color = g_new0 (GdkRGBA, 1);
+		color->red = (gdouble) i / 3.f;
+		color->green = color->red;
+		color->blue = color->red;
+		color->alpha = 1.0f;
+		g_ptr_array_add (colors, color);
+	}
+	return colors;
+}
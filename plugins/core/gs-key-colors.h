@@ -0,0 +1,18 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2016 Gautham Nair <gautham.nair.2005@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <unity-software.h>
+
+G_BEGIN_DECLS
+
+GPtrArray	*gs_key_colors_for_pixbuf		(GdkPixbuf	*pb,
+							 guint		 number);
+
+G_END_DECLS
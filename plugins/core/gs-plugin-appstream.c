@@ -26,8 +26,162 @@
  * Refines:     | [source]->[name,summary,pixbuf,id,kind]
  */
 
+/* a component with the details needed to choose between matches */
+typedef struct {
+	XbNode		*component;
+	const gchar	*kind;
+	gboolean	 has_pkgname;
+} GsPluginAppstreamIndexEntry;
+
+/* lookup tables built once per silo, the strings are owned by the silo */
+typedef struct {
+	GHashTable	*appstream_by_id;	/* id : GPtrArray of entries */
+	GHashTable	*appstream_by_pkgname;	/* pkgname : GPtrArray of entries */
+	GHashTable	*appstream_by_launchable; /* desktop-id : GPtrArray of entries */
+	GHashTable	*appdata_by_id;		/* id : GPtrArray of entries */
+	GPtrArray	*entries;
+} GsPluginAppstreamIndex;
+
+static void
+gs_plugin_appstream_index_entry_free (GsPluginAppstreamIndexEntry *entry)
+{
+	g_object_unref (entry->component);
+	g_free (entry);
+}
+
+static void
+gs_plugin_appstream_index_free (GsPluginAppstreamIndex *index)
+{
+	g_hash_table_unref (index->appstream_by_id);
+	g_hash_table_unref (index->appstream_by_pkgname);
+	g_hash_table_unref (index->appstream_by_launchable);
+	g_hash_table_unref (index->appdata_by_id);
+	g_ptr_array_unref (index->entries);
+	g_free (index);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GsPluginAppstreamIndex, gs_plugin_appstream_index_free)
+
+static void
+gs_plugin_appstream_index_insert (GHashTable *hash,
+				  const gchar *key,
+				  GsPluginAppstreamIndexEntry *entry)
+{
+	GPtrArray *bucket;
+
+	if (key == NULL)
+		return;
+	bucket = g_hash_table_lookup (hash, key);
+	if (bucket == NULL) {
+		bucket = g_ptr_array_new ();
+		g_hash_table_insert (hash, (gpointer) key, bucket);
+	}
+
+	/* a component may list the same package or launchable twice */
+	if (bucket->len > 0 && g_ptr_array_index (bucket, bucket->len - 1) == entry)
+		return;
+	g_ptr_array_add (bucket, entry);
+}
+
+static void
+gs_plugin_appstream_index_add (GsPluginAppstreamIndex *index,
+			       XbNode *component,
+			       gboolean is_appstream)
+{
+	GsPluginAppstreamIndexEntry *entry;
+	const gchar *id = NULL;
+	g_autoptr(GPtrArray) pkgnames = g_ptr_array_new ();
+	g_autoptr(GPtrArray) launchables = g_ptr_array_new ();
+	g_autoptr(XbNode) child = NULL;
+
+	/* walk the children directly rather than running a query for each */
+	child = xb_node_get_child (component);
+	while (child != NULL) {
+		const gchar *element = xb_node_get_element (child);
+		XbNode *next;
+		if (g_strcmp0 (element, "id") == 0) {
+			if (id == NULL)
+				id = xb_node_get_text (child);
+		} else if (g_strcmp0 (element, "pkgname") == 0) {
+			if (xb_node_get_text (child) != NULL)
+				g_ptr_array_add (pkgnames, (gpointer) xb_node_get_text (child));
+		} else if (g_strcmp0 (element, "launchable") == 0) {
+			if (g_strcmp0 (xb_node_get_attr (child, "type"), "desktop-id") == 0 &&
+			    xb_node_get_text (child) != NULL)
+				g_ptr_array_add (launchables, (gpointer) xb_node_get_text (child));
+		}
+		next = xb_node_get_next (child);
+		g_object_unref (child);
+		child = next;
+	}
+
+	entry = g_new0 (GsPluginAppstreamIndexEntry, 1);
+	entry->component = g_object_ref (component);
+	entry->kind = xb_node_get_attr (component, "type");
+	entry->has_pkgname = pkgnames->len > 0;
+	g_ptr_array_add (index->entries, entry);
+
+	if (!is_appstream) {
+		gs_plugin_appstream_index_insert (index->appdata_by_id, id, entry);
+		return;
+	}
+	gs_plugin_appstream_index_insert (index->appstream_by_id, id, entry);
+	for (guint i = 0; i < pkgnames->len; i++) {
+		gs_plugin_appstream_index_insert (index->appstream_by_pkgname,
+						  g_ptr_array_index (pkgnames, i),
+						  entry);
+	}
+	for (guint i = 0; i < launchables->len; i++) {
+		gs_plugin_appstream_index_insert (index->appstream_by_launchable,
+						  g_ptr_array_index (launchables, i),
+						  entry);
+	}
+}
+
+static GsPluginAppstreamIndex *
+gs_plugin_appstream_index_new (XbSilo *silo)
+{
+	g_autoptr(GsPluginAppstreamIndex) index = g_new0 (GsPluginAppstreamIndex, 1);
+	g_autoptr(GPtrArray) appstream = NULL;
+	g_autoptr(GPtrArray) appdata = NULL;
+
+	index->appstream_by_id = g_hash_table_new_full (g_str_hash, g_str_equal,
+							NULL, (GDestroyNotify) g_ptr_array_unref);
+	index->appstream_by_pkgname = g_hash_table_new_full (g_str_hash, g_str_equal,
+							     NULL, (GDestroyNotify) g_ptr_array_unref);
+	index->appstream_by_launchable = g_hash_table_new_full (g_str_hash, g_str_equal,
+								NULL, (GDestroyNotify) g_ptr_array_unref);
+	index->appdata_by_id = g_hash_table_new_full (g_str_hash, g_str_equal,
+						      NULL, (GDestroyNotify) g_ptr_array_unref);
+	index->entries = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_plugin_appstream_index_entry_free);
+
+	/* AppStream metadata, then installed AppData and desktop files */
+	appstream = xb_silo_query (silo, "components/component", 0, NULL);
+	if (appstream != NULL) {
+		for (guint i = 0; i < appstream->len; i++)
+			gs_plugin_appstream_index_add (index, g_ptr_array_index (appstream, i), TRUE);
+	}
+	appdata = xb_silo_query (silo, "component", 0, NULL);
+	if (appdata != NULL) {
+		for (guint i = 0; i < appdata->len; i++)
+			gs_plugin_appstream_index_add (index, g_ptr_array_index (appdata, i), FALSE);
+	}
+	g_debug ("indexed %u components", index->entries->len);
+	return g_steal_pointer (&index);
+}
+
+static GPtrArray *
+gs_plugin_appstream_index_lookup (GHashTable *hash, const gchar *key)
+{
+	if (key == NULL)
+		return NULL;
+	return g_hash_table_lookup (hash, key);
+}
+
 struct GsPluginData {
 	XbSilo			*silo;
+	GsPluginAppstreamIndex	*index;
+	GsAppstreamSearchIndex	*search_index;
 	GRWLock			 silo_lock;
 	GSettings		*settings;
 };
@@ -44,6 +198,9 @@ gs_plugin_initialize (GsPlugin *plugin)
 	/* need package name */
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_RUN_AFTER, "dpkg");
 
+	/* results only come from the silo */
+	gs_plugin_add_flags (plugin, GS_PLUGIN_FLAGS_PARALLEL_RESULTS);
+
 	/* require settings */
 	priv->settings = g_settings_new ("org.ubuntuunity.software");
 }
@@ -52,7 +209,9 @@ void
 gs_plugin_destroy (GsPlugin *plugin)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
-	g_object_unref (priv->silo);
+	g_clear_pointer (&priv->index, gs_plugin_appstream_index_free);
+	g_clear_pointer (&priv->search_index, gs_appstream_search_index_free);
+	g_clear_object (&priv->silo);
 	g_object_unref (priv->settings);
 	g_rw_lock_clear (&priv->silo_lock);
 }
@@ -440,9 +599,12 @@ gs_plugin_appstream_check_silo (GsPlugin *plugin,
 	const gchar *locale;
 	const gchar *test_xml;
 	g_autofree gchar *blobfn = NULL;
+	g_autofree gchar *indexfn = NULL;
 	g_autoptr(XbBuilder) builder = xb_builder_new ();
 	g_autoptr(XbNode) n = NULL;
 	g_autoptr(GFile) file = NULL;
+	g_autoptr(GError) error_index = NULL;
+	g_autoptr(GFile) file_index = NULL;
 	g_autoptr(GRWLockReaderLocker) reader_locker = NULL;
 	g_autoptr(GRWLockWriterLocker) writer_locker = NULL;
 	g_autoptr(GPtrArray) parent_appdata = g_ptr_array_new_with_free_func (g_free);
@@ -457,6 +619,8 @@ gs_plugin_appstream_check_silo (GsPlugin *plugin,
 
 	/* drat! silo needs regenerating */
 	writer_locker = g_rw_lock_writer_locker_new (&priv->silo_lock);
+	g_clear_pointer (&priv->index, gs_plugin_appstream_index_free);
+	g_clear_pointer (&priv->search_index, gs_appstream_search_index_free);
 	g_clear_object (&priv->silo);
 
 	/* verbose profiling */
@@ -608,6 +772,13 @@ gs_plugin_appstream_check_silo (GsPlugin *plugin,
 	if (priv->silo == NULL)
 		return FALSE;
 
+	/* apps refined from the old silo need refining again */
+	gs_plugin_refine_data_changed (plugin);
+
+	/* index the components so refine does not need to run a query
+	 * for each app */
+	priv->index = gs_plugin_appstream_index_new (priv->silo);
+
 	/* watch all directories too */
 	for (guint i = 0; i < parent_appstream->len; i++) {
 		const gchar *fn = g_ptr_array_index (parent_appstream, i);
@@ -633,6 +804,30 @@ gs_plugin_appstream_check_silo (GsPlugin *plugin,
 		return FALSE;
 	}
 
+	/* build the search index, or load it if the silo is unchanged */
+	indexfn = gs_utils_get_cache_filename ("appstream", "components.idx",
+					       GS_UTILS_CACHE_FLAG_WRITEABLE,
+					       error);
+	if (indexfn == NULL)
+		return FALSE;
+	file_index = g_file_new_for_path (indexfn);
+	priv->search_index = gs_appstream_search_index_new (priv->silo,
+							    file_index,
+							    cancellable,
+							    &error_index);
+	if (priv->search_index == NULL) {
+		if (g_error_matches (error_index, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+			g_debug ("not using search index: %s", error_index->message);
+			return TRUE;
+		}
+
+		/* drop the silo so the next call tries again */
+		g_clear_pointer (&priv->index, gs_plugin_appstream_index_free);
+		g_clear_object (&priv->silo);
+		g_propagate_error (error, g_steal_pointer (&error_index));
+		return FALSE;
+	}
+
 	/* success */
 	return TRUE;
 }
@@ -652,12 +847,12 @@ gs_plugin_url_to_app (GsPlugin *plugin,
 		      GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GPtrArray *entries;
+	GsPluginAppstreamIndexEntry *entry;
 	g_autofree gchar *path = NULL;
 	g_autofree gchar *scheme = NULL;
-	g_autofree gchar *xpath = NULL;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
 	g_autoptr(GsApp) app = NULL;
-	g_autoptr(XbNode) component = NULL;
 
 	/* check silo is valid */
 	if (!gs_plugin_appstream_check_silo (plugin, cancellable, error))
@@ -672,11 +867,17 @@ gs_plugin_url_to_app (GsPlugin *plugin,
 
 	/* create app */
 	path = gs_utils_get_url_path (url);
-	xpath = g_strdup_printf ("components/component/id[text()='%s']", path);
-	component = xb_silo_query_first (priv->silo, xpath, NULL);
-	if (component == NULL)
+	entries = gs_plugin_appstream_index_lookup (priv->index->appstream_by_id, path);
+
+	/* the desktop file name is also accepted */
+	if (entries == NULL) {
+		entries = gs_plugin_appstream_index_lookup (priv->index->appstream_by_launchable,
+							    path);
+	}
+	if (entries == NULL)
 		return TRUE;
-	app = gs_appstream_create_app (plugin, priv->silo, component, error);
+	entry = g_ptr_array_index (entries, 0);
+	app = gs_appstream_create_app (plugin, priv->silo, entry->component, error);
 	if (app == NULL)
 		return FALSE;
 	gs_app_set_scope (app, AS_APP_SCOPE_SYSTEM);
@@ -733,23 +934,13 @@ static gboolean
 gs_plugin_appstream_refine_state (GsPlugin *plugin, GsApp *app, GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
-	g_autofree gchar *xpath = NULL;
-	g_autoptr(GError) error_local = NULL;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
-	g_autoptr(XbNode) component = NULL;
 
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
 
-	xpath = g_strdup_printf ("component/id[text()='%s']", gs_app_get_id (app));
-	component = xb_silo_query_first (priv->silo, xpath, &error_local);
-	if (component == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
-	}
+	if (gs_plugin_appstream_index_lookup (priv->index->appdata_by_id,
+					      gs_app_get_id (app)) == NULL)
+		return TRUE;
 	gs_app_set_state (app, AS_APP_STATE_INSTALLED);
 	return TRUE;
 }
@@ -762,11 +953,10 @@ gs_plugin_refine_from_id (GsPlugin *plugin,
 			  GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GPtrArray *entries;
 	const gchar *id;
-	g_autoptr(GError) error_local = NULL;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
-	g_autoptr(GString) xpath = g_string_new (NULL);
-	g_autoptr(GPtrArray) components = NULL;
+	g_autoptr(GPtrArray) components = g_ptr_array_new ();
 
 	/* not enough info to find */
 	id = gs_app_get_id (app);
@@ -775,19 +965,29 @@ gs_plugin_refine_from_id (GsPlugin *plugin,
 
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
 
-	/* look in AppStream then fall back to AppData */
-	xb_string_append_union (xpath, "components/component/id[text()='%s']/../pkgname/..", id);
-	xb_string_append_union (xpath, "components/component[@type='webapp']/id[text()='%s']/..", id);
-	xb_string_append_union (xpath, "component/id[text()='%s']/..", id);
-	components = xb_silo_query (priv->silo, xpath->str, 0, &error_local);
-	if (components == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
+	/* look in AppStream for packages and webapps then fall back to AppData */
+	entries = gs_plugin_appstream_index_lookup (priv->index->appstream_by_id, id);
+	if (entries != NULL) {
+		for (guint i = 0; i < entries->len; i++) {
+			GsPluginAppstreamIndexEntry *entry = g_ptr_array_index (entries, i);
+			if (entry->has_pkgname)
+				g_ptr_array_add (components, entry->component);
+		}
+		for (guint i = 0; i < entries->len; i++) {
+			GsPluginAppstreamIndexEntry *entry = g_ptr_array_index (entries, i);
+			if (!entry->has_pkgname && g_strcmp0 (entry->kind, "webapp") == 0)
+				g_ptr_array_add (components, entry->component);
+		}
+	}
+	entries = gs_plugin_appstream_index_lookup (priv->index->appdata_by_id, id);
+	if (entries != NULL) {
+		for (guint i = 0; i < entries->len; i++) {
+			GsPluginAppstreamIndexEntry *entry = g_ptr_array_index (entries, i);
+			g_ptr_array_add (components, entry->component);
+		}
 	}
+	if (components->len == 0)
+		return TRUE;
 	for (guint i = 0; i < components->len; i++) {
 		XbNode *component = g_ptr_array_index (components, i);
 		if (!gs_appstream_refine_app (plugin, app, priv->silo,
@@ -807,6 +1007,30 @@ gs_plugin_refine_from_id (GsPlugin *plugin,
 	return TRUE;
 }
 
+static XbNode *
+gs_plugin_appstream_find_by_pkgname (GsPlugin *plugin, const gchar *pkgname)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GPtrArray *entries;
+	GsPluginAppstreamIndexEntry *entry;
+	const gchar *kinds[] = { "desktop", "console", "webapp", NULL };
+
+	entries = gs_plugin_appstream_index_lookup (priv->index->appstream_by_pkgname, pkgname);
+	if (entries == NULL)
+		return NULL;
+
+	/* prefer actual apps and then fallback to anything else */
+	for (guint j = 0; kinds[j] != NULL; j++) {
+		for (guint i = 0; i < entries->len; i++) {
+			entry = g_ptr_array_index (entries, i);
+			if (g_strcmp0 (entry->kind, kinds[j]) == 0)
+				return entry->component;
+		}
+	}
+	entry = g_ptr_array_index (entries, 0);
+	return entry->component;
+}
+
 static gboolean
 gs_plugin_refine_from_pkgname (GsPlugin *plugin,
 			       GsApp *app,
@@ -815,7 +1039,6 @@ gs_plugin_refine_from_pkgname (GsPlugin *plugin,
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	GPtrArray *sources = gs_app_get_sources (app);
-	g_autoptr(GError) error_local = NULL;
 
 	/* not enough info to find */
 	if (sources->len == 0)
@@ -825,25 +1048,12 @@ gs_plugin_refine_from_pkgname (GsPlugin *plugin,
 	for (guint j = 0; j < sources->len; j++) {
 		const gchar *pkgname = g_ptr_array_index (sources, j);
 		g_autoptr(GRWLockReaderLocker) locker = NULL;
-		g_autoptr(GString) xpath = g_string_new (NULL);
-		g_autoptr(XbNode) component = NULL;
+		XbNode *component;
 
 		locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
-
-		/* prefer actual apps and then fallback to anything else */
-		xb_string_append_union (xpath, "components/component[@type='desktop']/pkgname[text()='%s']/..", pkgname);
-		xb_string_append_union (xpath, "components/component[@type='console']/pkgname[text()='%s']/..", pkgname);
-		xb_string_append_union (xpath, "components/component[@type='webapp']/pkgname[text()='%s']/..", pkgname);
-		xb_string_append_union (xpath, "components/component/pkgname[text()='%s']/..", pkgname);
-		component = xb_silo_query_first (priv->silo, xpath->str, &error_local);
-		if (component == NULL) {
-			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-				continue;
-			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
-				continue;
-			g_propagate_error (error, g_steal_pointer (&error_local));
-			return FALSE;
-		}
+		component = gs_plugin_appstream_find_by_pkgname (plugin, pkgname);
+		if (component == NULL)
+			continue;
 		if (!gs_appstream_refine_app (plugin, app, priv->silo, component, flags, error))
 			return FALSE;
 		gs_plugin_appstream_set_compulsory_quirk (app, component);
@@ -896,11 +1106,9 @@ gs_plugin_refine_wildcard (GsPlugin *plugin,
 			   GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GPtrArray *entries;
 	const gchar *id;
-	g_autofree gchar *xpath = NULL;
-	g_autoptr(GError) error_local = NULL;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
-	g_autoptr(GPtrArray) components = NULL;
 
 	/* check silo is valid */
 	if (!gs_plugin_appstream_check_silo (plugin, cancellable, error))
@@ -914,20 +1122,17 @@ gs_plugin_refine_wildcard (GsPlugin *plugin,
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
 
 	/* find all app with package names when matching any prefixes */
-	xpath = g_strdup_printf ("components/component/id[text()='%s']/../pkgname/..", id);
-	components = xb_silo_query (priv->silo, xpath, 0, &error_local);
-	if (components == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
-	}
-	for (guint i = 0; i < components->len; i++) {
-		XbNode *component = g_ptr_array_index (components, i);
+	entries = gs_plugin_appstream_index_lookup (priv->index->appstream_by_id, id);
+	if (entries == NULL)
+		return TRUE;
+	for (guint i = 0; i < entries->len; i++) {
+		GsPluginAppstreamIndexEntry *entry = g_ptr_array_index (entries, i);
+		XbNode *component = entry->component;
 		g_autoptr(GsApp) new = NULL;
 
+		if (!entry->has_pkgname)
+			continue;
+
 		/* new app */
 		new = gs_appstream_create_app (plugin, priv->silo, component, error);
 		if (new == NULL)
@@ -982,6 +1187,7 @@ gs_plugin_add_search (GsPlugin *plugin,
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
 	return gs_appstream_search (plugin,
 				    priv->silo,
+				    priv->search_index,
 				    (const gchar * const *) values,
 				    list,
 				    cancellable,
@@ -10,6 +10,7 @@
 #include <config.h>
 
 #include <string.h>
+#include <glib/gstdio.h>
 
 #include <unity-software.h>
 
@@ -25,8 +26,31 @@ struct GsPluginData {
 	GtkIconTheme		*icon_theme;
 	GMutex			 icon_theme_lock;
 	GHashTable		*icon_theme_paths;
+	GMutex			 pixbuf_cache_lock;
+	GHashTable		*pixbuf_cache;		/* key : GList link in pixbuf_cache_lru */
+	GQueue			 pixbuf_cache_lru;	/* of GsPluginIconsCacheItem, newest first */
+	gsize			 pixbuf_cache_size;
 };
 
+/* the same few hundred apps get refined over and over when scrolling and
+ * searching, so keep the decoded icons around; at 64x64 this is enough for
+ * about a thousand of them */
+#define GS_PLUGIN_ICONS_CACHE_SIZE_MAX	(16 * 1024 * 1024)
+
+typedef struct {
+	gchar		*key;
+	GdkPixbuf	*pixbuf;
+	gint64		 mtime;		/* of the source file, or 0 if unknown */
+} GsPluginIconsCacheItem;
+
+static void
+gs_plugin_icons_cache_item_free (GsPluginIconsCacheItem *item)
+{
+	g_free (item->key);
+	g_object_unref (item->pixbuf);
+	g_slice_free (GsPluginIconsCacheItem, item);
+}
+
 static void gs_plugin_icons_add_theme_path (GsPlugin *plugin, const gchar *path);
 
 void
@@ -39,6 +63,9 @@ gs_plugin_initialize (GsPlugin *plugin)
 	gtk_icon_theme_set_screen (priv->icon_theme, gdk_screen_get_default ());
 	priv->icon_theme_paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	g_mutex_init (&priv->icon_theme_lock);
+	priv->pixbuf_cache = g_hash_table_new (g_str_hash, g_str_equal);
+	g_queue_init (&priv->pixbuf_cache_lru);
+	g_mutex_init (&priv->pixbuf_cache_lock);
 
 	test_search_path = g_getenv ("GS_SELF_TEST_ICON_THEME_PATH");
 	if (test_search_path != NULL) {
@@ -61,6 +88,75 @@ gs_plugin_destroy (GsPlugin *plugin)
 	g_object_unref (priv->icon_theme);
 	g_hash_table_unref (priv->icon_theme_paths);
 	g_mutex_clear (&priv->icon_theme_lock);
+	g_hash_table_unref (priv->pixbuf_cache);
+	g_queue_foreach (&priv->pixbuf_cache_lru, (GFunc) gs_plugin_icons_cache_item_free, NULL);
+	g_queue_clear (&priv->pixbuf_cache_lru);
+	g_mutex_clear (&priv->pixbuf_cache_lock);
+}
+
+/* must hold pixbuf_cache_lock */
+static void
+gs_plugin_icons_cache_remove_link (GsPlugin *plugin, GList *link)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GsPluginIconsCacheItem *item = link->data;
+
+	g_hash_table_remove (priv->pixbuf_cache, item->key);
+	g_queue_delete_link (&priv->pixbuf_cache_lru, link);
+	priv->pixbuf_cache_size -= gdk_pixbuf_get_byte_length (item->pixbuf);
+	gs_plugin_icons_cache_item_free (item);
+}
+
+static GdkPixbuf *
+gs_plugin_icons_cache_lookup (GsPlugin *plugin, const gchar *key, gint64 mtime)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GsPluginIconsCacheItem *item;
+	GList *link;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->pixbuf_cache_lock);
+
+	link = g_hash_table_lookup (priv->pixbuf_cache, key);
+	if (link == NULL)
+		return NULL;
+
+	/* the file has been replaced since */
+	item = link->data;
+	if (item->mtime != mtime) {
+		gs_plugin_icons_cache_remove_link (plugin, link);
+		return NULL;
+	}
+	g_queue_unlink (&priv->pixbuf_cache_lru, link);
+	g_queue_push_head_link (&priv->pixbuf_cache_lru, link);
+	return g_object_ref (item->pixbuf);
+}
+
+static void
+gs_plugin_icons_cache_add (GsPlugin *plugin,
+			   const gchar *key,
+			   gint64 mtime,
+			   GdkPixbuf *pixbuf)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GsPluginIconsCacheItem *item;
+	GList *link;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->pixbuf_cache_lock);
+
+	/* another thread may have got here first */
+	link = g_hash_table_lookup (priv->pixbuf_cache, key);
+	if (link != NULL)
+		gs_plugin_icons_cache_remove_link (plugin, link);
+
+	item = g_slice_new0 (GsPluginIconsCacheItem);
+	item->key = g_strdup (key);
+	item->pixbuf = g_object_ref (pixbuf);
+	item->mtime = mtime;
+	g_queue_push_head (&priv->pixbuf_cache_lru, item);
+	g_hash_table_insert (priv->pixbuf_cache, item->key, priv->pixbuf_cache_lru.head);
+	priv->pixbuf_cache_size += gdk_pixbuf_get_byte_length (pixbuf);
+
+	while (priv->pixbuf_cache_size > GS_PLUGIN_ICONS_CACHE_SIZE_MAX &&
+	       priv->pixbuf_cache_lru.tail != NULL)
+		gs_plugin_icons_cache_remove_link (plugin, priv->pixbuf_cache_lru.tail);
 }
 
 static gboolean
@@ -125,8 +221,12 @@ static GdkPixbuf *
 gs_plugin_icons_load_local (GsPlugin *plugin, AsIcon *icon, GError **error)
 {
 	GdkPixbuf *pixbuf;
+	GStatBuf stat_buf;
+	const gchar *filename = as_icon_get_filename (icon);
 	gint size;
-	if (as_icon_get_filename (icon) == NULL) {
+	g_autofree gchar *key = NULL;
+
+	if (filename == NULL) {
 		g_set_error_literal (error,
 				     GS_PLUGIN_ERROR,
 				     GS_PLUGIN_ERROR_NOT_SUPPORTED,
@@ -134,12 +234,22 @@ gs_plugin_icons_load_local (GsPlugin *plugin, AsIcon *icon, GError **error)
 		return NULL;
 	}
 	size = (gint) (64 * gs_plugin_get_scale (plugin));
-	pixbuf = gdk_pixbuf_new_from_file_at_size (as_icon_get_filename (icon),
-						   size, size, error);
+
+	/* decoded already */
+	key = g_strdup_printf ("%s@%i", filename, size);
+	if (g_stat (filename, &stat_buf) == 0) {
+		pixbuf = gs_plugin_icons_cache_lookup (plugin, key, stat_buf.st_mtime);
+		if (pixbuf != NULL)
+			return pixbuf;
+	}
+
+	pixbuf = gdk_pixbuf_new_from_file_at_size (filename, size, size, error);
 	if (pixbuf == NULL) {
 		gs_utils_error_convert_gdk_pixbuf (error);
 		return NULL;
 	}
+	if (g_stat (filename, &stat_buf) == 0)
+		gs_plugin_icons_cache_add (plugin, key, stat_buf.st_mtime, pixbuf);
 	return pixbuf;
 }
 
@@ -255,14 +365,54 @@ gs_plugin_icons_load_stock (GsPlugin *plugin, AsIcon *icon, GError **error)
 	return pixbuf;
 }
 
+/* look for the file in the same sizes as as_icon_load() */
+static gchar *
+gs_plugin_icons_find_cached_fn (AsIcon *icon)
+{
+	const guint sizes[] = { as_icon_get_width (icon), 64, 128 };
+
+	if (as_icon_get_prefix (icon) == NULL || as_icon_get_name (icon) == NULL)
+		return NULL;
+	for (guint i = 0; i < G_N_ELEMENTS (sizes); i++) {
+		g_autofree gchar *size_str = g_strdup_printf ("%ux%u", sizes[i], sizes[i]);
+		g_autofree gchar *fn = g_build_filename (as_icon_get_prefix (icon),
+							 size_str,
+							 as_icon_get_name (icon),
+							 NULL);
+		if (g_file_test (fn, G_FILE_TEST_EXISTS))
+			return g_steal_pointer (&fn);
+	}
+	return NULL;
+}
+
 static GdkPixbuf *
 gs_plugin_icons_load_cached (GsPlugin *plugin, AsIcon *icon, GError **error)
 {
+	GdkPixbuf *pixbuf;
+	GStatBuf stat_buf;
+	g_autofree gchar *fn = gs_plugin_icons_find_cached_fn (icon);
+	g_autofree gchar *key = NULL;
+
+	/* the metadata can be refreshed without the icon name changing */
+	key = g_strdup_printf ("%s/%s@%ux%u@%u",
+			       as_icon_get_prefix (icon),
+			       as_icon_get_name (icon),
+			       as_icon_get_width (icon),
+			       as_icon_get_height (icon),
+			       gs_plugin_get_scale (plugin));
+	if (fn != NULL && g_stat (fn, &stat_buf) == 0) {
+		pixbuf = gs_plugin_icons_cache_lookup (plugin, key, stat_buf.st_mtime);
+		if (pixbuf != NULL)
+			return pixbuf;
+	}
+
 	if (!as_icon_load (icon, AS_ICON_LOAD_FLAG_SEARCH_SIZE, error)) {
 		gs_utils_error_convert_gdk_pixbuf (error);
 		gs_utils_error_convert_appstream (error);
 		return NULL;
 	}
+	if (fn != NULL && g_stat (fn, &stat_buf) == 0)
+		gs_plugin_icons_cache_add (plugin, key, stat_buf.st_mtime, as_icon_get_pixbuf (icon));
 	return g_object_ref (as_icon_get_pixbuf (icon));
 }
 
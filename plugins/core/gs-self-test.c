@@ -9,10 +9,12 @@
 #include "config.h"
 
 #include <glib/gstdio.h>
+#include <math.h>
 
 #include "unity-software-private.h"
 
 #include "gs-appstream.h"
+#include "gs-key-colors.h"
 #include "gs-test.h"
 
 static void
@@ -49,6 +51,189 @@ gs_plugins_core_search_repo_name_func (GsPluginLoader *plugin_loader)
 	g_assert_cmpint (gs_app_get_kind (app), ==, AS_APP_KIND_DESKTOP);
 }
 
+static void
+gs_plugins_core_appstream_refine_func (GsPluginLoader *plugin_loader)
+{
+	GsApp *app_tmp;
+	gboolean ret;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsApp) app_id = gs_app_new ("arachne.desktop");
+	g_autoptr(GsApp) app_pkgname = gs_app_new (NULL);
+	g_autoptr(GsApp) app_unknown = gs_app_new ("unknown.desktop");
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsAppList) list_url = NULL;
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+
+	/* refine by ID, by package name, and something not in the silo */
+	gs_app_add_source (app_pkgname, "arachne");
+	gs_app_list_add (list, app_id);
+	gs_app_list_add (list, app_pkgname);
+	gs_app_list_add (list, app_unknown);
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
+					 "list", list,
+					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_DEFAULT,
+					 NULL);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpstr (gs_app_get_summary (app_id), ==, "Test");
+	g_assert_cmpstr (gs_app_get_id (app_pkgname), ==, "arachne.desktop");
+	g_assert_cmpstr (gs_app_get_summary (app_pkgname), ==, "Test");
+	g_assert_cmpstr (gs_app_get_summary (app_unknown), ==, NULL);
+
+	/* look up a URL */
+	g_clear_object (&plugin_job);
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_URL_TO_APP,
+					 "search", "appstream://arachne.desktop",
+					 NULL);
+	list_url = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert (list_url != NULL);
+	g_assert_cmpint (gs_app_list_length (list_url), ==, 1);
+	app_tmp = gs_app_list_index (list_url, 0);
+	g_assert_cmpstr (gs_app_get_id (app_tmp), ==, "arachne.desktop");
+}
+
+static GsCategory *
+gs_plugins_core_category_counts_new_parent (void)
+{
+	GsCategory *parent = gs_category_new ("graphics");
+	g_autoptr(GsCategory) all = gs_category_new ("all");
+	g_autoptr(GsCategory) viewers = gs_category_new ("viewers");
+
+	gs_category_add_desktop_group (all, "Graphics");
+	gs_category_add_desktop_group (viewers, "Graphics::Viewer");
+	gs_category_add_child (parent, all);
+	gs_category_add_child (parent, viewers);
+	return parent;
+}
+
+static void
+gs_plugins_core_category_counts_func (void)
+{
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GString) xml = g_string_new (NULL);
+	g_autoptr(GsPlugin) plugin = gs_plugin_new ();
+	g_autoptr(XbBuilder) builder = xb_builder_new ();
+	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
+	g_autoptr(XbSilo) silo = NULL;
+	GHashTable *counts;
+
+	/* more components than the old per-group query limit */
+	g_string_append (xml, "<?xml version=\"1.0\"?>\n<components version=\"0.9\">\n");
+	for (guint i = 0; i < 25; i++) {
+		g_string_append_printf (xml,
+					"<component type=\"desktop\">"
+					"<id>viewer%u.desktop</id>"
+					"<categories><category>Graphics</category>%s</categories>"
+					"</component>\n",
+					i, i % 2 == 0 ? "<category>Viewer</category>" : "");
+	}
+	g_string_append (xml,
+			 "<component type=\"desktop\">"
+			 "<id>twice.desktop</id>"
+			 "<categories><category>Graphics</category>"
+			 "<category>Graphics</category></categories>"
+			 "</component>\n"
+			 "<component type=\"desktop\">"
+			 "<id>viewer.desktop</id>"
+			 "<categories><category>Viewer</category></categories>"
+			 "</component>\n"
+			 "</components>\n");
+	g_assert_true (xb_builder_source_load_xml (source, xml->str,
+						   XB_BUILDER_SOURCE_FLAG_NONE,
+						   &error));
+	g_assert_no_error (error);
+	xb_builder_import_source (builder, source);
+	silo = xb_builder_compile (builder, XB_BUILDER_COMPILE_FLAG_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (silo);
+	gs_plugin_set_name (plugin, "appstream");
+
+	/* the second run is answered from the cache on the silo */
+	for (guint i = 0; i < 2; i++) {
+		g_autoptr(GPtrArray) list = g_ptr_array_new_with_free_func (g_object_unref);
+		GsCategory *parent;
+		GPtrArray *children;
+
+		g_ptr_array_add (list, gs_plugins_core_category_counts_new_parent ());
+		g_assert_true (gs_appstream_add_categories (plugin, silo, list, NULL, &error));
+		g_assert_no_error (error);
+		parent = g_ptr_array_index (list, 0);
+		children = gs_category_get_children (parent);
+		g_assert_cmpint (gs_category_get_size (g_ptr_array_index (children, 0)), ==, 26);
+		g_assert_cmpint (gs_category_get_size (g_ptr_array_index (children, 1)), ==, 13);
+		g_assert_cmpint (gs_category_get_size (parent), ==, 26 + 13);
+	}
+
+	/* only the groups the desktop categories use are counted */
+	counts = g_object_get_data (G_OBJECT (silo), "GsAppstream::category-counts");
+	g_assert_nonnull (counts);
+	g_assert_true (g_hash_table_contains (counts, "Graphics::Viewer"));
+	g_assert_false (g_hash_table_contains (counts, "Viewer::Graphics"));
+}
+
+static GdkPixbuf *
+gs_plugins_core_icons_refine (GsPluginLoader *plugin_loader, const gchar *filename)
+{
+	gboolean ret;
+	g_autoptr(AsIcon) icon = as_icon_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsApp) app = gs_app_new ("icon-test.desktop");
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+
+	as_icon_set_kind (icon, AS_ICON_KIND_LOCAL);
+	as_icon_set_filename (icon, filename);
+	gs_app_add_icon (app, icon);
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
+					 "app", app,
+					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+					 NULL);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert (gs_app_get_pixbuf (app) != NULL);
+	return g_object_ref (gs_app_get_pixbuf (app));
+}
+
+static void
+gs_plugins_core_icons_cache_func (GsPluginLoader *plugin_loader)
+{
+	gboolean ret;
+	g_autofree gchar *filename = NULL;
+	g_autoptr(GdkPixbuf) pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 64, 64);
+	g_autoptr(GdkPixbuf) pb1 = NULL;
+	g_autoptr(GdkPixbuf) pb2 = NULL;
+	g_autoptr(GdkPixbuf) pb3 = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file = NULL;
+
+	g_assert_cmpint (g_mkdir_with_parents (g_get_user_cache_dir (), 0755), ==, 0);
+	filename = g_build_filename (g_get_user_cache_dir (), "icon-test.png", NULL);
+	gdk_pixbuf_fill (pb, 0xff0000ff);
+	ret = gdk_pixbuf_save (pb, filename, "png", &error, NULL);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* the second app shares the decoded icon */
+	pb1 = gs_plugins_core_icons_refine (plugin_loader, filename);
+	pb2 = gs_plugins_core_icons_refine (plugin_loader, filename);
+	g_assert (pb1 == pb2);
+
+	/* a changed file is decoded again */
+	file = g_file_new_for_path (filename);
+	ret = g_file_set_attribute_uint64 (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+					   (guint64) g_get_real_time () / G_USEC_PER_SEC + 60,
+					   G_FILE_QUERY_INFO_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	pb3 = gs_plugins_core_icons_refine (plugin_loader, filename);
+	g_assert (pb3 != pb1);
+}
+
 static void
 gs_plugins_core_os_release_func (GsPluginLoader *plugin_loader)
 {
@@ -176,6 +361,260 @@ gs_plugins_core_generic_updates_func (GsPluginLoader *plugin_loader)
 	}
 }
 
+static void
+gs_plugins_core_search_index_func (void)
+{
+	const gchar *xml;
+	g_autofree gchar *fn = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GsPlugin) plugin = gs_plugin_new ();
+	g_autoptr(XbBuilder) builder = xb_builder_new ();
+	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
+	g_autoptr(XbSilo) silo = NULL;
+	const gchar *searches[][3] = {
+		{ "gimp", NULL },
+		{ "GIMP", NULL },
+		{ "image", "editor" },
+		{ "org.gimp", NULL },
+		{ "web", NULL },
+		{ "purple", NULL },
+		{ "image", "nosuchword" },
+		{ "edit", NULL },
+		{ "editors", NULL },
+		{ "browsing", "images" },
+		{ NULL }
+	};
+
+	xml = "<?xml version=\"1.0\"?>\n"
+		"<components origin=\"purple\" version=\"0.9\">\n"
+		"  <component type=\"desktop\">\n"
+		"    <id>org.gimp.GIMP</id>\n"
+		"    <name>GIMP</name>\n"
+		"    <summary>(Powerful) image editor</summary>\n"
+		"    <pkgname>gimp</pkgname>\n"
+		"    <mimetypes><mimetype>image/png</mimetype></mimetypes>\n"
+		"  </component>\n"
+		"  <component type=\"desktop\">\n"
+		"    <id>org.gnome.Epiphany</id>\n"
+		"    <name>Web</name>\n"
+		"    <summary>Browse and edit the web</summary>\n"
+		"    <keywords><keyword>Image</keyword></keywords>\n"
+		"    <launchable type=\"desktop-id\">epiphany.desktop</launchable>\n"
+		"  </component>\n"
+		"</components>\n";
+	g_assert_true (xb_builder_source_load_xml (source, xml,
+						   XB_BUILDER_SOURCE_FLAG_NONE,
+						   &error));
+	g_assert_no_error (error);
+	xb_builder_import_source (builder, source);
+	silo = xb_builder_compile (builder, XB_BUILDER_COMPILE_FLAG_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (silo);
+	gs_plugin_set_name (plugin, "appstream");
+
+	fn = g_build_filename (g_getenv ("GS_SELF_TEST_CACHEDIR"), "search-index.idx", NULL);
+	file = g_file_new_for_path (fn);
+
+	/* the second pass loads the index back from disk */
+	for (guint pass = 0; pass < 2; pass++) {
+		g_autoptr(GsAppstreamSearchIndex) index = NULL;
+
+		index = gs_appstream_search_index_new (silo, file, NULL, &error);
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+			g_test_skip ("built without libstemmer");
+			return;
+		}
+		g_assert_no_error (error);
+		g_assert_nonnull (index);
+
+		/* the index must agree with querying every component */
+		for (guint i = 0; searches[i][0] != NULL; i++) {
+			g_autoptr(GsAppList) list = gs_app_list_new ();
+			g_autoptr(GsAppList) list_index = gs_app_list_new ();
+
+			g_assert_true (gs_appstream_search (plugin, silo, NULL,
+							    searches[i], list,
+							    NULL, &error));
+			g_assert_no_error (error);
+			gs_plugin_cache_invalidate (plugin);
+			g_assert_true (gs_appstream_search (plugin, silo, index,
+							    searches[i], list_index,
+							    NULL, &error));
+			g_assert_no_error (error);
+			g_assert_cmpint (gs_app_list_length (list_index), ==,
+					 gs_app_list_length (list));
+			for (guint j = 0; j < gs_app_list_length (list); j++) {
+				GsApp *app = gs_app_list_index (list, j);
+				GsApp *app_index = gs_app_list_index (list_index, j);
+				g_assert_cmpstr (gs_app_get_id (app_index), ==,
+						 gs_app_get_id (app));
+				g_assert_cmpint (gs_app_get_match_value (app_index), ==,
+						 gs_app_get_match_value (app));
+			}
+		}
+	}
+}
+
+/* the original algorithm, which rebinned every pixel for each bin size */
+static GPtrArray *
+gs_plugins_core_key_colors_reference (GdkPixbuf *pb, guint number)
+{
+	GPtrArray *colors = g_ptr_array_new_with_free_func (g_free);
+	gint rowstride = gdk_pixbuf_get_rowstride (pb);
+	gint n_channels = gdk_pixbuf_get_n_channels (pb);
+	guchar *pixels = gdk_pixbuf_get_pixels (pb);
+
+	for (guint bin_size = 250; bin_size > 0; bin_size -= 2) {
+		g_autoptr(GHashTable) hash = NULL;
+		hash = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					      NULL, g_free);
+		for (gint y = 0; y < gdk_pixbuf_get_height (pb); y++) {
+			for (gint x = 0; x < gdk_pixbuf_get_width (pb); x++) {
+				guchar *p = pixels + y * rowstride + x * n_channels;
+				GdkRGBA *s;
+				gpointer key;
+
+				if (p[3] != 255)
+					continue;
+				key = GUINT_TO_POINTER ((guint32) (p[0] / bin_size) |
+							(guint32) (p[1] / bin_size) << 8 |
+							(guint32) (p[2] / bin_size) << 16);
+				s = g_hash_table_lookup (hash, key);
+				if (s == NULL) {
+					s = g_new0 (GdkRGBA, 1);
+					g_hash_table_insert (hash, key, s);
+				}
+				s->red += (gdouble) p[0] / 255.f;
+				s->green += (gdouble) p[1] / 255.f;
+				s->blue += (gdouble) p[2] / 255.f;
+				s->alpha += 1;
+			}
+		}
+		if (g_hash_table_size (hash) >= number) {
+			g_autoptr(GList) values = g_hash_table_get_values (hash);
+			for (GList *l = values; l != NULL; l = l->next) {
+				GdkRGBA *s = l->data;
+				GdkRGBA *color = g_new0 (GdkRGBA, 1);
+				color->red = s->red / s->alpha;
+				color->green = s->green / s->alpha;
+				color->blue = s->blue / s->alpha;
+				g_ptr_array_add (colors, color);
+			}
+			return colors;
+		}
+	}
+	return colors;
+}
+
+static void
+gs_plugins_core_key_colors_func (void)
+{
+	const gchar *icon_names[] = {
+		"system-file-manager",
+		"utilities-terminal",
+		"accessories-text-editor",
+		"web-browser",
+		NULL
+	};
+	const gchar *test_search_path = g_getenv ("GS_SELF_TEST_ICON_THEME_PATH");
+	g_autoptr(GPtrArray) pixbufs = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GtkIconTheme) icon_theme = gtk_icon_theme_new ();
+	g_autoptr(GRand) rand = g_rand_new_with_seed (42);
+	g_autoptr(GTimer) timer = g_timer_new ();
+	gdouble elapsed = 0.f;
+	gdouble elapsed_reference = 0.f;
+
+	/* sample icons from the system theme, if installed */
+	if (test_search_path != NULL) {
+		g_auto(GStrv) dirs = g_strsplit (test_search_path, ":", -1);
+		gtk_icon_theme_set_search_path (icon_theme, (const gchar **) dirs,
+						(gint) g_strv_length (dirs));
+	}
+	for (guint i = 0; icon_names[i] != NULL; i++) {
+		g_autoptr(GdkPixbuf) pb = NULL;
+		pb = gtk_icon_theme_load_icon (icon_theme, icon_names[i], 64,
+					       GTK_ICON_LOOKUP_FORCE_SIZE, NULL);
+		if (pb == NULL || !gdk_pixbuf_get_has_alpha (pb))
+			continue;
+		g_ptr_array_add (pixbufs, gdk_pixbuf_scale_simple (pb, 32, 32,
+								   GDK_INTERP_BILINEAR));
+	}
+
+	/* and some synthetic ones: noise, a gradient and a few flat colors */
+	for (guint i = 0; i < 3; i++) {
+		GdkPixbuf *pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 32, 32);
+		gint rowstride = gdk_pixbuf_get_rowstride (pb);
+		guchar *pixels = gdk_pixbuf_get_pixels (pb);
+		for (gint y = 0; y < 32; y++) {
+			for (gint x = 0; x < 32; x++) {
+				guchar *p = pixels + y * rowstride + x * 4;
+				if (i == 0) {
+					p[0] = (guchar) g_rand_int_range (rand, 0, 256);
+					p[1] = (guchar) g_rand_int_range (rand, 0, 256);
+					p[2] = (guchar) g_rand_int_range (rand, 0, 256);
+				} else if (i == 1) {
+					p[0] = (guchar) (x * 8);
+					p[1] = (guchar) (y * 8);
+					p[2] = 0x80;
+				} else {
+					p[0] = (guchar) ((x / 8) * 60);
+					p[1] = (guchar) ((y / 8) * 60);
+					p[2] = 0x20;
+				}
+				p[3] = (x + y) % 7 == 0 ? 0x00 : 0xff;
+			}
+		}
+		g_ptr_array_add (pixbufs, pb);
+	}
+
+	/* the single-pass kernel must find the same bins as the original */
+	for (guint i = 0; i < pixbufs->len; i++) {
+		GdkPixbuf *pb = g_ptr_array_index (pixbufs, i);
+		g_autoptr(GPtrArray) colors = NULL;
+		g_autoptr(GPtrArray) colors_reference = NULL;
+
+		g_timer_reset (timer);
+		for (guint j = 0; j < 100; j++) {
+			g_clear_pointer (&colors, g_ptr_array_unref);
+			colors = gs_key_colors_for_pixbuf (pb, 10);
+		}
+		elapsed += g_timer_elapsed (timer, NULL);
+
+		g_timer_reset (timer);
+		for (guint j = 0; j < 100; j++) {
+			g_clear_pointer (&colors_reference, g_ptr_array_unref);
+			colors_reference = gs_plugins_core_key_colors_reference (pb, 10);
+		}
+		elapsed_reference += g_timer_elapsed (timer, NULL);
+
+		/* the reference leaves this empty for the monochrome ramp */
+		if (colors_reference->len == 0) {
+			g_assert_cmpint (colors->len, ==, 3);
+			continue;
+		}
+		g_assert_cmpint (colors->len, ==, colors_reference->len);
+		for (guint j = 0; j < colors->len; j++) {
+			GdkRGBA *color = g_ptr_array_index (colors, j);
+			gboolean found = FALSE;
+			for (guint k = 0; k < colors_reference->len; k++) {
+				GdkRGBA *tmp = g_ptr_array_index (colors_reference, k);
+				if (tmp->alpha < 0)
+					continue;
+				if (fabs (tmp->red - color->red) > 1e-6 ||
+				    fabs (tmp->green - color->green) > 1e-6 ||
+				    fabs (tmp->blue - color->blue) > 1e-6)
+					continue;
+				tmp->alpha = -1;
+				found = TRUE;
+				break;
+			}
+			g_assert_true (found);
+		}
+	}
+	g_print ("%.2fms vs %.2fms ", elapsed * 1000, elapsed_reference * 1000);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -259,9 +698,21 @@ main (int argc, char **argv)
 	g_assert (ret);
 
 	/* plugin tests go here */
+	g_test_add_func ("/unity-software/plugins/core/search-index",
+			 gs_plugins_core_search_index_func);
+	g_test_add_func ("/unity-software/plugins/core/category-counts",
+			 gs_plugins_core_category_counts_func);
+	g_test_add_func ("/unity-software/plugins/core/key-colors",
+			 gs_plugins_core_key_colors_func);
 	g_test_add_data_func ("/unity-software/plugins/core/search-repo-name",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_core_search_repo_name_func);
+	g_test_add_data_func ("/unity-software/plugins/core/appstream-refine",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_appstream_refine_func);
+	g_test_add_data_func ("/unity-software/plugins/core/icons-cache",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_icons_cache_func);
 	g_test_add_data_func ("/unity-software/plugins/core/os-release",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_core_os_release_func);
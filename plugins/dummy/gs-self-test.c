@@ -152,6 +152,61 @@ gs_plugins_dummy_refine_func (GsPluginLoader *plugin_loader)
 	g_assert_cmpstr (gs_app_get_url (app, AS_URL_KIND_HOMEPAGE), ==, "http://www.test.org/");
 }
 
+static void
+gs_plugins_dummy_refine_staged_partial_cb (GsPluginJob *plugin_job,
+					   GsAppList *list,
+					   guint64 refine_flags,
+					   gpointer user_data)
+{
+	GArray *stages = (GArray *) user_data;
+	GsApp *app = gs_app_list_index (list, 0);
+
+	/* local metadata is always available first */
+	g_assert_cmpstr (gs_app_get_description (app), !=, NULL);
+	g_array_append_val (stages, refine_flags);
+}
+
+static void
+gs_plugins_dummy_refine_staged_func (GsPluginLoader *plugin_loader)
+{
+	gboolean ret;
+	guint64 refine_flags;
+	g_autoptr(GArray) stages = g_array_new (FALSE, FALSE, sizeof (guint64));
+	g_autoptr(GsApp) app = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+
+	/* local, disk and network flags in one job */
+	app = gs_app_new ("chiron.desktop");
+	gs_app_set_management_plugin (app, "dummy");
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
+					 "app", app,
+					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_DESCRIPTION |
+							 GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING |
+							 GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS,
+					 "staged-refine", TRUE,
+					 NULL);
+	g_signal_connect (plugin_job, "partial-result",
+			  G_CALLBACK (gs_plugins_dummy_refine_staged_partial_cb),
+			  stages);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* one partial result per tier, except the last */
+	g_assert_cmpint (stages->len, ==, 2);
+	refine_flags = g_array_index (stages, guint64, 0);
+	g_assert_cmpint (refine_flags, ==, GS_PLUGIN_REFINE_FLAGS_REQUIRE_DESCRIPTION);
+	refine_flags = g_array_index (stages, guint64, 1);
+	g_assert_cmpint (refine_flags, ==, GS_PLUGIN_REFINE_FLAGS_REQUIRE_DESCRIPTION |
+					   GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING);
+
+	/* everything is there at the end */
+	g_assert_cmpint (gs_app_get_rating (app), ==, 66);
+	g_assert_cmpint (gs_app_get_reviews (app)->len, >, 0);
+}
+
 static void
 gs_plugins_dummy_metadata_quirks (GsPluginLoader *plugin_loader)
 {
@@ -430,6 +485,63 @@ gs_plugins_dummy_search_func (GsPluginLoader *plugin_loader)
 	g_assert_cmpint (gs_app_get_kind (app), ==, AS_APP_KIND_DESKTOP);
 }
 
+typedef struct {
+	GMainLoop	*loop;
+	guint		*pending;
+	GsAppList	*list;
+	GError		*error;
+} GsDummyCoalesceHelper;
+
+static void
+gs_plugins_dummy_coalesce_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source);
+	GsDummyCoalesceHelper *helper = (GsDummyCoalesceHelper *) user_data;
+	helper->list = gs_plugin_loader_job_process_finish (plugin_loader, res,
+							    &helper->error);
+	if (--(*helper->pending) == 0)
+		g_main_loop_quit (helper->loop);
+}
+
+static void
+gs_plugins_dummy_search_coalesce_func (GsPluginLoader *plugin_loader)
+{
+	GsDummyCoalesceHelper helpers[2] = { { NULL } };
+	guint pending = G_N_ELEMENTS (helpers);
+	g_autoptr(GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+	g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+
+	/* two identical searches share one pipeline */
+	for (guint i = 0; i < G_N_ELEMENTS (helpers); i++) {
+		g_autoptr(GsPluginJob) plugin_job = NULL;
+		helpers[i].loop = loop;
+		helpers[i].pending = &pending;
+		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_SEARCH,
+						 "search", "zeus",
+						 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+						 NULL);
+		gs_plugin_loader_job_process_async (plugin_loader, plugin_job,
+						    i == 0 ? cancellable : NULL,
+						    gs_plugins_dummy_coalesce_cb,
+						    &helpers[i]);
+	}
+
+	/* the first caller giving up does not cancel the second */
+	g_cancellable_cancel (cancellable);
+	g_main_loop_run (loop);
+	gs_test_flush_main_context ();
+
+	g_assert_error (helpers[0].error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_CANCELLED);
+	g_assert (helpers[0].list == NULL);
+	g_assert_no_error (helpers[1].error);
+	g_assert (helpers[1].list != NULL);
+	g_assert_cmpint (gs_app_list_length (helpers[1].list), ==, 1);
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (helpers[1].list, 0)), ==, "zeus.desktop");
+
+	g_clear_error (&helpers[0].error);
+	g_clear_object (&helpers[1].list);
+}
+
 static void
 gs_plugins_dummy_search_alternate_func (GsPluginLoader *plugin_loader)
 {
@@ -483,6 +595,49 @@ gs_plugins_dummy_hang_func (GsPluginLoader *plugin_loader)
 	g_assert (list == NULL);
 }
 
+static void
+gs_plugins_dummy_parallel_results_func (GsPluginLoader *plugin_loader)
+{
+	GsApp *app;
+	GsPlugin *plugin = gs_plugin_loader_find_plugin (plugin_loader, "dummy");
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+
+	/* run the dummy plugin in the same batch as appstream */
+	g_assert (plugin != NULL);
+	gs_plugin_add_flags (plugin, GS_PLUGIN_FLAGS_PARALLEL_RESULTS);
+
+	/* the results from both are merged and refined as before */
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_GET_INSTALLED,
+					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN |
+							 GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+					 NULL);
+	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert (list != NULL);
+	g_assert_cmpint (gs_app_list_length (list), ==, 1);
+	app = gs_app_list_index (list, 0);
+	g_assert_cmpstr (gs_app_get_id (app), ==, "zeus.desktop");
+	g_assert_cmpint (gs_app_get_state (app), ==, AS_APP_STATE_INSTALLED);
+	g_assert_cmpstr (gs_app_get_source_default (app), ==, "zeus");
+	g_clear_object (&list);
+	g_clear_object (&plugin_job);
+
+	/* a fatal error from one plugin fails the whole batch */
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_SEARCH,
+					 "search", "hang",
+					 "timeout", 1, /* seconds */
+					 NULL);
+	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_error (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_TIMED_OUT);
+	g_assert (list == NULL);
+
+	gs_plugin_remove_flags (plugin, GS_PLUGIN_FLAGS_PARALLEL_RESULTS);
+}
+
 static void
 gs_plugins_dummy_search_invalid_func (GsPluginLoader *plugin_loader)
 {
@@ -710,6 +865,103 @@ gs_plugins_dummy_limit_parallel_ops_func (GsPluginLoader *plugin_loader)
 	gs_plugin_loader_set_max_parallel_ops (plugin_loader, 0);
 }
 
+typedef struct {
+	const gchar	*name;
+	GPtrArray	*finished;	/* of const gchar * */
+	GMainLoop	*loop;
+	GError		*error;
+} GsDummyLaneHelper;
+
+static void
+plugin_job_lane_cb (GObject *source,
+		    GAsyncResult *res,
+		    gpointer user_data)
+{
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source);
+	GsDummyLaneHelper *helper = (GsDummyLaneHelper *) user_data;
+
+	gs_plugin_loader_job_action_finish (plugin_loader, res, &helper->error);
+	g_ptr_array_add (helper->finished, (gpointer) helper->name);
+	if (helper->finished->len == 3)
+		g_main_loop_quit (helper->loop);
+}
+
+static void
+gs_plugins_dummy_lanes_func (GsPluginLoader *plugin_loader)
+{
+	g_autoptr(GsApp) app1 = NULL;
+	g_autoptr(GsApp) app2 = NULL;
+	g_autoptr(GsApp) app3 = NULL;
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsPluginJob) plugin_job1 = NULL;
+	g_autoptr(GsPluginJob) plugin_job2 = NULL;
+	g_autoptr(GsPluginJob) plugin_job3 = NULL;
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GMainLoop) loop = g_main_loop_new (context, FALSE);
+	g_autoptr(GPtrArray) finished = g_ptr_array_new ();
+	GsDummyLaneHelper helper1 = { "download", finished, loop, NULL };
+	GsDummyLaneHelper helper2 = { "install", finished, loop, NULL };
+	GsDummyLaneHelper helper3 = { "install-interactive", finished, loop, NULL };
+
+	/* allow only one operation at a time */
+	gs_plugin_loader_set_max_parallel_ops (plugin_loader, 1);
+	g_main_context_push_thread_default (context);
+
+	/* download updates in the background, as the update monitor does */
+	app1 = gs_app_new ("hermes.desktop");
+	gs_app_set_management_plugin (app1, "dummy");
+	gs_app_set_state (app1, AS_APP_STATE_UPDATABLE_LIVE);
+	gs_app_list_add (list, app1);
+	plugin_job1 = gs_plugin_job_newv (GS_PLUGIN_ACTION_DOWNLOAD,
+					  "list", list,
+					  NULL);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job1, NULL,
+					    plugin_job_lane_cb, &helper1);
+	for (guint i = 0; i < 500 && gs_app_get_progress (app1) == GS_APP_PROGRESS_UNKNOWN; i++)
+		g_usleep (10000);
+	g_assert_cmpint (gs_app_get_progress (app1), !=, GS_APP_PROGRESS_UNKNOWN);
+
+	/* this has to wait for the download to finish */
+	app2 = gs_app_new ("chiron.desktop");
+	gs_app_set_management_plugin (app2, "dummy");
+	gs_app_set_state (app2, AS_APP_STATE_AVAILABLE);
+	plugin_job2 = gs_plugin_job_newv (GS_PLUGIN_ACTION_INSTALL,
+					  "app", app2,
+					  NULL);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job2, NULL,
+					    plugin_job_lane_cb, &helper2);
+	g_assert_cmpint (gs_app_get_state (app2), ==, AS_APP_STATE_AVAILABLE);
+
+	/* this preempts the download, which then has to wait behind the
+	 * install that was queued after it was first started */
+	app3 = gs_app_new ("zeus.desktop");
+	gs_app_set_management_plugin (app3, "dummy");
+	gs_app_set_state (app3, AS_APP_STATE_AVAILABLE);
+	plugin_job3 = gs_plugin_job_newv (GS_PLUGIN_ACTION_INSTALL,
+					  "app", app3,
+					  "interactive", TRUE,
+					  NULL);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job3, NULL,
+					    plugin_job_lane_cb, &helper3);
+
+	g_main_loop_run (loop);
+	g_main_context_pop_thread_default (context);
+	gs_test_flush_main_context ();
+
+	g_assert_no_error (helper1.error);
+	g_assert_no_error (helper2.error);
+	g_assert_no_error (helper3.error);
+	g_assert_cmpint (finished->len, ==, 3);
+	g_assert_cmpstr (g_ptr_array_index (finished, 0), ==, "install-interactive");
+	g_assert_cmpstr (g_ptr_array_index (finished, 1), ==, "install");
+	g_assert_cmpstr (g_ptr_array_index (finished, 2), ==, "download");
+	g_assert_cmpint (gs_app_get_state (app2), ==, AS_APP_STATE_INSTALLED);
+	g_assert_cmpint (gs_app_get_state (app3), ==, AS_APP_STATE_INSTALLED);
+
+	/* set the default max parallel ops */
+	gs_plugin_loader_set_max_parallel_ops (plugin_loader, 0);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -856,9 +1108,15 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/unity-software/plugins/dummy/search-alternate",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_search_alternate_func);
+	g_test_add_data_func ("/unity-software/plugins/dummy/search{coalesce}",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_search_coalesce_func);
 	g_test_add_data_func ("/unity-software/plugins/dummy/hang",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_hang_func);
+	g_test_add_data_func ("/unity-software/plugins/dummy/parallel-results",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_parallel_results_func);
 	g_test_add_data_func ("/unity-software/plugins/dummy/search{invalid}",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_search_invalid_func);
@@ -877,6 +1135,9 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/unity-software/plugins/dummy/refine",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_refine_func);
+	g_test_add_data_func ("/unity-software/plugins/dummy/refine{staged}",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_refine_staged_func);
 	g_test_add_data_func ("/unity-software/plugins/dummy/updates",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_updates_func);
@@ -889,6 +1150,9 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/unity-software/plugins/dummy/limit-parallel-ops",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_limit_parallel_ops_func);
+	g_test_add_data_func ("/unity-software/plugins/dummy/lanes",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_lanes_func);
 	retval = g_test_run ();
 
 	/* Clean up. */
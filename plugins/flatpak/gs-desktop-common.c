@@ -0,0 +1 @@
+../core/gs-desktop-common.c
\ No newline at end of file
@@ -0,0 +1 @@
+../core/gs-desktop-common.h
\ No newline at end of file
@@ -29,17 +29,22 @@ struct _GsFlatpak {
 	GsFlatpakFlags		 flags;
 	FlatpakInstallation	*installation;
 	GPtrArray		*installed_refs;  /* must be entirely replaced rather than updated internally */
+	GHashTable		*installed_refs_index; /* origin/name/arch/branch : FlatpakInstalledRef, replaced with installed_refs */
 	GMutex			 installed_refs_mutex;
+	GHashTable		*remotes;	/* name : FlatpakRemote */
+	GMutex			 remotes_mutex;
 	GHashTable		*broken_remotes;
 	GMutex			 broken_remotes_mutex;
 	GFileMonitor		*monitor;
 	AsAppScope		 scope;
 	GsPlugin		*plugin;
 	XbSilo			*silo;
+	GsAppstreamSearchIndex	*search_index;
 	GRWLock			 silo_lock;
 	gchar			*id;
 	guint			 changed_id;
 	GHashTable		*app_silos;
+	guint			 app_silos_generation;
 	GMutex			 app_silos_mutex;
 };
 
@@ -300,6 +305,41 @@ gs_flatpak_create_source (GsFlatpak *self, FlatpakRemote *xremote)
 	return g_steal_pointer (&app);
 }
 
+static void
+gs_flatpak_invalidate_remotes (GsFlatpak *self)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->remotes_mutex);
+	g_hash_table_remove_all (self->remotes);
+}
+
+/* like flatpak_installation_get_remote_by_name() but without reading the
+ * repo config each time; the returned remote must not be modified */
+static FlatpakRemote *
+gs_flatpak_get_remote_by_name (GsFlatpak *self,
+			       const gchar *name,
+			       GCancellable *cancellable,
+			       GError **error)
+{
+	FlatpakRemote *xremote;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	locker = g_mutex_locker_new (&self->remotes_mutex);
+	xremote = g_hash_table_lookup (self->remotes, name);
+	if (xremote != NULL)
+		return g_object_ref (xremote);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+
+	xremote = flatpak_installation_get_remote_by_name (self->installation,
+							   name,
+							   cancellable,
+							   error);
+	if (xremote == NULL)
+		return NULL;
+	locker = g_mutex_locker_new (&self->remotes_mutex);
+	g_hash_table_replace (self->remotes, g_strdup (name), g_object_ref (xremote));
+	return xremote;
+}
+
 static void
 gs_plugin_flatpak_changed_cb (GFileMonitor *monitor,
 			      GFile *child,
@@ -317,9 +357,18 @@ gs_plugin_flatpak_changed_cb (GFileMonitor *monitor,
 		return;
 	}
 
+	/* drop the remotes cache */
+	gs_flatpak_invalidate_remotes (self);
+
+	/* rebuild the app silos when they are next refined */
+	g_mutex_lock (&self->app_silos_mutex);
+	self->app_silos_generation++;
+	g_mutex_unlock (&self->app_silos_mutex);
+
 	/* drop the installed refs cache */
 	locker = g_mutex_locker_new (&self->installed_refs_mutex);
 	g_clear_pointer (&self->installed_refs, g_ptr_array_unref);
+	g_clear_pointer (&self->installed_refs_index, g_hash_table_unref);
 }
 
 static gboolean
@@ -740,7 +789,10 @@ gs_flatpak_rescan_appstream_store (GsFlatpak *self,
 {
 	const gchar *const *locales = g_get_language_names ();
 	g_autofree gchar *blobfn = NULL;
+	g_autofree gchar *indexfn = NULL;
+	g_autoptr(GError) error_index = NULL;
 	g_autoptr(GFile) file = NULL;
+	g_autoptr(GFile) file_index = NULL;
 	g_autoptr(GPtrArray) xremotes = NULL;
 	g_autoptr(GRWLockReaderLocker) reader_locker = NULL;
 	g_autoptr(GRWLockWriterLocker) writer_locker = NULL;
@@ -754,6 +806,7 @@ gs_flatpak_rescan_appstream_store (GsFlatpak *self,
 
 	/* drat! silo needs regenerating */
 	writer_locker = g_rw_lock_writer_locker_new (&self->silo_lock);
+	g_clear_pointer (&self->search_index, gs_appstream_search_index_free);
 	g_clear_object (&self->silo);
 
 	/* verbose profiling */
@@ -807,6 +860,33 @@ gs_flatpak_rescan_appstream_store (GsFlatpak *self,
 	if (self->silo == NULL)
 		return FALSE;
 
+	/* apps refined from the old silo need refining again */
+	gs_plugin_refine_data_changed (self->plugin);
+
+	/* build the search index, or load it if the silo is unchanged */
+	indexfn = gs_utils_get_cache_filename (gs_flatpak_get_id (self),
+					       "components.idx",
+					       GS_UTILS_CACHE_FLAG_WRITEABLE,
+					       error);
+	if (indexfn == NULL)
+		return FALSE;
+	file_index = g_file_new_for_path (indexfn);
+	self->search_index = gs_appstream_search_index_new (self->silo,
+							    file_index,
+							    cancellable,
+							    &error_index);
+	if (self->search_index == NULL) {
+		if (g_error_matches (error_index, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+			g_debug ("not using search index: %s", error_index->message);
+			return TRUE;
+		}
+
+		/* drop the silo so the next call tries again */
+		g_clear_object (&self->silo);
+		g_propagate_error (error, g_steal_pointer (&error_index));
+		return FALSE;
+	}
+
 	/* success */
 	return TRUE;
 }
@@ -1363,6 +1443,7 @@ gs_flatpak_app_install_source (GsFlatpak *self, GsApp *app,
 	}
 
 	/* invalidate cache */
+	gs_flatpak_invalidate_remotes (self);
 	g_rw_lock_reader_lock (&self->silo_lock);
 	if (self->silo != NULL)
 		xb_silo_invalidate (self->silo);
@@ -1568,9 +1649,11 @@ gs_flatpak_refresh (GsFlatpak *self,
 		return FALSE;
 	}
 
-	/* drop the installed refs cache */
+	/* drop the remotes and installed refs caches */
+	gs_flatpak_invalidate_remotes (self);
 	g_mutex_lock (&self->installed_refs_mutex);
 	g_clear_pointer (&self->installed_refs, g_ptr_array_unref);
+	g_clear_pointer (&self->installed_refs_index, g_hash_table_unref);
 	g_mutex_unlock (&self->installed_refs_mutex);
 
 	/* manually do this in case we created the first appstream file */
@@ -1609,10 +1692,10 @@ gs_plugin_refine_item_origin_hostname (GsFlatpak *self, GsApp *app,
 		return TRUE;
 
 	/* get the remote  */
-	xremote = flatpak_installation_get_remote_by_name (self->installation,
-							   gs_app_get_origin (app),
-							   cancellable,
-							   &error_local);
+	xremote = gs_flatpak_get_remote_by_name (self,
+						 gs_app_get_origin (app),
+						 cancellable,
+						 &error_local);
 	if (xremote == NULL) {
 		if (g_error_matches (error_local,
 				     FLATPAK_ERROR,
@@ -1767,6 +1850,36 @@ gs_flatpak_create_fake_ref (GsApp *app, GError **error)
 	return xref;
 }
 
+static gchar *
+gs_flatpak_installed_ref_key (const gchar *origin,
+			      const gchar *name,
+			      const gchar *arch,
+			      const gchar *branch)
+{
+	return g_strdup_printf ("%s/%s/%s/%s", origin, name, arch, branch);
+}
+
+static GHashTable *
+gs_flatpak_installed_refs_index_new (GPtrArray *installed_refs)
+{
+	GHashTable *index = g_hash_table_new_full (g_str_hash, g_str_equal,
+						   g_free, g_object_unref);
+	for (guint i = 0; i < installed_refs->len; i++) {
+		FlatpakInstalledRef *ref_tmp = g_ptr_array_index (installed_refs, i);
+		g_autofree gchar *key = NULL;
+		key = gs_flatpak_installed_ref_key (flatpak_installed_ref_get_origin (ref_tmp),
+						    flatpak_ref_get_name (FLATPAK_REF (ref_tmp)),
+						    flatpak_ref_get_arch (FLATPAK_REF (ref_tmp)),
+						    flatpak_ref_get_branch (FLATPAK_REF (ref_tmp)));
+
+		/* the first match wins, as with the old linear search */
+		if (g_hash_table_contains (index, key))
+			continue;
+		g_hash_table_insert (index, g_steal_pointer (&key), g_object_ref (ref_tmp));
+	}
+	return index;
+}
+
 /* the _unlocked() version doesn't call gs_flatpak_rescan_appstream_store,
  * in order to avoid taking the writer lock on self->silo_lock */
 static gboolean
@@ -1775,8 +1888,8 @@ gs_flatpak_refine_app_state_unlocked (GsFlatpak *self,
                                       GCancellable *cancellable,
                                       GError **error)
 {
-	g_autoptr(FlatpakInstalledRef) ref = NULL;
-	g_autoptr(GPtrArray) installed_refs = NULL;
+	FlatpakInstalledRef *ref = NULL;
+	g_autoptr(GHashTable) installed_refs_index = NULL;
 
 	/* already found */
 	if (gs_app_get_state (app) != AS_APP_STATE_UNKNOWN)
@@ -1798,24 +1911,23 @@ gs_flatpak_refine_app_state_unlocked (GsFlatpak *self,
 			gs_flatpak_error_convert (error);
 			return FALSE;
 		}
+		g_clear_pointer (&self->installed_refs_index, g_hash_table_unref);
+		self->installed_refs_index = gs_flatpak_installed_refs_index_new (self->installed_refs);
 	}
 
-	installed_refs = g_ptr_array_ref (self->installed_refs);
+	installed_refs_index = g_hash_table_ref (self->installed_refs_index);
 	g_mutex_unlock (&self->installed_refs_mutex);
 
-	for (guint i = 0; i < installed_refs->len; i++) {
-		FlatpakInstalledRef *ref_tmp = g_ptr_array_index (installed_refs, i);
-		const gchar *origin = flatpak_installed_ref_get_origin (ref_tmp);
-		const gchar *name = flatpak_ref_get_name (FLATPAK_REF (ref_tmp));
-		const gchar *arch = flatpak_ref_get_arch (FLATPAK_REF (ref_tmp));
-		const gchar *branch = flatpak_ref_get_branch (FLATPAK_REF (ref_tmp));
-		if (g_strcmp0 (origin, gs_app_get_origin (app)) == 0 &&
-		    g_strcmp0 (name, gs_flatpak_app_get_ref_name (app)) == 0 &&
-		    g_strcmp0 (arch, gs_flatpak_app_get_ref_arch (app)) == 0 &&
-		    g_strcmp0 (branch, gs_app_get_branch (app)) == 0) {
-			ref = g_object_ref (ref_tmp);
-			break;
-		}
+	if (gs_app_get_origin (app) != NULL &&
+	    gs_flatpak_app_get_ref_name (app) != NULL &&
+	    gs_flatpak_app_get_ref_arch (app) != NULL &&
+	    gs_app_get_branch (app) != NULL) {
+		g_autofree gchar *key = NULL;
+		key = gs_flatpak_installed_ref_key (gs_app_get_origin (app),
+						    gs_flatpak_app_get_ref_name (app),
+						    gs_flatpak_app_get_ref_arch (app),
+						    gs_app_get_branch (app));
+		ref = g_hash_table_lookup (installed_refs_index, key);
 	}
 	if (ref != NULL) {
 		g_debug ("marking %s as installed with flatpak",
@@ -1843,9 +1955,9 @@ gs_flatpak_refine_app_state_unlocked (GsFlatpak *self,
 	if (gs_app_get_state (app) == AS_APP_STATE_UNKNOWN &&
 	    gs_app_get_origin (app) != NULL) {
 		g_autoptr(FlatpakRemote) xremote = NULL;
-		xremote = flatpak_installation_get_remote_by_name (self->installation,
-								   gs_app_get_origin (app),
-								   cancellable, NULL);
+		xremote = gs_flatpak_get_remote_by_name (self,
+							 gs_app_get_origin (app),
+							 cancellable, NULL);
 		if (xremote != NULL) {
 			if (flatpak_remote_get_disabled (xremote)) {
 				g_debug ("%s is available with flatpak "
@@ -2244,26 +2356,61 @@ gs_flatpak_refine_appstream_release (XbNode *component, GsApp *app)
 	}
 }
 
-/* This function is like gs_flatpak_refine_appstream(), but takes gzip
- * compressed appstream data as a GBytes and assumes they are already uniquely
- * tied to the app (and therefore app ID alone can be used to find the right
- * component).
- */
-static gboolean
-gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
-					GsApp *app,
-					const char *origin, /* (nullable) */
-					FlatpakInstalledRef *installed_ref, /* (nullable) */
-					GBytes *appstream_gz,
-					GsPluginRefineFlags flags,
-					GCancellable *cancellable,
-					GError **error)
+/* the key for a silo built from the appstream data of a ref; the commit
+ * identifies the data of installed refs, and bundles use a checksum */
+static gchar *
+gs_flatpak_app_silo_key (GsApp *app,
+			 const gchar *origin,
+			 FlatpakInstalledRef *installed_ref,
+			 GBytes *appstream_gz)
+{
+	g_autofree gchar *ref_display = gs_flatpak_app_get_ref_display (app);
+	g_autofree gchar *checksum = NULL;
+	const gchar *commit = NULL;
+
+	if (installed_ref != NULL)
+		commit = flatpak_ref_get_commit (FLATPAK_REF (installed_ref));
+	if (commit == NULL) {
+		checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, appstream_gz);
+		commit = checksum;
+	}
+	return g_strdup_printf ("%s:%s:%s:%s", ref_display,
+				origin != NULL ? origin : "",
+				installed_ref != NULL ? "installed" : "",
+				commit);
+}
+
+/* returns the app silo saved by a previous refine if it was built from the
+ * same data since the installation last changed */
+static XbSilo *
+gs_flatpak_app_silo_lookup (GsFlatpak *self, GsApp *app, const gchar *key)
+{
+	XbSilo *silo;
+	g_autofree gchar *ref_display = gs_flatpak_app_get_ref_display (app);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->app_silos_mutex);
+
+	silo = g_hash_table_lookup (self->app_silos, ref_display);
+	if (silo == NULL)
+		return NULL;
+	if (GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (silo), "GsFlatpak::generation")) != self->app_silos_generation)
+		return NULL;
+	if (g_strcmp0 (g_object_get_data (G_OBJECT (silo), "GsFlatpak::key"), key) != 0)
+		return NULL;
+	return g_object_ref (silo);
+}
+
+static XbSilo *
+gs_flatpak_app_silo_compile (GsFlatpak *self,
+			     GsApp *app,
+			     const char *origin, /* (nullable) */
+			     FlatpakInstalledRef *installed_ref, /* (nullable) */
+			     GBytes *appstream_gz,
+			     GCancellable *cancellable,
+			     GError **error)
 {
 	const gchar *const *locales = g_get_language_names ();
-	g_autofree gchar *xpath = NULL;
 	g_autoptr(XbBuilder) builder = xb_builder_new ();
 	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
-	g_autoptr(XbNode) component_node = NULL;
 	g_autoptr(XbNode) n = NULL;
 	g_autoptr(XbSilo) silo = NULL;
 	g_autoptr(XbBuilderFixup) bundle_fixup = NULL;
@@ -2284,7 +2431,7 @@ gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
 			     GS_PLUGIN_ERROR,
 			     GS_PLUGIN_ERROR_INVALID_FORMAT,
 			     "unable to decompress appstream data");
-		return FALSE;
+		return NULL;
 	}
 	stream_data = g_converter_input_stream_new (stream_gz,
 						    G_CONVERTER (decompressor));
@@ -2295,14 +2442,14 @@ gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
 					       error);
 	if (appstream == NULL) {
 		gs_flatpak_error_convert (error);
-		return FALSE;
+		return NULL;
 	}
 
 	/* build silo */
 	if (!xb_builder_source_load_bytes (source, appstream,
 					   XB_BUILDER_SOURCE_FLAG_NONE,
 					   error))
-		return FALSE;
+		return NULL;
 
 	/* Appdata from flatpak_installed_ref_load_appdata() may be missing the
 	 * <bundle> tag but for this function we know it's the right component.
@@ -2334,7 +2481,7 @@ gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
 				   cancellable,
 				   error);
 	if (silo == NULL)
-		return FALSE;
+		return NULL;
 	if (g_getenv ("GS_XMLB_VERBOSE") != NULL) {
 		g_autofree gchar *xml = NULL;
 		xml = xb_silo_export (silo,
@@ -2351,7 +2498,52 @@ gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
 				     GS_PLUGIN_ERROR,
 				     GS_PLUGIN_ERROR_NOT_SUPPORTED,
 				     "no apps found in AppStream data");
-		return FALSE;
+		return NULL;
+	}
+	return g_steal_pointer (&silo);
+}
+
+/* This function is like gs_flatpak_refine_appstream(), but takes gzip
+ * compressed appstream data as a GBytes and assumes they are already uniquely
+ * tied to the app (and therefore app ID alone can be used to find the right
+ * component).
+ */
+static gboolean
+gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
+					GsApp *app,
+					const char *origin, /* (nullable) */
+					FlatpakInstalledRef *installed_ref, /* (nullable) */
+					GBytes *appstream_gz,
+					GsPluginRefineFlags flags,
+					GCancellable *cancellable,
+					GError **error)
+{
+	g_autofree gchar *key = NULL;
+	g_autofree gchar *xpath = NULL;
+	g_autoptr(XbNode) component_node = NULL;
+	g_autoptr(XbSilo) silo = NULL;
+
+	/* reuse the silo if it was built from the same data */
+	key = gs_flatpak_app_silo_key (app, origin, installed_ref, appstream_gz);
+	silo = gs_flatpak_app_silo_lookup (self, app, key);
+	if (silo == NULL) {
+		guint generation;
+
+		/* if the installation changes while compiling, the silo is
+		 * rebuilt on the next refine */
+		g_mutex_lock (&self->app_silos_mutex);
+		generation = self->app_silos_generation;
+		g_mutex_unlock (&self->app_silos_mutex);
+
+		g_debug ("building app silo for %s", gs_flatpak_app_get_ref_name (app));
+		silo = gs_flatpak_app_silo_compile (self, app, origin, installed_ref,
+						    appstream_gz, cancellable, error);
+		if (silo == NULL)
+			return FALSE;
+		g_object_set_data_full (G_OBJECT (silo), "GsFlatpak::key",
+					g_steal_pointer (&key), g_free);
+		g_object_set_data (G_OBJECT (silo), "GsFlatpak::generation",
+				   GUINT_TO_POINTER (generation));
 	}
 
 	/* find app */
@@ -2374,7 +2566,7 @@ gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
 	/* use the default release as the version number */
 	gs_flatpak_refine_appstream_release (component_node, app);
 
-	/* save the silo so it can be used for searches */
+	/* save the silo so it can be used for searches and later refines */
 	{
 		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->app_silos_mutex);
 		g_hash_table_replace (self->app_silos,
@@ -2673,6 +2865,7 @@ gs_flatpak_app_remove_source (GsFlatpak *self,
 	}
 
 	/* invalidate cache */
+	gs_flatpak_invalidate_remotes (self);
 	g_rw_lock_reader_lock (&self->silo_lock);
 	if (self->silo != NULL)
 		xb_silo_invalidate (self->silo);
@@ -2989,7 +3182,8 @@ gs_flatpak_search (GsFlatpak *self,
 		return FALSE;
 
 	locker = g_rw_lock_reader_locker_new (&self->silo_lock);
-	if (!gs_appstream_search (self->plugin, self->silo, values, list_tmp,
+	if (!gs_appstream_search (self->plugin, self->silo, self->search_index,
+				  values, list_tmp,
 				  cancellable, error))
 		return FALSE;
 
@@ -3026,7 +3220,7 @@ gs_flatpak_search (GsFlatpak *self,
 			continue;
 		}
 
-		if (!gs_appstream_search (self->plugin, app_silo, values, app_list_tmp,
+		if (!gs_appstream_search (self->plugin, app_silo, NULL, values, app_list_tmp,
 					  cancellable, error))
 			return FALSE;
 
@@ -3206,11 +3400,15 @@ gs_flatpak_finalize (GObject *object)
 	}
 	if (self->silo != NULL)
 		g_object_unref (self->silo);
+	g_clear_pointer (&self->search_index, gs_appstream_search_index_free);
 
 	g_free (self->id);
 	g_object_unref (self->installation);
 	g_clear_pointer (&self->installed_refs, g_ptr_array_unref);
+	g_clear_pointer (&self->installed_refs_index, g_hash_table_unref);
 	g_mutex_clear (&self->installed_refs_mutex);
+	g_hash_table_unref (self->remotes);
+	g_mutex_clear (&self->remotes_mutex);
 	g_object_unref (self->plugin);
 	g_hash_table_unref (self->broken_remotes);
 	g_mutex_clear (&self->broken_remotes_mutex);
@@ -3237,6 +3435,9 @@ gs_flatpak_init (GsFlatpak *self)
 
 	g_mutex_init (&self->installed_refs_mutex);
 	self->installed_refs = NULL;
+	g_mutex_init (&self->remotes_mutex);
+	self->remotes = g_hash_table_new_full (g_str_hash, g_str_equal,
+					       g_free, g_object_unref);
 	g_mutex_init (&self->broken_remotes_mutex);
 	self->broken_remotes = g_hash_table_new_full (g_str_hash, g_str_equal,
 						      g_free, NULL);
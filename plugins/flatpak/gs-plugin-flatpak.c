@@ -52,6 +52,9 @@ gs_plugin_initialize (GsPlugin *plugin)
 	/* prioritize over packages */
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_BETTER_THAN, "packagekit");
 
+	/* results are built in a temporary list for each installation */
+	gs_plugin_add_flags (plugin, GS_PLUGIN_FLAGS_PARALLEL_RESULTS);
+
 	/* set name of MetaInfo file */
 	gs_plugin_set_appstream_id (plugin, "org.ubuntuunity.software.Plugin.Flatpak");
 
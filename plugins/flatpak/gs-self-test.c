@@ -1033,6 +1033,18 @@ gs_plugins_flatpak_broken_remote_func (GsPluginLoader *plugin_loader)
 	g_assert_true (ret);
 }
 
+static void
+silo_compile_log_cb (const gchar *log_domain,
+		     GLogLevelFlags log_level,
+		     const gchar *message,
+		     gpointer user_data)
+{
+	gint *n_compiles = (gint *) user_data;
+	if (g_str_has_prefix (message, "building app silo for "))
+		g_atomic_int_inc (n_compiles);
+	g_log_default_handler (log_domain, log_level, message, NULL);
+}
+
 static void
 flatpak_bundle_or_ref_helper (GsPluginLoader *plugin_loader,
                               gboolean        is_bundle)
@@ -1248,6 +1260,35 @@ flatpak_bundle_or_ref_helper (GsPluginLoader *plugin_loader,
 			  "user/flatpak/test-1/desktop/org.test.Chiron/master"));
 	}
 
+	/* the silo built from the installed appdata is reused */
+	if (is_bundle) {
+		const guint n_loops = 50;
+		gint n_compiles = 0;
+		guint log_handler;
+		g_autoptr(GTimer) timer = g_timer_new ();
+		log_handler = g_log_set_handler (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
+						 silo_compile_log_cb,
+						 &n_compiles);
+		for (guint i = 0; i < n_loops; i++) {
+			g_autoptr(GsApp) app_loop = NULL;
+			g_autoptr(GsPluginJob) plugin_job_loop = NULL;
+			plugin_job_loop = gs_plugin_job_newv (GS_PLUGIN_ACTION_FILE_TO_APP,
+							      "file", file,
+							      "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_VERSION,
+							      NULL);
+			app_loop = gs_plugin_loader_job_process_app (plugin_loader, plugin_job_loop, NULL, &error);
+			g_assert_no_error (error);
+			g_assert_true (app_loop != NULL);
+			g_assert_cmpstr (gs_app_get_version (app_loop), ==, "1.2.3");
+		}
+		g_log_remove_handler (G_LOG_DOMAIN, log_handler);
+		g_print ("%.2fms per file-to-app ",
+			 g_timer_elapsed (timer, NULL) * 1000 / n_loops);
+
+		/* only the first conversion may have to build the silo */
+		g_assert_cmpint (g_atomic_int_get (&n_compiles), <=, 1);
+	}
+
 	/* remove app */
 	g_object_unref (plugin_job);
 	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REMOVE,
@@ -96,6 +96,9 @@ gs_plugin_initialize (GsPlugin *plugin)
 	GsPluginData *priv = gs_plugin_alloc_data (plugin, sizeof(GsPluginData));
 	priv->client = fwupd_client_new ();
 
+	/* results only come from fwupd */
+	gs_plugin_add_flags (plugin, GS_PLUGIN_FLAGS_PARALLEL_RESULTS);
+
 	/* set name of MetaInfo file */
 	gs_plugin_set_appstream_id (plugin, "org.ubuntuunity.software.Plugin.Fwupd");
 }
@@ -10,6 +10,7 @@
 #include <config.h>
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <unity-software.h>
 #include <json-glib/json-glib.h>
 #include <string.h>
@@ -20,92 +21,36 @@
  * Provides review data from the Open Desktop Ratings Serice.
  */
 
-#if !GLIB_CHECK_VERSION(2, 62, 0)
-typedef struct
-{
-  guint8 *data;
-  guint   len;
-  guint   alloc;
-  guint   elt_size;
-  guint   zero_terminated : 1;
-  guint   clear : 1;
-  gatomicrefcount ref_count;
-  GDestroyNotify clear_func;
-} GRealArray;
-
-gboolean
-g_array_binary_search (GArray        *array,
-                       gconstpointer  target,
-                       GCompareFunc   compare_func,
-                       guint         *out_match_index)
-{
-  gboolean result = FALSE;
-  GRealArray *_array = (GRealArray *) array;
-  guint left, middle, right;
-  gint val;
-
-  g_return_val_if_fail (_array != NULL, FALSE);
-  g_return_val_if_fail (compare_func != NULL, FALSE);
-
-  if (G_LIKELY(_array->len))
-    {
-      left = 0;
-      right = _array->len - 1;
-
-      while (left <= right)
-        {
-          middle = left + (right - left) / 2;
-
-          val = compare_func (_array->data + (_array->elt_size * middle), target);
-          if (val == 0)
-            {
-              result = TRUE;
-              break;
-            }
-          else if (val < 0)
-            left = middle + 1;
-          else if (/* val > 0 && */ middle > 0)
-            right = middle - 1;
-          else
-            break;  /* element not found */
-        }
-    }
-
-  if (result && out_match_index != NULL)
-    *out_match_index = middle;
-
-  return result;
-}
-#endif  /* glib < 2.62.0 */
-
 #define ODRS_REVIEW_CACHE_AGE_MAX		237000 /* 1 week */
 #define ODRS_REVIEW_NUMBER_RESULTS_MAX		20
 
-/* Element in priv->ratings, all allocated in one big block and sorted
- * alphabetically to reduce the number of allocations and fragmentation. */
+/* The ratings are compiled from ratings.json into ratings.bin, which is mapped
+ * into memory and searched in place. The file is a GsOdrsRatingsHeader,
+ * followed by n_ratings GsOdrsRating rows sorted by app ID, followed by a pool
+ * of NUL-terminated app IDs which the rows point into. */
+#define ODRS_RATINGS_MAGIC			0x5352444f /* "ODRS" */
+#define ODRS_RATINGS_VERSION			1
+
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	guint32 n_ratings;
+	guint32 pool_size;
+	guint64 json_size;  /* of the ratings.json this was compiled from */
+	guint64 json_mtime;
+} GsOdrsRatingsHeader;
+
 typedef struct {
-	gchar *app_id;  /* (owned) */
+	guint32 app_id;  /* offset into the string pool */
 	guint32 n_star_ratings[6];
 } GsOdrsRating;
 
-static int
-rating_compare (const GsOdrsRating *a, const GsOdrsRating *b)
-{
-	return g_strcmp0 (a->app_id, b->app_id);
-}
-
-static void
-rating_clear (GsOdrsRating *rating)
-{
-	g_free (rating->app_id);
-}
-
 struct GsPluginData {
 	GSettings		*settings;
 	gchar			*distro;
 	gchar			*user_hash;
 	gchar			*review_server;
-	GArray			*ratings;  /* (element-type GsOdrsRating) (mutex ratings_mutex) (owned) (nullable) */
+	GMappedFile		*ratings;  /* (mutex ratings_mutex) (owned) (nullable) */
 	GMutex			 ratings_mutex;
 	GsApp			*cached_origin;
 };
@@ -162,8 +107,19 @@ gs_plugin_initialize (GsPlugin *plugin)
 	gs_plugin_set_appstream_id (plugin, "org.ubuntuunity.software.Plugin.Odrs");
 }
 
+typedef struct {
+	const gchar *app_id;  /* (not owned) */
+	guint32 n_star_ratings[6];
+} GsOdrsRatingJson;
+
+static int
+rating_json_compare (const GsOdrsRatingJson *a, const GsOdrsRatingJson *b)
+{
+	return g_strcmp0 (a->app_id, b->app_id);
+}
+
 static gboolean
-gs_plugin_odrs_load_ratings_for_app (JsonObject *json_app, const gchar *app_id, GsOdrsRating *rating_out)
+gs_plugin_odrs_load_ratings_for_app (JsonObject *json_app, const gchar *app_id, GsOdrsRatingJson *rating_out)
 {
 	guint i;
 	const gchar *names[] = { "star0", "star1", "star2", "star3",
@@ -175,15 +131,47 @@ gs_plugin_odrs_load_ratings_for_app (JsonObject *json_app, const gchar *app_id,
 		rating_out->n_star_ratings[i] = (guint64) json_object_get_int_member (json_app, names[i]);
 	}
 
-	rating_out->app_id = g_strdup (app_id);
+	rating_out->app_id = app_id;
 
 	return TRUE;
 }
 
+static const GsOdrsRatingsHeader *
+gs_plugin_odrs_ratings_get_header (GMappedFile *mapped_file)
+{
+	const GsOdrsRatingsHeader *header;
+	const GsOdrsRating *rows;
+	gsize len = g_mapped_file_get_length (mapped_file);
+	const gchar *data = g_mapped_file_get_contents (mapped_file);
+
+	/* the checks here mean the table can be searched without checking
+	 * any of the offsets again */
+	if (len < sizeof(GsOdrsRatingsHeader))
+		return NULL;
+	header = (const GsOdrsRatingsHeader *) data;
+	if (header->magic != ODRS_RATINGS_MAGIC ||
+	    header->version != ODRS_RATINGS_VERSION)
+		return NULL;
+	if (header->pool_size == 0 ||
+	    (guint64) header->n_ratings * sizeof(GsOdrsRating) +
+	    header->pool_size + sizeof(GsOdrsRatingsHeader) != len)
+		return NULL;
+	if (data[len - 1] != '\0')
+		return NULL;
+	rows = (const GsOdrsRating *) (data + sizeof(GsOdrsRatingsHeader));
+	for (guint i = 0; i < header->n_ratings; i++) {
+		if (rows[i].app_id >= header->pool_size)
+			return NULL;
+	}
+	return header;
+}
+
 static gboolean
-gs_plugin_odrs_load_ratings (GsPlugin *plugin, const gchar *fn, GError **error)
+gs_plugin_odrs_compile_ratings (const gchar *fn,
+				const gchar *fn_bin,
+				GStatBuf *json_stat,
+				GError **error)
 {
-	GsPluginData *priv = gs_plugin_get_data (plugin);
 	JsonNode *json_root;
 	JsonObject *json_item;
 	g_autoptr(JsonParser) json_parser = NULL;
@@ -191,7 +179,9 @@ gs_plugin_odrs_load_ratings (GsPlugin *plugin, const gchar *fn, GError **error)
 	JsonNode *json_app_node;
 	JsonObjectIter iter;
 	g_autoptr(GArray) new_ratings = NULL;
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GByteArray) buf = NULL;
+	g_autoptr(GString) pool = NULL;
+	GsOdrsRatingsHeader header = { 0, };
 
 	/* parse the data and find the success */
 	json_parser = json_parser_new_immutable ();
@@ -223,14 +213,13 @@ gs_plugin_odrs_load_ratings (GsPlugin *plugin, const gchar *fn, GError **error)
 
 	new_ratings = g_array_sized_new (FALSE,  /* don’t zero-terminate */
 					 FALSE,  /* don’t clear */
-					 sizeof (GsOdrsRating),
+					 sizeof (GsOdrsRatingJson),
 					 json_object_get_size (json_item));
-	g_array_set_clear_func (new_ratings, (GDestroyNotify) rating_clear);
 
 	/* parse each app */
 	json_object_iter_init (&iter, json_item);
 	while (json_object_iter_next (&iter, &app_id, &json_app_node)) {
-		GsOdrsRating rating;
+		GsOdrsRatingJson rating;
 		JsonObject *json_app;
 
 		if (!JSON_NODE_HOLDS_OBJECT (json_app_node))
@@ -241,13 +230,102 @@ gs_plugin_odrs_load_ratings (GsPlugin *plugin, const gchar *fn, GError **error)
 			g_array_append_val (new_ratings, rating);
 	}
 
-	/* Allow for binary searches later. */
-	g_array_sort (new_ratings, (GCompareFunc) rating_compare);
+	/* allow for binary searches later */
+	g_array_sort (new_ratings, (GCompareFunc) rating_json_compare);
+
+	/* rows, then the string pool */
+	header.magic = ODRS_RATINGS_MAGIC;
+	header.version = ODRS_RATINGS_VERSION;
+	header.n_ratings = new_ratings->len;
+	header.json_size = (guint64) json_stat->st_size;
+	header.json_mtime = (guint64) json_stat->st_mtime;
+	buf = g_byte_array_sized_new (sizeof(GsOdrsRatingsHeader) +
+				      new_ratings->len * sizeof(GsOdrsRating));
+	g_byte_array_set_size (buf, sizeof(GsOdrsRatingsHeader));
+	pool = g_string_new (NULL);
+	for (guint i = 0; i < new_ratings->len; i++) {
+		GsOdrsRatingJson *rating_json = &g_array_index (new_ratings, GsOdrsRatingJson, i);
+		GsOdrsRating rating;
+		rating.app_id = (guint32) pool->len;
+		memcpy (rating.n_star_ratings, rating_json->n_star_ratings,
+			sizeof(rating.n_star_ratings));
+		g_byte_array_append (buf, (const guint8 *) &rating, sizeof(rating));
+		g_string_append_len (pool, rating_json->app_id,
+				     (gssize) strlen (rating_json->app_id) + 1);
+	}
+	if (pool->len == 0)
+		g_string_append_c (pool, '\0');
+	header.pool_size = (guint32) pool->len;
+	memcpy (buf->data, &header, sizeof(header));
+	g_byte_array_append (buf, (const guint8 *) pool->str, (guint) pool->len);
+
+	/* this is atomic, so the old table can stay mapped */
+	if (!g_file_set_contents (fn_bin, (const gchar *) buf->data,
+				  (gssize) buf->len, error)) {
+		gs_utils_error_convert_appstream (error);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean
+gs_plugin_odrs_load_ratings (GsPlugin *plugin, const gchar *fn, GError **error)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	const GsOdrsRatingsHeader *header = NULL;
+	g_autofree gchar *fn_bin = NULL;
+	g_autofree gchar *dirname = NULL;
+	g_autoptr(GMappedFile) mapped_file = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+	GStatBuf json_stat;
+
+	if (g_stat (fn, &json_stat) != 0) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_FAILED,
+			     "failed to stat %s", fn);
+		return FALSE;
+	}
+
+	/* use the compiled table if it matches the JSON */
+	dirname = g_path_get_dirname (fn);
+	fn_bin = g_build_filename (dirname, "ratings.bin", NULL);
+	mapped_file = g_mapped_file_new (fn_bin, FALSE, NULL);
+	if (mapped_file != NULL) {
+		header = gs_plugin_odrs_ratings_get_header (mapped_file);
+		if (header != NULL &&
+		    (header->json_size != (guint64) json_stat.st_size ||
+		     header->json_mtime != (guint64) json_stat.st_mtime))
+			header = NULL;
+	}
+
+	/* otherwise parse the JSON once and write the table */
+	if (header == NULL) {
+		g_debug ("compiling %s to %s", fn, fn_bin);
+		g_clear_pointer (&mapped_file, g_mapped_file_unref);
+		if (!gs_plugin_odrs_compile_ratings (fn, fn_bin, &json_stat, error))
+			return FALSE;
+		mapped_file = g_mapped_file_new (fn_bin, FALSE, error);
+		if (mapped_file == NULL) {
+			gs_utils_error_convert_appstream (error);
+			return FALSE;
+		}
+		if (gs_plugin_odrs_ratings_get_header (mapped_file) == NULL) {
+			g_set_error (error,
+				     GS_PLUGIN_ERROR,
+				     GS_PLUGIN_ERROR_INVALID_FORMAT,
+				     "failed to load %s", fn_bin);
+			return FALSE;
+		}
+	}
 
 	/* Update the shared state */
 	locker = g_mutex_locker_new (&priv->ratings_mutex);
-	g_clear_pointer (&priv->ratings, g_array_unref);
-	priv->ratings = g_steal_pointer (&new_ratings);
+	g_clear_pointer (&priv->ratings, g_mapped_file_unref);
+	priv->ratings = g_steal_pointer (&mapped_file);
+
+	/* apps refined before the ratings were loaded have none */
+	gs_plugin_refine_data_changed (plugin);
 
 	return TRUE;
 }
@@ -314,7 +392,7 @@ gs_plugin_destroy (GsPlugin *plugin)
 	g_free (priv->user_hash);
 	g_free (priv->distro);
 	g_free (priv->review_server);
-	g_clear_pointer (&priv->ratings, g_array_unref);
+	g_clear_pointer (&priv->ratings, g_mapped_file_unref);
 	g_object_unref (priv->settings);
 	g_object_unref (priv->cached_origin);
 	g_mutex_clear (&priv->ratings_mutex);
@@ -610,6 +688,10 @@ gs_plugin_odrs_refine_ratings (GsPlugin *plugin,
 	g_autoptr(GArray) review_ratings = NULL;
 	g_autoptr(GPtrArray) reviewable_ids = NULL;
 	g_autoptr(GMutexLocker) locker = NULL;
+	const gchar *data;
+	const gchar *pool;
+	const GsOdrsRatingsHeader *header;
+	const GsOdrsRating *rows;
 
 	/* get ratings for each reviewable ID */
 	reviewable_ids = _gs_app_get_reviewable_ids (app);
@@ -619,18 +701,33 @@ gs_plugin_odrs_refine_ratings (GsPlugin *plugin,
 	if (priv->ratings == NULL)
 		return TRUE;
 
+	/* validated when it was loaded */
+	data = g_mapped_file_get_contents (priv->ratings);
+	header = (const GsOdrsRatingsHeader *) data;
+	rows = (const GsOdrsRating *) (data + sizeof(GsOdrsRatingsHeader));
+	pool = (const gchar *) (rows + header->n_ratings);
+
 	for (guint i = 0; i < reviewable_ids->len; i++) {
 		const gchar *id = g_ptr_array_index (reviewable_ids, i);
-		const GsOdrsRating search_rating = { id, { 0, }};
-		guint found_index;
-		const GsOdrsRating *found_rating;
-
-		if (!g_array_binary_search (priv->ratings, &search_rating,
-					    (GCompareFunc) rating_compare, &found_index))
+		const GsOdrsRating *found_rating = NULL;
+		guint left = 0;
+		guint right = header->n_ratings;
+
+		while (left < right) {
+			guint middle = left + (right - left) / 2;
+			gint val = g_strcmp0 (pool + rows[middle].app_id, id);
+			if (val == 0) {
+				found_rating = &rows[middle];
+				break;
+			}
+			if (val < 0)
+				left = middle + 1;
+			else
+				right = middle;
+		}
+		if (found_rating == NULL)
 			continue;
 
-		found_rating = &g_array_index (priv->ratings, GsOdrsRating, found_index);
-
 		/* copy into accumulator array */
 		for (guint j = 0; j < 6; j++)
 			ratings_raw[j] += found_rating->n_star_ratings[j];
@@ -0,0 +1,190 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2016-2018 Gautham Nair <gautham.nair.2005@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gs-packagekit-client-pool.h"
+
+/*
+ * A PkClient can only run one synchronous transaction at a time, so plugins
+ * used to share a single client behind a mutex. packagekitd is happy to run
+ * several read-only transactions at once though, so this hands out one
+ * client per transaction instead, up to a limit. Transactions that change
+ * the system still go through each plugin's own PkTask.
+ */
+
+struct _GsPackagekitClientPool {
+	GObject			 parent_instance;
+	GMutex			 mutex;
+	GCond			 cond;
+	GPtrArray		*clients;	/* of PkClient, all of them */
+	GPtrArray		*idle;		/* of PkClient, not owned */
+	GHashTable		*busy;		/* of PkClient, not owned */
+	guint			 max_clients;
+};
+
+G_DEFINE_TYPE (GsPackagekitClientPool, gs_packagekit_client_pool, G_TYPE_OBJECT)
+
+static void
+gs_packagekit_client_pool_reset_client (PkClient *client)
+{
+	pk_client_set_background (client, FALSE);
+	pk_client_set_cache_age (client, G_MAXUINT);
+}
+
+static void
+gs_packagekit_client_pool_cancelled_cb (GCancellable *cancellable,
+					GsPackagekitClientPool *self)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->mutex);
+	g_cond_broadcast (&self->cond);
+}
+
+/**
+ * gs_packagekit_client_pool_acquire:
+ * @self: a #GsPackagekitClientPool
+ * @what: a description for debugging, e.g. "resolve"
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Borrows a client for one read-only transaction, blocking until one is
+ * available. The client is set up to run in the foreground with an unlimited
+ * cache age, and any changes to that are undone when it is released.
+ *
+ * Returns: (transfer none): a #PkClient, or %NULL if @cancellable was cancelled
+ **/
+PkClient *
+gs_packagekit_client_pool_acquire (GsPackagekitClientPool *self,
+				   const gchar *what,
+				   GCancellable *cancellable,
+				   GError **error)
+{
+	PkClient *client = NULL;
+	gint64 begin = g_get_monotonic_time ();
+	gint64 waited;
+	gulong cancelled_id = 0;
+
+	/* wake the waiting thread if the caller gives up; this has to be
+	 * connected without the mutex held as it may be called right away */
+	if (cancellable != NULL) {
+		cancelled_id = g_cancellable_connect (cancellable,
+						      G_CALLBACK (gs_packagekit_client_pool_cancelled_cb),
+						      self, NULL);
+	}
+
+	g_mutex_lock (&self->mutex);
+	while (!g_cancellable_is_cancelled (cancellable)) {
+		if (self->idle->len > 0) {
+			client = g_ptr_array_index (self->idle, self->idle->len - 1);
+			g_ptr_array_remove_index (self->idle, self->idle->len - 1);
+			break;
+		}
+		if (self->clients->len < self->max_clients) {
+			client = pk_client_new ();
+			gs_packagekit_client_pool_reset_client (client);
+			g_ptr_array_add (self->clients, client);
+			break;
+		}
+		g_cond_wait (&self->cond, &self->mutex);
+	}
+	if (client != NULL) {
+		g_hash_table_add (self->busy, client);
+
+		/* make contention visible */
+		waited = g_get_monotonic_time () - begin;
+		if (waited >= G_TIME_SPAN_MILLISECOND) {
+			g_debug ("waited %" G_GINT64_FORMAT "ms for a client to %s "
+				 "(%u transactions running)",
+				 waited / G_TIME_SPAN_MILLISECOND, what,
+				 g_hash_table_size (self->busy));
+		}
+	}
+	g_mutex_unlock (&self->mutex);
+
+	/* the callback takes the mutex, so this must be done after unlocking */
+	g_cancellable_disconnect (cancellable, cancelled_id);
+	if (client == NULL) {
+		g_cancellable_set_error_if_cancelled (cancellable, error);
+		gs_utils_error_convert_gio (error);
+	}
+	return client;
+}
+
+/**
+ * gs_packagekit_client_pool_release:
+ * @self: a #GsPackagekitClientPool
+ * @client: a #PkClient returned by gs_packagekit_client_pool_acquire()
+ *
+ * Returns a client to the pool so another transaction can use it.
+ **/
+void
+gs_packagekit_client_pool_release (GsPackagekitClientPool *self, PkClient *client)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->mutex);
+
+	if (!g_hash_table_remove (self->busy, client)) {
+		g_critical ("client %p was not acquired from this pool", client);
+		return;
+	}
+	gs_packagekit_client_pool_reset_client (client);
+	g_ptr_array_add (self->idle, client);
+	g_cond_broadcast (&self->cond);
+}
+
+static void
+gs_packagekit_client_pool_finalize (GObject *object)
+{
+	GsPackagekitClientPool *self = GS_PACKAGEKIT_CLIENT_POOL (object);
+
+	g_warn_if_fail (g_hash_table_size (self->busy) == 0);
+	g_hash_table_unref (self->busy);
+	g_ptr_array_unref (self->idle);
+	g_ptr_array_unref (self->clients);
+	g_cond_clear (&self->cond);
+	g_mutex_clear (&self->mutex);
+
+	G_OBJECT_CLASS (gs_packagekit_client_pool_parent_class)->finalize (object);
+}
+
+static void
+gs_packagekit_client_pool_class_init (GsPackagekitClientPoolClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gs_packagekit_client_pool_finalize;
+}
+
+static void
+gs_packagekit_client_pool_init (GsPackagekitClientPool *self)
+{
+	g_mutex_init (&self->mutex);
+	g_cond_init (&self->cond);
+	self->clients = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	self->idle = g_ptr_array_new ();
+	self->busy = g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+/**
+ * gs_packagekit_client_pool_new:
+ * @max_clients: the maximum number of transactions to run at once
+ *
+ * Creates a pool of clients for read-only queries, which may use all of the
+ * clients at once.
+ *
+ * Returns: a #GsPackagekitClientPool
+ **/
+GsPackagekitClientPool *
+gs_packagekit_client_pool_new (guint max_clients)
+{
+	GsPackagekitClientPool *self;
+	g_return_val_if_fail (max_clients > 0, NULL);
+	self = g_object_new (GS_TYPE_PACKAGEKIT_CLIENT_POOL, NULL);
+	self->max_clients = max_clients;
+	return self;
+}
@@ -0,0 +1,32 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2016-2018 Gautham Nair <gautham.nair.2005@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <unity-software.h>
+#include <packagekit-glib2/packagekit.h>
+
+G_BEGIN_DECLS
+
+/* enough for a few jobs to refine at once without flooding packagekitd */
+#define GS_PACKAGEKIT_CLIENT_POOL_SIZE	4
+
+#define GS_TYPE_PACKAGEKIT_CLIENT_POOL (gs_packagekit_client_pool_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsPackagekitClientPool, gs_packagekit_client_pool, GS, PACKAGEKIT_CLIENT_POOL, GObject)
+
+GsPackagekitClientPool *gs_packagekit_client_pool_new	(guint			 max_clients);
+PkClient	*gs_packagekit_client_pool_acquire	(GsPackagekitClientPool	*self,
+							 const gchar		*what,
+							 GCancellable		*cancellable,
+							 GError			**error);
+void		 gs_packagekit_client_pool_release	(GsPackagekitClientPool	*self,
+							 PkClient		*client);
+
+G_END_DECLS
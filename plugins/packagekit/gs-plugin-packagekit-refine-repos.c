@@ -11,6 +11,7 @@
 #include <packagekit-glib2/packagekit.h>
 #include <unity-software.h>
 
+#include "gs-packagekit-client-pool.h"
 #include "gs-packagekit-helper.h"
 #include "packagekit-common.h"
 
@@ -24,8 +25,7 @@
  */
 
 struct GsPluginData {
-	PkClient	*client;
-	GMutex		 client_mutex;
+	GsPackagekitClientPool	*client_pool;
 };
 
 void
@@ -33,10 +33,7 @@ gs_plugin_initialize (GsPlugin *plugin)
 {
 	GsPluginData *priv = gs_plugin_alloc_data (plugin, sizeof(GsPluginData));
 
-	g_mutex_init (&priv->client_mutex);
-	priv->client = pk_client_new ();
-	pk_client_set_background (priv->client, FALSE);
-	pk_client_set_cache_age (priv->client, G_MAXUINT);
+	priv->client_pool = gs_packagekit_client_pool_new (GS_PACKAGEKIT_CLIENT_POOL_SIZE);
 
 	/* need repos::repo-filename */
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_RUN_AFTER, "repos");
@@ -46,8 +43,7 @@ void
 gs_plugin_destroy (GsPlugin *plugin)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
-	g_mutex_clear (&priv->client_mutex);
-	g_object_unref (priv->client);
+	g_object_unref (priv->client_pool);
 }
 
 static gboolean
@@ -58,6 +54,7 @@ gs_plugin_packagekit_refine_repo_from_filename (GsPlugin *plugin,
                                                 GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 	const gchar *to_array[] = { NULL, NULL };
 	g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
 	g_autoptr(PkResults) results = NULL;
@@ -65,14 +62,17 @@ gs_plugin_packagekit_refine_repo_from_filename (GsPlugin *plugin,
 
 	to_array[0] = filename;
 	gs_packagekit_helper_add_app (helper, app);
-	g_mutex_lock (&priv->client_mutex);
-	results = pk_client_search_files (priv->client,
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "search-files", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_search_files (client,
 	                                  pk_bitfield_from_enums (PK_FILTER_ENUM_INSTALLED, -1),
 	                                  (gchar **) to_array,
 	                                  cancellable,
 	                                  gs_packagekit_helper_cb, helper,
 	                                  error);
-	g_mutex_unlock (&priv->client_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 	if (!gs_plugin_packagekit_results_valid (results, error)) {
 		g_prefix_error (error, "failed to search file %s: ", filename);
 		return FALSE;
@@ -13,6 +13,7 @@
 #include <unity-software.h>
 
 #include "gs-markdown.h"
+#include "gs-packagekit-client-pool.h"
 #include "gs-packagekit-helper.h"
 #include "packagekit-common.h"
 
@@ -27,8 +28,7 @@
 
 struct GsPluginData {
 	PkControl		*control;
-	PkClient		*client;
-	GMutex			 client_mutex;
+	GsPackagekitClientPool	*client_pool;
 };
 
 static void
@@ -48,15 +48,12 @@ gs_plugin_initialize (GsPlugin *plugin)
 {
 	GsPluginData *priv = gs_plugin_alloc_data (plugin, sizeof(GsPluginData));
 
-	g_mutex_init (&priv->client_mutex);
-	priv->client = pk_client_new ();
+	priv->client_pool = gs_packagekit_client_pool_new (GS_PACKAGEKIT_CLIENT_POOL_SIZE);
 	priv->control = pk_control_new ();
 	g_signal_connect (priv->control, "updates-changed",
 			  G_CALLBACK (gs_plugin_packagekit_updates_changed_cb), plugin);
 	g_signal_connect (priv->control, "repo-list-changed",
 			  G_CALLBACK (gs_plugin_packagekit_repo_list_changed_cb), plugin);
-	pk_client_set_background (priv->client, FALSE);
-	pk_client_set_cache_age (priv->client, G_MAXUINT);
 
 	/* need pkgname and ID */
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_RUN_AFTER, "appstream");
@@ -67,8 +64,7 @@ void
 gs_plugin_destroy (GsPlugin *plugin)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
-	g_mutex_clear (&priv->client_mutex);
-	g_object_unref (priv->client);
+	g_object_unref (priv->client_pool);
 	g_object_unref (priv->control);
 }
 
@@ -91,6 +87,7 @@ gs_plugin_packagekit_resolve_packages_with_filter (GsPlugin *plugin,
                                                    GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 	GPtrArray *sources;
 	GsApp *app;
 	const gchar *pkgname;
@@ -100,6 +97,7 @@ gs_plugin_packagekit_resolve_packages_with_filter (GsPlugin *plugin,
 	g_autoptr(PkResults) results = NULL;
 	g_autoptr(GPtrArray) package_ids = NULL;
 	g_autoptr(GPtrArray) packages = NULL;
+	g_autoptr(GHashTable) packages_by_name = NULL;
 
 	package_ids = g_ptr_array_new_with_free_func (g_free);
 	for (i = 0; i < gs_app_list_length (list); i++) {
@@ -121,14 +119,17 @@ gs_plugin_packagekit_resolve_packages_with_filter (GsPlugin *plugin,
 	g_ptr_array_add (package_ids, NULL);
 
 	/* resolve them all at once */
-	g_mutex_lock (&priv->client_mutex);
-	results = pk_client_resolve (priv->client,
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "resolve", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_resolve (client,
 				     filter,
 				     (gchar **) package_ids->pdata,
 				     cancellable,
 				     gs_packagekit_helper_cb, helper,
 				     error);
-	g_mutex_unlock (&priv->client_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 	if (!gs_plugin_packagekit_results_valid (results, error)) {
 		g_prefix_error (error, "failed to resolve package_ids: ");
 		return FALSE;
@@ -144,11 +145,12 @@ gs_plugin_packagekit_resolve_packages_with_filter (GsPlugin *plugin,
 		return FALSE;
 	}
 
+	packages_by_name = gs_plugin_packagekit_packages_array_to_hash (packages);
 	for (i = 0; i < gs_app_list_length (list); i++) {
 		app = gs_app_list_index (list, i);
 		if (gs_app_get_local_file (app) != NULL)
 			continue;
-		gs_plugin_packagekit_resolve_packages_app (plugin, packages, app);
+		gs_plugin_packagekit_resolve_packages_app (plugin, packages_by_name, app);
 	}
 	return TRUE;
 }
@@ -199,41 +201,138 @@ gs_plugin_packagekit_resolve_packages (GsPlugin *plugin,
 
 static gboolean
 gs_plugin_packagekit_refine_from_desktop (GsPlugin *plugin,
-					  GsApp *app,
-					  const gchar *filename,
+					  GHashTable *apps_by_filename,
 					  GCancellable *cancellable,
 					  GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
-	const gchar *to_array[] = { NULL, NULL };
+	PkClient *client;
+	GHashTableIter iter;
+	gpointer key, value;
+	guint n_filenames = 0;
+	g_autofree gchar **filenames = NULL;
 	g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
 	g_autoptr(PkResults) results = NULL;
 	g_autoptr(GPtrArray) packages = NULL;
+	g_autoptr(GHashTable) packages_by_filename = NULL;
+	g_autoptr(GHashTable) packages_by_id = NULL;
+	g_autoptr(GPtrArray) package_ids = NULL;
 
-	to_array[0] = filename;
-	gs_packagekit_helper_add_app (helper, app);
-	g_mutex_lock (&priv->client_mutex);
-	results = pk_client_search_files (priv->client,
+	filenames = (gchar **) g_hash_table_get_keys_as_array (apps_by_filename, &n_filenames);
+	if (n_filenames == 0)
+		return TRUE;
+	g_hash_table_iter_init (&iter, apps_by_filename);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GPtrArray *apps = value;
+		for (guint i = 0; i < apps->len; i++)
+			gs_packagekit_helper_add_app (helper, g_ptr_array_index (apps, i));
+	}
+
+	/* find all the packages owning any of the files in one go */
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "search-files", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_search_files (client,
 					  pk_bitfield_from_enums (PK_FILTER_ENUM_INSTALLED, -1),
-					  (gchar **) to_array,
+					  filenames,
 					  cancellable,
 					  gs_packagekit_helper_cb, helper,
 					  error);
-	g_mutex_unlock (&priv->client_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 	if (!gs_plugin_packagekit_results_valid (results, error)) {
-		g_prefix_error (error, "failed to search file %s: ", filename);
+		g_prefix_error (error, "failed to search %u files: ", n_filenames);
 		return FALSE;
 	}
-
-	/* get results */
 	packages = pk_results_get_package_array (results);
-	if (packages->len == 1) {
-		PkPackage *package;
-		package = g_ptr_array_index (packages, 0);
-		gs_plugin_packagekit_set_metadata_from_package (plugin, app, package);
-	} else {
-		g_warning ("Failed to find one package for %s, %s, [%u]",
-			   gs_app_get_id (app), filename, packages->len);
+
+	/* backends may report a package once for each file it owns */
+	packages_by_id = g_hash_table_new (g_str_hash, g_str_equal);
+	package_ids = g_ptr_array_new ();
+	for (guint i = 0; i < packages->len; i++) {
+		PkPackage *package = g_ptr_array_index (packages, i);
+		const gchar *package_id = pk_package_get_id (package);
+		if (g_hash_table_contains (packages_by_id, package_id))
+			continue;
+		g_hash_table_insert (packages_by_id, (gpointer) package_id, package);
+		g_ptr_array_add (package_ids, (gpointer) package_id);
+	}
+
+	/* map each file back to the packages that own it */
+	packages_by_filename = g_hash_table_new_full (g_str_hash, g_str_equal,
+						      g_free, (GDestroyNotify) g_ptr_array_unref);
+	if (n_filenames == 1) {
+		GPtrArray *owners = g_ptr_array_new ();
+		for (guint i = 0; i < package_ids->len; i++) {
+			g_ptr_array_add (owners,
+					 g_hash_table_lookup (packages_by_id,
+							      g_ptr_array_index (package_ids, i)));
+		}
+		g_hash_table_insert (packages_by_filename,
+				     g_strdup (filenames[0]), owners);
+	} else if (package_ids->len > 0) {
+		g_autoptr(PkResults) results_files = NULL;
+		g_autoptr(GPtrArray) files = NULL;
+
+		g_ptr_array_add (package_ids, NULL);
+
+		client = gs_packagekit_client_pool_acquire (priv->client_pool,
+							    "get-files", cancellable, error);
+		if (client == NULL)
+			return FALSE;
+		results_files = pk_client_get_files (client,
+						     (gchar **) package_ids->pdata,
+						     cancellable,
+						     gs_packagekit_helper_cb, helper,
+						     error);
+		gs_packagekit_client_pool_release (priv->client_pool, client);
+		if (!gs_plugin_packagekit_results_valid (results_files, error)) {
+			g_prefix_error (error, "failed to get files for %u packages: ",
+					package_ids->len - 1);
+			return FALSE;
+		}
+		files = pk_results_get_files_array (results_files);
+		for (guint i = 0; i < files->len; i++) {
+			PkFiles *item = g_ptr_array_index (files, i);
+			gchar **fns = pk_files_get_files (item);
+			PkPackage *package;
+
+			package = g_hash_table_lookup (packages_by_id,
+						       pk_files_get_package_id (item));
+			if (package == NULL)
+				continue;
+			for (guint j = 0; fns != NULL && fns[j] != NULL; j++) {
+				GPtrArray *owners;
+				if (!g_hash_table_contains (apps_by_filename, fns[j]))
+					continue;
+				owners = g_hash_table_lookup (packages_by_filename, fns[j]);
+				if (owners == NULL) {
+					owners = g_ptr_array_new ();
+					g_hash_table_insert (packages_by_filename,
+							     g_strdup (fns[j]), owners);
+				}
+				if (!g_ptr_array_find (owners, package, NULL))
+					g_ptr_array_add (owners, package);
+			}
+		}
+	}
+
+	g_hash_table_iter_init (&iter, apps_by_filename);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		const gchar *filename = key;
+		GPtrArray *apps = value;
+		GPtrArray *owners = g_hash_table_lookup (packages_by_filename, filename);
+		for (guint i = 0; i < apps->len; i++) {
+			GsApp *app = g_ptr_array_index (apps, i);
+			if (owners != NULL && owners->len == 1) {
+				PkPackage *package = g_ptr_array_index (owners, 0);
+				gs_plugin_packagekit_set_metadata_from_package (plugin, app, package);
+			} else {
+				g_warning ("Failed to find one package for %s, %s, [%u]",
+					   gs_app_get_id (app), filename,
+					   owners != NULL ? owners->len : 0);
+			}
+		}
 	}
 	return TRUE;
 }
@@ -272,6 +371,7 @@ gs_plugin_packagekit_refine_updatedetails (GsPlugin *plugin,
 					   GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 	const gchar *package_id;
 	guint j;
 	GsApp *app;
@@ -295,13 +395,16 @@ gs_plugin_packagekit_refine_updatedetails (GsPlugin *plugin,
 		return TRUE;
 
 	/* get any update details */
-	g_mutex_lock (&priv->client_mutex);
-	results = pk_client_get_update_detail (priv->client,
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "get-update-detail", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_get_update_detail (client,
 					       (gchar **) package_ids,
 					       cancellable,
 					       gs_packagekit_helper_cb, helper,
 					       error);
-	g_mutex_unlock (&priv->client_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 	if (!gs_plugin_packagekit_results_valid (results, error)) {
 		g_prefix_error (error, "failed to get update details for %s: ",
 				package_ids[0]);
@@ -337,6 +440,7 @@ gs_plugin_packagekit_refine_details2 (GsPlugin *plugin,
 				      GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 	GPtrArray *source_ids;
 	GsApp *app;
 	const gchar *package_id;
@@ -361,13 +465,16 @@ gs_plugin_packagekit_refine_details2 (GsPlugin *plugin,
 	g_ptr_array_add (package_ids, NULL);
 
 	/* get any details */
-	g_mutex_lock (&priv->client_mutex);
-	results = pk_client_get_details (priv->client,
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "get-details", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_get_details (client,
 					 (gchar **) package_ids->pdata,
 					 cancellable,
 					 gs_packagekit_helper_cb, helper,
 					 error);
-	g_mutex_unlock (&priv->client_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 	if (!gs_plugin_packagekit_results_valid (results, error)) {
 		g_autofree gchar *package_ids_str = g_strjoinv (",", (gchar **) package_ids->pdata);
 		g_prefix_error (error, "failed to get details for %s: ",
@@ -399,6 +506,7 @@ gs_plugin_packagekit_refine_update_urgency (GsPlugin *plugin,
 					    GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 	guint i;
 	GsApp *app;
 	const gchar *package_id;
@@ -413,13 +521,16 @@ gs_plugin_packagekit_refine_update_urgency (GsPlugin *plugin,
 
 	/* get the list of updates */
 	filter = pk_bitfield_value (PK_FILTER_ENUM_NONE);
-	g_mutex_lock (&priv->client_mutex);
-	results = pk_client_get_updates (priv->client,
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "get-updates", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_get_updates (client,
 					 filter,
 					 cancellable,
 					 gs_packagekit_helper_cb, helper,
 					 error);
-	g_mutex_unlock (&priv->client_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 	if (!gs_plugin_packagekit_results_valid (results, error)) {
 		g_prefix_error (error, "failed to get updates for urgency: ");
 		return FALSE;
@@ -583,28 +694,29 @@ gs_plugin_packagekit_refine_distro_upgrade (GsPlugin *plugin,
 					    GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 	guint i;
 	GsApp *app2;
 	g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
 	g_autoptr(PkResults) results = NULL;
 	g_autoptr(GsAppList) list = NULL;
-	guint cache_age_save;
 
 	gs_packagekit_helper_add_app (helper, app);
 
 	/* ask PK to simulate upgrading the system */
-	g_mutex_lock (&priv->client_mutex);
-	cache_age_save = pk_client_get_cache_age (priv->client);
-	pk_client_set_cache_age (priv->client, 60 * 60 * 24 * 7); /* once per week */
-	results = pk_client_upgrade_system (priv->client,
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "upgrade-system", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	pk_client_set_cache_age (client, 60 * 60 * 24 * 7); /* once per week */
+	results = pk_client_upgrade_system (client,
 					    pk_bitfield_from_enums (PK_TRANSACTION_FLAG_ENUM_SIMULATE, -1),
 					    gs_app_get_version (app),
 					    PK_UPGRADE_KIND_ENUM_COMPLETE,
 					    cancellable,
 					    gs_packagekit_helper_cb, helper,
 					    error);
-	pk_client_set_cache_age (priv->client, cache_age_save);
-	g_mutex_unlock (&priv->client_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 
 	if (!gs_plugin_packagekit_results_valid (results, error)) {
 		g_prefix_error (error, "failed to refine distro upgrade: ");
@@ -679,13 +791,18 @@ gs_plugin_packagekit_refine_filename_to_id (GsPlugin *plugin,
 					    GCancellable *cancellable,
 					    GError **error)
 {
+	g_autoptr(GHashTable) apps_by_filename = NULL;
+
 	/* not now */
 	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SETUP_ACTION) == 0)
 		return TRUE;
 
+	apps_by_filename = g_hash_table_new_full (g_str_hash, g_str_equal,
+						  g_free, (GDestroyNotify) g_ptr_array_unref);
 	for (guint i = 0; i < gs_app_list_length (list); i++) {
 		g_autofree gchar *fn = NULL;
 		GsApp *app = gs_app_list_index (list, i);
+		GPtrArray *apps;
 		const gchar *tmp;
 		if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD))
 			continue;
@@ -717,14 +834,17 @@ gs_plugin_packagekit_refine_filename_to_id (GsPlugin *plugin,
 			g_debug ("ignoring %s as does not exist", fn);
 			continue;
 		}
-		if (!gs_plugin_packagekit_refine_from_desktop (plugin,
-								app,
-								fn,
-								cancellable,
-								error))
-			return FALSE;
+		apps = g_hash_table_lookup (apps_by_filename, fn);
+		if (apps == NULL) {
+			apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+			g_hash_table_insert (apps_by_filename, g_steal_pointer (&fn), apps);
+		}
+		g_ptr_array_add (apps, g_object_ref (app));
 	}
-	return TRUE;
+	return gs_plugin_packagekit_refine_from_desktop (plugin,
+							 apps_by_filename,
+							 cancellable,
+							 error);
 }
 
 static gboolean
@@ -11,12 +11,12 @@
 #include <packagekit-glib2/packagekit.h>
 #include <unity-software.h>
 
+#include "gs-packagekit-client-pool.h"
 #include "gs-packagekit-helper.h"
 #include "packagekit-common.h"
 
 struct GsPluginData {
-	PkClient		*client;
-	GMutex			 client_mutex;
+	GsPackagekitClientPool	*client_pool;
 };
 
 void
@@ -24,19 +24,14 @@ gs_plugin_initialize (GsPlugin *plugin)
 {
 	GsPluginData *priv = gs_plugin_alloc_data (plugin, sizeof(GsPluginData));
 
-	g_mutex_init (&priv->client_mutex);
-	priv->client = pk_client_new ();
-
-	pk_client_set_background (priv->client, FALSE);
-	pk_client_set_cache_age (priv->client, G_MAXUINT);
+	priv->client_pool = gs_packagekit_client_pool_new (GS_PACKAGEKIT_CLIENT_POOL_SIZE);
 }
 
 void
 gs_plugin_destroy (GsPlugin *plugin)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
-	g_mutex_clear (&priv->client_mutex);
-	g_object_unref (priv->client);
+	g_object_unref (priv->client_pool);
 }
 
 gboolean
@@ -47,6 +42,7 @@ gs_plugin_url_to_app (GsPlugin *plugin,
 		      GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 
 	g_autofree gchar *scheme = NULL;
 	g_autofree gchar *path = NULL;
@@ -87,14 +83,17 @@ gs_plugin_url_to_app (GsPlugin *plugin,
 	package_ids = g_new0 (gchar *, 2);
 	package_ids[0] = g_strdup (path);
 
-	g_mutex_lock (&priv->client_mutex);
-	results = pk_client_resolve (priv->client,
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "resolve", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_resolve (client,
 				     pk_bitfield_from_enums (PK_FILTER_ENUM_NEWEST, PK_FILTER_ENUM_ARCH, -1),
 				     package_ids,
 				     cancellable,
 				     gs_packagekit_helper_cb, helper,
 				     error);
-	g_mutex_unlock (&priv->client_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 
 	if (!gs_plugin_packagekit_results_valid (results, error)) {
 		g_prefix_error (error, "failed to resolve package_ids: ");
@@ -107,13 +106,15 @@ gs_plugin_url_to_app (GsPlugin *plugin,
 
 	if (packages->len >= 1) {
 		g_autoptr(GHashTable) details_collection = NULL;
+		g_autoptr(GHashTable) packages_by_name = NULL;
 
 		if (gs_app_get_local_file (app) != NULL)
 			return TRUE;
 
 		details_collection = gs_plugin_packagekit_details_array_to_hash (details);
+		packages_by_name = gs_plugin_packagekit_packages_array_to_hash (packages);
 
-		gs_plugin_packagekit_resolve_packages_app (plugin, packages, app);
+		gs_plugin_packagekit_resolve_packages_app (plugin, packages_by_name, app);
 		gs_plugin_packagekit_refine_details_app (plugin, details_collection, app);
 
 		gs_app_list_add (list, app);
@@ -14,6 +14,7 @@
 #include <unity-software.h>
 
 #include "packagekit-common.h"
+#include "gs-packagekit-client-pool.h"
 #include "gs-packagekit-helper.h"
 
 /*
@@ -27,7 +28,8 @@
 
 struct GsPluginData {
 	PkTask			*task;
-	GMutex			 task_mutex;
+	GMutex			 task_mutex;	/* only for transactions using task */
+	GsPackagekitClientPool	*client_pool;
 };
 
 void
@@ -39,6 +41,10 @@ gs_plugin_initialize (GsPlugin *plugin)
 	priv->task = pk_task_new ();
 	pk_client_set_background (PK_CLIENT (priv->task), FALSE);
 	pk_client_set_cache_age (PK_CLIENT (priv->task), G_MAXUINT);
+	priv->client_pool = gs_packagekit_client_pool_new (GS_PACKAGEKIT_CLIENT_POOL_SIZE);
+
+	/* results only come from packagekitd */
+	gs_plugin_add_flags (plugin, GS_PLUGIN_FLAGS_PARALLEL_RESULTS);
 }
 
 void
@@ -47,6 +53,7 @@ gs_plugin_destroy (GsPlugin *plugin)
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	g_mutex_clear (&priv->task_mutex);
 	g_object_unref (priv->task);
+	g_object_unref (priv->client_pool);
 }
 
 static gboolean
@@ -56,6 +63,7 @@ gs_plugin_add_sources_related (GsPlugin *plugin,
 			       GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 	guint i;
 	GsApp *app;
 	GsApp *app_tmp;
@@ -71,13 +79,16 @@ gs_plugin_add_sources_related (GsPlugin *plugin,
 					 PK_FILTER_ENUM_ARCH,
 					 PK_FILTER_ENUM_NOT_COLLECTIONS,
 					 -1);
-	g_mutex_lock (&priv->task_mutex);
-	results = pk_client_get_packages (PK_CLIENT(priv->task),
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "get-packages", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_get_packages (client,
 					   filter,
 					   cancellable,
 					   gs_packagekit_helper_cb, helper,
 					   error);
-	g_mutex_unlock (&priv->task_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 	if (!gs_plugin_packagekit_results_valid (results, error)) {
 		g_prefix_error (error, "failed to get sources related: ");
 		return FALSE;
@@ -120,6 +131,7 @@ gs_plugin_add_sources (GsPlugin *plugin,
 		       GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 	PkBitfield filter;
 	PkRepoDetail *rd;
 	g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
@@ -134,13 +146,16 @@ gs_plugin_add_sources (GsPlugin *plugin,
 					 PK_FILTER_ENUM_NOT_DEVELOPMENT,
 					 PK_FILTER_ENUM_NOT_SUPPORTED,
 					 -1);
-	g_mutex_lock (&priv->task_mutex);
-	results = pk_client_get_repo_list (PK_CLIENT(priv->task),
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "get-repo-list", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_get_repo_list (client,
 					   filter,
 					   cancellable,
 					   gs_packagekit_helper_cb, helper,
 					   error);
-	g_mutex_unlock (&priv->task_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 	if (!gs_plugin_packagekit_results_valid (results, error))
 		return FALSE;
 	hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
@@ -588,19 +603,23 @@ gs_plugin_add_updates (GsPlugin *plugin,
 		       GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 	g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
 	g_autoptr(PkResults) results = NULL;
 	g_autoptr(GPtrArray) array = NULL;
 
 	/* do sync call */
 	gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_WAITING);
-	g_mutex_lock (&priv->task_mutex);
-	results = pk_client_get_updates (PK_CLIENT (priv->task),
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "get-updates", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_get_updates (client,
 					 pk_bitfield_value (PK_FILTER_ENUM_NONE),
 					 cancellable,
 					 gs_packagekit_helper_cb, helper,
 					 error);
-	g_mutex_unlock (&priv->task_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 	if (!gs_plugin_packagekit_results_valid (results, error))
 		return FALSE;
 
@@ -623,6 +642,7 @@ gs_plugin_add_search_files (GsPlugin *plugin,
                             GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 	PkBitfield filter;
 	g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
 	g_autoptr(PkResults) results = NULL;
@@ -632,14 +652,17 @@ gs_plugin_add_search_files (GsPlugin *plugin,
 	filter = pk_bitfield_from_enums (PK_FILTER_ENUM_NEWEST,
 					 PK_FILTER_ENUM_ARCH,
 					 -1);
-	g_mutex_lock (&priv->task_mutex);
-	results = pk_client_search_files (PK_CLIENT (priv->task),
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "search-files", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_search_files (client,
 	                                  filter,
 	                                  search,
 	                                  cancellable,
 	                                  gs_packagekit_helper_cb, helper,
 	                                  error);
-	g_mutex_unlock (&priv->task_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 	if (!gs_plugin_packagekit_results_valid (results, error))
 		return FALSE;
 
@@ -655,6 +678,7 @@ gs_plugin_add_search_what_provides (GsPlugin *plugin,
                                     GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	PkClient *client;
 	PkBitfield filter;
 	g_autoptr(GsPackagekitHelper) helper = gs_packagekit_helper_new (plugin);
 	g_autoptr(PkResults) results = NULL;
@@ -664,14 +688,17 @@ gs_plugin_add_search_what_provides (GsPlugin *plugin,
 	filter = pk_bitfield_from_enums (PK_FILTER_ENUM_NEWEST,
 					 PK_FILTER_ENUM_ARCH,
 					 -1);
-	g_mutex_lock (&priv->task_mutex);
-	results = pk_client_what_provides (PK_CLIENT (priv->task),
+	client = gs_packagekit_client_pool_acquire (priv->client_pool,
+						    "what-provides", cancellable, error);
+	if (client == NULL)
+		return FALSE;
+	results = pk_client_what_provides (client,
 	                                   filter,
 	                                   search,
 	                                   cancellable,
 	                                   gs_packagekit_helper_cb, helper,
 	                                   error);
-	g_mutex_unlock (&priv->task_mutex);
+	gs_packagekit_client_pool_release (priv->client_pool, client);
 	if (!gs_plugin_packagekit_results_valid (results, error))
 		return FALSE;
 
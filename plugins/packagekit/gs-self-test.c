@@ -11,7 +11,9 @@
 #include "unity-software-private.h"
 
 #include "gs-markdown.h"
+#include "gs-packagekit-client-pool.h"
 #include "gs-test.h"
+#include "packagekit-common.h"
 
 static void
 gs_markdown_func (void)
@@ -193,6 +195,106 @@ gs_markdown_func (void)
 	g_free (text);
 }
 
+static void
+gs_packagekit_resolve_packages_app_func (void)
+{
+	g_autoptr(GsPlugin) plugin = gs_plugin_new ();
+	g_autoptr(GPtrArray) apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	g_autoptr(GPtrArray) packages = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	g_autoptr(GHashTable) packages_by_name = NULL;
+	g_autoptr(GTimer) timer = NULL;
+
+	/* an installed package for each app, plus as many unrelated ones */
+	for (guint i = 0; i < 4000; i++) {
+		g_autofree gchar *package_id = NULL;
+		g_autoptr(PkPackage) package = pk_package_new ();
+		g_autoptr(GError) error = NULL;
+
+		package_id = g_strdup_printf ("pkg%05u;1.%u;x86_64;installed:main", i, i);
+		g_assert_true (pk_package_set_id (package, package_id, &error));
+		g_assert_no_error (error);
+		pk_package_set_info (package, i % 2 == 0 ? PK_INFO_ENUM_INSTALLED :
+							   PK_INFO_ENUM_AVAILABLE);
+		pk_package_set_summary (package, "Summary");
+		g_ptr_array_add (packages, g_steal_pointer (&package));
+	}
+	for (guint i = 0; i < 2000; i++) {
+		g_autofree gchar *id = g_strdup_printf ("app%05u.desktop", i);
+		g_autofree gchar *pkgname = g_strdup_printf ("pkg%05u", i * 2);
+		GsApp *app = gs_app_new (id);
+		gs_app_add_source (app, pkgname);
+		g_ptr_array_add (apps, app);
+	}
+
+	/* resolve them all */
+	timer = g_timer_new ();
+	packages_by_name = gs_plugin_packagekit_packages_array_to_hash (packages);
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		gs_plugin_packagekit_resolve_packages_app (plugin, packages_by_name, app);
+	}
+	g_print ("%.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		g_autofree gchar *package_id = g_strdup_printf ("pkg%05u;1.%u;x86_64;installed:main",
+								i * 2, i * 2);
+		g_assert_cmpint (gs_app_get_state (app), ==, AS_APP_STATE_INSTALLED);
+		g_assert_cmpstr (gs_app_get_source_id_default (app), ==, package_id);
+		g_assert_cmpstr (gs_app_get_origin (app), ==, "main");
+	}
+}
+
+static gpointer
+gs_packagekit_client_pool_cancel_cb (gpointer user_data)
+{
+	GCancellable *cancellable = G_CANCELLABLE (user_data);
+	g_usleep (50 * G_TIME_SPAN_MILLISECOND);
+	g_cancellable_cancel (cancellable);
+	return NULL;
+}
+
+static void
+gs_packagekit_client_pool_func (void)
+{
+	PkClient *client1;
+	PkClient *client2;
+	PkClient *client3;
+	g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GThread) thread = NULL;
+	g_autoptr(GsPackagekitClientPool) pool = gs_packagekit_client_pool_new (2);
+
+	/* queries run side by side */
+	client1 = gs_packagekit_client_pool_acquire (pool, "resolve", NULL, &error);
+	g_assert_no_error (error);
+	client2 = gs_packagekit_client_pool_acquire (pool, "resolve", NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (client1 != client2);
+
+	/* the pool is full, so waiting stops when cancelled from elsewhere */
+	thread = g_thread_new ("cancel", gs_packagekit_client_pool_cancel_cb, cancellable);
+	client3 = gs_packagekit_client_pool_acquire (pool, "resolve", cancellable, &error);
+	g_assert_error (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_CANCELLED);
+	g_assert_null (client3);
+	g_thread_join (g_steal_pointer (&thread));
+	g_clear_error (&error);
+
+	/* already cancelled */
+	client3 = gs_packagekit_client_pool_acquire (pool, "resolve", cancellable, &error);
+	g_assert_error (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_CANCELLED);
+	g_assert_null (client3);
+
+	/* released clients are reused and reset */
+	pk_client_set_cache_age (client1, 60);
+	gs_packagekit_client_pool_release (pool, client1);
+	client3 = gs_packagekit_client_pool_acquire (pool, "resolve", NULL, NULL);
+	g_assert_true (client3 == client1);
+	g_assert_cmpint (pk_client_get_cache_age (client3), ==, G_MAXUINT);
+	gs_packagekit_client_pool_release (pool, client2);
+	gs_packagekit_client_pool_release (pool, client3);
+}
+
 static void
 gs_plugins_packagekit_local_func (GsPluginLoader *plugin_loader)
 {
@@ -256,6 +358,10 @@ main (int argc, char **argv)
 
 	/* generic tests go here */
 	g_test_add_func ("/unity-software/markdown", gs_markdown_func);
+	g_test_add_func ("/unity-software/plugins/packagekit/resolve-packages-app",
+			 gs_packagekit_resolve_packages_app_func);
+	g_test_add_func ("/unity-software/plugins/packagekit/client-pool",
+			 gs_packagekit_client_pool_func);
 
 	/* we can only load this once per process */
 	plugin_loader = gs_plugin_loader_new ();
@@ -287,12 +287,42 @@ gs_plugin_packagekit_add_results (GsPlugin *plugin,
 	return TRUE;
 }
 
+/* Index the packages by name so that matching many apps against a large
+ * result set does not rescan it for every app source. Packages sharing a
+ * name (e.g. several arches) are kept in the order PackageKit returned them.
+ * The keys are owned by the packages, so @packages must outlive the table. */
+GHashTable *
+gs_plugin_packagekit_packages_array_to_hash (GPtrArray *packages)
+{
+	g_autoptr(GHashTable) packages_by_name = NULL;
+
+	packages_by_name = g_hash_table_new_full (g_str_hash, g_str_equal,
+						  NULL, (GDestroyNotify) g_ptr_array_unref);
+	for (guint i = 0; i < packages->len; i++) {
+		PkPackage *package = g_ptr_array_index (packages, i);
+		const gchar *name = pk_package_get_name (package);
+		GPtrArray *array;
+
+		if (name == NULL)
+			continue;
+		array = g_hash_table_lookup (packages_by_name, name);
+		if (array == NULL) {
+			array = g_ptr_array_new ();
+			g_hash_table_insert (packages_by_name, (gpointer) name, array);
+		}
+		g_ptr_array_add (array, package);
+	}
+
+	return g_steal_pointer (&packages_by_name);
+}
+
 void
 gs_plugin_packagekit_resolve_packages_app (GsPlugin *plugin,
-					   GPtrArray *packages,
+					   GHashTable *packages_by_name,
 					   GsApp *app)
 {
 	GPtrArray *sources;
+	GPtrArray *packages;
 	PkPackage *package;
 	const gchar *pkgname;
 	guint i, j;
@@ -305,24 +335,27 @@ gs_plugin_packagekit_resolve_packages_app (GsPlugin *plugin,
 	sources = gs_app_get_sources (app);
 	for (j = 0; j < sources->len; j++) {
 		pkgname = g_ptr_array_index (sources, j);
+		if (pkgname == NULL)
+			continue;
+		packages = g_hash_table_lookup (packages_by_name, pkgname);
+		if (packages == NULL)
+			continue;
 		for (i = 0; i < packages->len; i++) {
 			package = g_ptr_array_index (packages, i);
-			if (g_strcmp0 (pk_package_get_name (package), pkgname) == 0) {
-				gs_plugin_packagekit_set_metadata_from_package (plugin, app, package);
-				switch (pk_package_get_info (package)) {
-				case PK_INFO_ENUM_INSTALLED:
-					number_installed++;
-					break;
-				case PK_INFO_ENUM_AVAILABLE:
-					number_available++;
-					break;
-				case PK_INFO_ENUM_UNAVAILABLE:
-					number_available++;
-					break;
-				default:
-					/* should we expect anything else? */
-					break;
-				}
+			gs_plugin_packagekit_set_metadata_from_package (plugin, app, package);
+			switch (pk_package_get_info (package)) {
+			case PK_INFO_ENUM_INSTALLED:
+				number_installed++;
+				break;
+			case PK_INFO_ENUM_AVAILABLE:
+				number_available++;
+				break;
+			case PK_INFO_ENUM_UNAVAILABLE:
+				number_available++;
+				break;
+			default:
+				/* should we expect anything else? */
+				break;
 			}
 		}
 	}
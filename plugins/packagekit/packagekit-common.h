@@ -24,8 +24,9 @@ gboolean	gs_plugin_packagekit_add_results		(GsPlugin	*plugin,
 gboolean	gs_plugin_packagekit_error_convert		(GError		**error);
 gboolean	gs_plugin_packagekit_results_valid		(PkResults	*results,
 								 GError		**error);
+GHashTable *	gs_plugin_packagekit_packages_array_to_hash	(GPtrArray *packages);
 void		gs_plugin_packagekit_resolve_packages_app	(GsPlugin *plugin,
-								 GPtrArray *packages,
+								 GHashTable *packages_by_name,
 								 GsApp *app);
 void		gs_plugin_packagekit_set_metadata_from_package	(GsPlugin *plugin,
 								 GsApp *app,
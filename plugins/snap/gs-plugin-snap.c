@@ -23,9 +23,13 @@ struct GsPluginData {
 	GHashTable		*store_snaps;
 };
 
+/* store details are refreshed after this many seconds */
+#define SNAP_STORE_CACHE_AGE_MAX	(60 * 60)
+
 typedef struct {
 	SnapdSnap *snap;
 	gboolean full_details;
+	gint64 expires;
 } CacheEntry;
 
 static CacheEntry *
@@ -34,6 +38,7 @@ cache_entry_new (SnapdSnap *snap, gboolean full_details)
 	CacheEntry *entry = g_slice_new (CacheEntry);
 	entry->snap = g_object_ref (snap);
 	entry->full_details = full_details;
+	entry->expires = g_get_monotonic_time () + SNAP_STORE_CACHE_AGE_MAX * G_USEC_PER_SEC;
 	return entry;
 }
 
@@ -135,6 +140,9 @@ gs_plugin_initialize (GsPlugin *plugin)
 	/* Override hardcoded popular apps */
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_RUN_BEFORE, "hardcoded-popular");
 
+	/* results only come from snapd */
+	gs_plugin_add_flags (plugin, GS_PLUGIN_FLAGS_PARALLEL_RESULTS);
+
 	/* set name of MetaInfo file */
 	gs_plugin_set_appstream_id (plugin, "org.ubuntuunity.software.Plugin.Snap");
 }
@@ -257,19 +265,37 @@ store_snap_cache_lookup (GsPlugin *plugin, const gchar *name, gboolean need_deta
 	if (entry == NULL)
 		return NULL;
 
+	/* too old */
+	if (entry->expires < g_get_monotonic_time ()) {
+		g_hash_table_remove (priv->store_snaps, name);
+		return NULL;
+	}
+
 	if (need_details && !entry->full_details)
 		return NULL;
 
 	return g_object_ref (entry->snap);
 }
 
+static gboolean
+store_snap_cache_expired_cb (gpointer key, gpointer value, gpointer user_data)
+{
+	CacheEntry *entry = value;
+	gint64 *now = user_data;
+	return entry->expires < *now;
+}
+
 static void
 store_snap_cache_update (GsPlugin *plugin, GPtrArray *snaps, gboolean full_details)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->store_snaps_lock);
+	gint64 now = g_get_monotonic_time ();
 	guint i;
 
+	/* drop anything that has expired so the cache does not grow forever */
+	g_hash_table_foreach_remove (priv->store_snaps, store_snap_cache_expired_cb, &now);
+
 	for (i = 0; i < snaps->len; i++) {
 		SnapdSnap *snap = snaps->pdata[i];
 		g_hash_table_insert (priv->store_snaps, g_strdup (snapd_snap_get_name (snap)), cache_entry_new (snap, full_details));
@@ -894,6 +920,7 @@ refine_screenshots (GsApp *app, SnapdSnap *snap)
 static gboolean
 refine_app_with_client (GsPlugin             *plugin,
 			SnapdClient          *client,
+			GHashTable           *local_snaps,
 			GsApp                *app,
 			GsPluginRefineFlags   flags,
 			GCancellable         *cancellable,
@@ -920,7 +947,15 @@ refine_app_with_client (GsPlugin             *plugin,
 	channel = g_strdup (gs_app_get_branch (app));
 
 	/* get information from locally installed snaps and information we already have */
-	local_snap = snapd_client_get_snap_sync (client, snap_name, cancellable, NULL);
+	if (local_snaps != NULL) {
+		SnapdSnap *local_snap_tmp = NULL;
+		if (snap_name != NULL)
+			local_snap_tmp = g_hash_table_lookup (local_snaps, snap_name);
+		if (local_snap_tmp != NULL)
+			local_snap = g_object_ref (local_snap_tmp);
+	} else {
+		local_snap = snapd_client_get_snap_sync (client, snap_name, cancellable, NULL);
+	}
 	store_snap = store_snap_cache_lookup (plugin, snap_name, FALSE);
 	if (store_snap != NULL)
 		store_channel = expand_channel_name (snapd_snap_get_channel (store_snap));
@@ -1056,6 +1091,36 @@ refine_app_with_client (GsPlugin             *plugin,
 	return TRUE;
 }
 
+static GHashTable *
+get_local_snaps (SnapdClient *client, GPtrArray *names, GCancellable *cancellable)
+{
+	g_autoptr(GPtrArray) snaps = NULL;
+	g_autoptr(GError) error_local = NULL;
+	GHashTable *local_snaps;
+
+	/* get all the requested snaps in one request */
+	g_ptr_array_add (names, NULL);
+	snaps = snapd_client_get_snaps_sync (client, SNAPD_GET_SNAPS_FLAGS_NONE,
+					     (GStrv) names->pdata,
+					     cancellable, &error_local);
+	g_ptr_array_remove_index (names, names->len - 1);
+	if (snaps == NULL) {
+		g_debug ("failed to get local snaps, falling back: %s",
+			 error_local->message);
+		return NULL;
+	}
+
+	local_snaps = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     NULL, (GDestroyNotify) g_object_unref);
+	for (guint i = 0; i < snaps->len; i++) {
+		SnapdSnap *snap = g_ptr_array_index (snaps, i);
+		g_hash_table_insert (local_snaps,
+				     (gpointer) snapd_snap_get_name (snap),
+				     g_object_ref (snap));
+	}
+	return local_snaps;
+}
+
 gboolean
 gs_plugin_refine (GsPlugin             *plugin,
 		  GsAppList            *list,
@@ -1064,14 +1129,34 @@ gs_plugin_refine (GsPlugin             *plugin,
 		  GError              **error)
 {
 	g_autoptr(SnapdClient) client = NULL;
+	g_autoptr(GPtrArray) names = g_ptr_array_new ();
+	g_autoptr(GHashTable) names_set = g_hash_table_new (g_str_hash, g_str_equal);
+	g_autoptr(GHashTable) local_snaps = NULL;
+
+	/* get the unique snap names we are being asked about */
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		const gchar *snap_name;
+		if (g_strcmp0 (gs_app_get_management_plugin (app), "snap") != 0)
+			continue;
+		snap_name = gs_app_get_metadata_item (app, "snap::name");
+		if (snap_name == NULL || !g_hash_table_add (names_set, (gpointer) snap_name))
+			continue;
+		g_ptr_array_add (names, (gpointer) snap_name);
+	}
+	if (names->len == 0)
+		return TRUE;
 
 	client = get_client (plugin, error);
 	if (client == NULL)
 		return FALSE;
 
+	/* one round trip for all the local snaps */
+	local_snaps = get_local_snaps (client, names, cancellable);
+
 	for (guint i = 0; i < gs_app_list_length (list); i++) {
 		GsApp *app = gs_app_list_index (list, i);
-		if (!refine_app_with_client (plugin, client, app, flags, cancellable, error))
+		if (!refine_app_with_client (plugin, client, local_snaps, app, flags, cancellable, error))
 			return FALSE;
 	}
 
@@ -50,6 +50,7 @@ struct _GsApplication {
 	GsDbusHelper	*dbus_helper;
 #endif
 	GsShellSearchProvider *search_provider;
+	guint		 metrics_registration_id;
 	GSettings       *settings;
 	GSimpleActionGroup	*action_map;
 	guint		 shell_loaded_handler_id;
@@ -259,6 +260,46 @@ gs_application_initialize_plugins (GsApplication *app)
 
 }
 
+static const gchar gs_application_metrics_xml[] =
+	"<node>"
+	"  <interface name='org.ubuntuunity.software.Metrics'>"
+	"    <method name='GetMetrics'>"
+	"      <arg type='a(ssau)' name='metrics' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+static void
+gs_application_metrics_method_call_cb (GDBusConnection *connection,
+				       const gchar *sender,
+				       const gchar *object_path,
+				       const gchar *interface_name,
+				       const gchar *method_name,
+				       GVariant *parameters,
+				       GDBusMethodInvocation *invocation,
+				       gpointer user_data)
+{
+	GsApplication *app = GS_APPLICATION (user_data);
+	g_autoptr(GVariant) metrics = NULL;
+
+	if (app->plugin_loader == NULL) {
+		g_dbus_method_invocation_return_error_literal (invocation,
+							       G_DBUS_ERROR,
+							       G_DBUS_ERROR_FAILED,
+							       "plugins not loaded");
+		return;
+	}
+	metrics = gs_plugin_loader_get_metrics (app->plugin_loader);
+	g_dbus_method_invocation_return_value (invocation,
+					       g_variant_new ("(@a(ssau))", metrics));
+}
+
+static const GDBusInterfaceVTable gs_application_metrics_vtable = {
+	gs_application_metrics_method_call_cb,
+	NULL,
+	NULL,
+};
+
 static gboolean
 gs_application_dbus_register (GApplication    *application,
                               GDBusConnection *connection,
@@ -266,6 +307,21 @@ gs_application_dbus_register (GApplication    *application,
                               GError         **error)
 {
 	GsApplication *app = GS_APPLICATION (application);
+	g_autoptr(GDBusNodeInfo) info = NULL;
+
+	/* latency metrics from the plugin loader */
+	info = g_dbus_node_info_new_for_xml (gs_application_metrics_xml, error);
+	if (info == NULL)
+		return FALSE;
+	app->metrics_registration_id =
+		g_dbus_connection_register_object (connection,
+						   object_path,
+						   info->interfaces[0],
+						   &gs_application_metrics_vtable,
+						   app, NULL, error);
+	if (app->metrics_registration_id == 0)
+		return FALSE;
+
 	app->search_provider = gs_shell_search_provider_new ();
 	return gs_shell_search_provider_register (app->search_provider, connection, error);
 }
@@ -277,6 +333,11 @@ gs_application_dbus_unregister (GApplication    *application,
 {
 	GsApplication *app = GS_APPLICATION (application);
 
+	if (app->metrics_registration_id != 0) {
+		g_dbus_connection_unregister_object (connection,
+						     app->metrics_registration_id);
+		app->metrics_registration_id = 0;
+	}
 	if (app->search_provider != NULL) {
 		gs_shell_search_provider_unregister (app->search_provider);
 		g_clear_object (&app->search_provider);
@@ -1676,6 +1676,19 @@ gs_details_page_refresh_reviews (GsDetailsPage *self)
 	}
 }
 
+static void
+gs_details_page_app_refine_partial_cb (GsPluginJob *plugin_job,
+				       GsAppList *list,
+				       guint64 refine_flags,
+				       gpointer user_data)
+{
+	GsDetailsPage *self = GS_DETAILS_PAGE (user_data);
+	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE)
+		gs_details_page_refresh_size (self);
+	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING)
+		gs_details_page_refresh_reviews (self);
+}
+
 static void
 gs_details_page_app_refine_cb (GObject *source,
 				GAsyncResult *res,
@@ -1825,7 +1838,11 @@ gs_details_page_load_stage2 (GsDetailsPage *self)
 							  GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEW_RATINGS |
 							  GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS |
 							  GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE,
+					  "staged-refine", TRUE,
 					  NULL);
+	g_signal_connect_object (plugin_job1, "partial-result",
+				 G_CALLBACK (gs_details_page_app_refine_partial_cb),
+				 self, 0);
 	plugin_job2 = gs_plugin_job_newv (GS_PLUGIN_ACTION_GET_ALTERNATES,
 					  "interactive", TRUE,
 					  "app", self->app,
@@ -28,7 +28,9 @@ struct _GsScreenshotImage
 	GSettings	*settings;
 	SoupSession	*session;
 	SoupMessage	*message;
+	GCancellable	*cancellable;
 	gchar		*filename;
+	gchar		*cache_key;
 	const gchar	*current_image;
 	guint		 width;
 	guint		 height;
@@ -60,22 +62,85 @@ gs_screenshot_image_set_error (GsScreenshotImage *ssimg, const gchar *message)
 	ssimg->showing_image = FALSE;
 }
 
+/* scaled screenshots are shared by all the widgets so that going back to a
+ * details page does not decode everything again; only used from the main
+ * thread */
+#define GS_SCREENSHOT_IMAGE_CACHE_SIZE_MAX	(64 * 1024 * 1024)
+
+typedef struct {
+	gchar		*key;
+	GdkPixbuf	*pixbuf;
+} GsScreenshotImageCacheItem;
+
+static GHashTable *pixbuf_cache = NULL;		/* key : GList link in pixbuf_cache_lru */
+static GQueue pixbuf_cache_lru = G_QUEUE_INIT;	/* of GsScreenshotImageCacheItem, newest first */
+static gsize pixbuf_cache_size = 0;
+
 static void
-as_screenshot_show_image (GsScreenshotImage *ssimg)
+gs_screenshot_image_cache_item_free (GsScreenshotImageCacheItem *item)
 {
-	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	pixbuf_cache_size -= gdk_pixbuf_get_byte_length (item->pixbuf);
+	g_free (item->key);
+	g_object_unref (item->pixbuf);
+	g_slice_free (GsScreenshotImageCacheItem, item);
+}
 
-	/* no need to composite */
-	if (ssimg->width == G_MAXUINT || ssimg->height == G_MAXUINT) {
-		pixbuf = gdk_pixbuf_new_from_file (ssimg->filename, NULL);
-	} else {
-		/* this is always going to have alpha */
-		pixbuf = gdk_pixbuf_new_from_file_at_scale (ssimg->filename,
-							    (gint) (ssimg->width * ssimg->scale),
-							    (gint) (ssimg->height * ssimg->scale),
-							    FALSE, NULL);
-	}
+static void
+gs_screenshot_image_cache_remove_link (GList *link)
+{
+	GsScreenshotImageCacheItem *item = link->data;
+	g_hash_table_remove (pixbuf_cache, item->key);
+	g_queue_delete_link (&pixbuf_cache_lru, link);
+	gs_screenshot_image_cache_item_free (item);
+}
 
+static GdkPixbuf *
+gs_screenshot_image_cache_lookup (const gchar *key)
+{
+	GList *link;
+
+	if (pixbuf_cache == NULL || key == NULL)
+		return NULL;
+	link = g_hash_table_lookup (pixbuf_cache, key);
+	if (link == NULL)
+		return NULL;
+	g_queue_unlink (&pixbuf_cache_lru, link);
+	g_queue_push_head_link (&pixbuf_cache_lru, link);
+	return ((GsScreenshotImageCacheItem *) link->data)->pixbuf;
+}
+
+static void
+gs_screenshot_image_cache_insert (const gchar *key, GdkPixbuf *pixbuf)
+{
+	GsScreenshotImageCacheItem *item;
+	GList *link;
+	gsize size = gdk_pixbuf_get_byte_length (pixbuf);
+
+	if (key == NULL || size > GS_SCREENSHOT_IMAGE_CACHE_SIZE_MAX)
+		return;
+	if (pixbuf_cache == NULL)
+		pixbuf_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+	/* replace any older version */
+	link = g_hash_table_lookup (pixbuf_cache, key);
+	if (link != NULL)
+		gs_screenshot_image_cache_remove_link (link);
+
+	item = g_slice_new0 (GsScreenshotImageCacheItem);
+	item->key = g_strdup (key);
+	item->pixbuf = g_object_ref (pixbuf);
+	g_queue_push_head (&pixbuf_cache_lru, item);
+	g_hash_table_insert (pixbuf_cache, item->key, pixbuf_cache_lru.head);
+	pixbuf_cache_size += size;
+
+	/* drop the least recently shown */
+	while (pixbuf_cache_size > GS_SCREENSHOT_IMAGE_CACHE_SIZE_MAX)
+		gs_screenshot_image_cache_remove_link (pixbuf_cache_lru.tail);
+}
+
+static void
+gs_screenshot_image_show_pixbuf (GsScreenshotImage *ssimg, GdkPixbuf *pixbuf)
+{
 	/* show icon */
 	if (g_strcmp0 (ssimg->current_image, "image1") == 0) {
 		if (pixbuf != NULL) {
@@ -97,82 +162,40 @@ as_screenshot_show_image (GsScreenshotImage *ssimg)
 	ssimg->showing_image = TRUE;
 }
 
+typedef struct {
+	gchar		*filename;
+	gchar		*cache_key;
+	guint		 width;		/* device pixels, or G_MAXUINT */
+	guint		 height;	/* device pixels, or G_MAXUINT */
+	GBytes		*data;		/* (nullable): just downloaded */
+	guint		 width_counterpart;	/* 0 for none */
+	guint		 height_counterpart;
+} GsScreenshotImageLoadHelper;
+
 static void
-gs_screenshot_image_show_blurred (GsScreenshotImage *ssimg,
-				  const gchar *filename_thumb)
+gs_screenshot_image_load_helper_free (GsScreenshotImageLoadHelper *helper)
 {
-	g_autoptr(AsImage) im = NULL;
-	g_autoptr(GdkPixbuf) pb = NULL;
-
-	/* create an helper which can do the blurring for us */
-	im = as_image_new ();
-	if (!as_image_load_filename (im, filename_thumb, NULL))
-		return;
-	pb = as_image_save_pixbuf (im,
-				   ssimg->width * ssimg->scale,
-				   ssimg->height * ssimg->scale,
-				   AS_IMAGE_SAVE_FLAG_BLUR);
-	if (pb == NULL)
-		return;
-
-	if (g_strcmp0 (ssimg->current_image, "image1") == 0) {
-		gs_image_set_from_pixbuf_with_scale (GTK_IMAGE (ssimg->image1),
-						     pb, (gint) ssimg->scale);
-	} else {
-		gs_image_set_from_pixbuf_with_scale (GTK_IMAGE (ssimg->image2),
-						     pb, (gint) ssimg->scale);
-	}
+	g_free (helper->filename);
+	g_free (helper->cache_key);
+	if (helper->data != NULL)
+		g_bytes_unref (helper->data);
+	g_slice_free (GsScreenshotImageLoadHelper, helper);
 }
 
-static gboolean
-gs_screenshot_image_save_downloaded_img (GsScreenshotImage *ssimg,
-					 GdkPixbuf *pixbuf,
-					 GError **error)
+static void
+gs_screenshot_image_save_counterpart (GsScreenshotImageLoadHelper *helper,
+				      AsImage *im)
 {
-	g_autoptr(AsImage) im = NULL;
-	gboolean ret;
-	const GPtrArray *images;
 	g_autoptr(GError) error_local = NULL;
 	g_autofree char *filename = NULL;
 	g_autofree char *size_dir = NULL;
 	g_autofree char *cache_kind = NULL;
 	g_autofree char *basename = NULL;
-	guint width = ssimg->width;
-	guint height = ssimg->height;
-
-	/* save to file, using the same code as the AppStream builder
-	 * so the preview looks the same */
-	im = as_image_new ();
-	as_image_set_pixbuf (im, pixbuf);
-	ret = as_image_save_filename (im, ssimg->filename,
-				      ssimg->width * ssimg->scale,
-				      ssimg->height * ssimg->scale,
-				      AS_IMAGE_SAVE_FLAG_PAD_16_9,
-				      error);
-
-	if (!ret)
-		return FALSE;
 
-	if (ssimg->screenshot == NULL)
-		return TRUE;
-
-	images = as_screenshot_get_images (ssimg->screenshot);
-	if (images->len > 1)
-		return TRUE;
-
-	if (width == AS_IMAGE_THUMBNAIL_WIDTH &&
-	    height == AS_IMAGE_THUMBNAIL_HEIGHT) {
-		width = AS_IMAGE_NORMAL_WIDTH;
-		height = AS_IMAGE_NORMAL_HEIGHT;
-	} else {
-		width = AS_IMAGE_THUMBNAIL_WIDTH;
-		height = AS_IMAGE_THUMBNAIL_HEIGHT;
-	}
-
-	width *= ssimg->scale;
-	height *= ssimg->scale;
-	basename = g_path_get_basename (ssimg->filename);
-	size_dir = g_strdup_printf ("%ux%u", width, height);
+	basename = g_path_get_basename (helper->filename);
+	size_dir = g_strdup_printf ("%ux%u",
+				    helper->width_counterpart,
+				    helper->height_counterpart);
 	cache_kind = g_build_filename ("screenshots", size_dir, NULL);
 	filename = gs_utils_get_cache_filename (cache_kind, basename,
 						GS_UTILS_CACHE_FLAG_WRITEABLE,
@@ -185,22 +208,216 @@ gs_screenshot_image_save_downloaded_img (GsScreenshotImage *ssimg,
                 g_warning ("Failed to get cache filename for counterpart "
                            "screenshot '%s' in folder '%s': %s", basename,
                            cache_kind, error_local->message);
-                return TRUE;
+                return;
         }
 
-	ret = as_image_save_filename (im, filename, width, height,
-				      AS_IMAGE_SAVE_FLAG_PAD_16_9,
-				      &error_local);
-
-	if (!ret) {
+	if (!as_image_save_filename (im, filename,
+				     helper->width_counterpart,
+				     helper->height_counterpart,
+				     AS_IMAGE_SAVE_FLAG_PAD_16_9,
+				     &error_local)) {
 		/* if we cannot save this screenshot, warn about that but do not
 		 * set a user's visible error because this is a complementary
 		 * operation */
                 g_warning ("Failed to save screenshot '%s': %s", filename,
                            error_local->message);
         }
+}
+
+/* decodes, scales and writes to the disk cache, all off the main thread */
+static void
+gs_screenshot_image_load_thread_cb (GTask *task,
+				    gpointer source_object,
+				    gpointer task_data,
+				    GCancellable *cancellable)
+{
+	GsScreenshotImageLoadHelper *helper = task_data;
+	gconstpointer data;
+	gsize data_len;
+	g_autoptr(AsImage) im = NULL;
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GdkPixbuf) pixbuf_scaled = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GInputStream) stream = NULL;
+
+	/* already in the cache on disk */
+	if (helper->data == NULL) {
+		if (helper->width == G_MAXUINT || helper->height == G_MAXUINT) {
+			pixbuf = gdk_pixbuf_new_from_file (helper->filename, &error);
+		} else {
+			/* this is always going to have alpha */
+			pixbuf = gdk_pixbuf_new_from_file_at_scale (helper->filename,
+								    (gint) helper->width,
+								    (gint) helper->height,
+								    FALSE, &error);
+		}
+		if (pixbuf == NULL) {
+			g_task_return_error (task, g_steal_pointer (&error));
+			return;
+		}
+		g_task_return_pointer (task, g_steal_pointer (&pixbuf), g_object_unref);
+		return;
+	}
+
+	/* load the image */
+	stream = g_memory_input_stream_new_from_bytes (helper->data);
+	pixbuf = gdk_pixbuf_new_from_stream (stream, cancellable, NULL);
+	if (pixbuf == NULL) {
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+					 /* TRANSLATORS: possibly image file corrupt or not an image */
+					 "%s", _("Failed to load image"));
+		return;
+	}
 
-	return TRUE;
+	/* is image size destination size unknown or exactly the correct size */
+	if (helper->width == G_MAXUINT || helper->height == G_MAXUINT ||
+	    (helper->width == (guint) gdk_pixbuf_get_width (pixbuf) &&
+	     helper->height == (guint) gdk_pixbuf_get_height (pixbuf))) {
+		data = g_bytes_get_data (helper->data, &data_len);
+		if (!g_file_set_contents (helper->filename, data, (gssize) data_len, &error)) {
+			g_task_return_error (task, g_steal_pointer (&error));
+			return;
+		}
+		g_task_return_pointer (task, g_steal_pointer (&pixbuf), g_object_unref);
+		return;
+	}
+
+	/* scale and save, using the same code as the AppStream builder
+	 * so the preview looks the same; the result is also what gets shown
+	 * so there is no need to load the file back in */
+	im = as_image_new ();
+	as_image_set_pixbuf (im, pixbuf);
+	pixbuf_scaled = as_image_save_pixbuf (im, helper->width, helper->height,
+					      AS_IMAGE_SAVE_FLAG_PAD_16_9);
+	if (pixbuf_scaled == NULL) {
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+					 "%s", _("Failed to load image"));
+		return;
+	}
+	if (!gdk_pixbuf_save (pixbuf_scaled, helper->filename, "png", &error, NULL)) {
+		g_task_return_error (task, g_steal_pointer (&error));
+		return;
+	}
+	if (helper->width_counterpart > 0)
+		gs_screenshot_image_save_counterpart (helper, im);
+	g_task_return_pointer (task, g_steal_pointer (&pixbuf_scaled), g_object_unref);
+}
+
+static void
+gs_screenshot_image_load_cb (GObject *source_object,
+			     GAsyncResult *res,
+			     gpointer user_data)
+{
+	GsScreenshotImage *ssimg = GS_SCREENSHOT_IMAGE (source_object);
+	GsScreenshotImageLoadHelper *helper = g_task_get_task_data (G_TASK (res));
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GError) error = NULL;
+
+	pixbuf = g_task_propagate_pointer (G_TASK (res), &error);
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) ||
+	    ssimg->session == NULL)
+		return;
+	if (pixbuf == NULL && helper->data != NULL) {
+		gs_screenshot_image_set_error (ssimg, error->message);
+		return;
+	}
+	if (pixbuf == NULL)
+		g_debug ("failed to load %s: %s", helper->filename, error->message);
+	else
+		gs_screenshot_image_cache_insert (helper->cache_key, pixbuf);
+
+	/* got image, so show */
+	gs_screenshot_image_show_pixbuf (ssimg, pixbuf);
+}
+
+static void
+gs_screenshot_image_load_pixbuf (GsScreenshotImage *ssimg, GBytes *data)
+{
+	GsScreenshotImageLoadHelper *helper;
+	g_autoptr(GTask) task = NULL;
+
+	/* only the newest image is wanted */
+	g_cancellable_cancel (ssimg->cancellable);
+	g_clear_object (&ssimg->cancellable);
+	ssimg->cancellable = g_cancellable_new ();
+
+	helper = g_slice_new0 (GsScreenshotImageLoadHelper);
+	helper->filename = g_strdup (ssimg->filename);
+	helper->cache_key = g_strdup (ssimg->cache_key);
+	if (ssimg->width == G_MAXUINT || ssimg->height == G_MAXUINT) {
+		helper->width = G_MAXUINT;
+		helper->height = G_MAXUINT;
+	} else {
+		helper->width = ssimg->width * ssimg->scale;
+		helper->height = ssimg->height * ssimg->scale;
+	}
+	if (data != NULL)
+		helper->data = g_bytes_ref (data);
+
+	/* also save the other size if that is the only image */
+	if (data != NULL && ssimg->screenshot != NULL &&
+	    as_screenshot_get_images (ssimg->screenshot)->len <= 1) {
+		if (ssimg->width == AS_IMAGE_THUMBNAIL_WIDTH &&
+		    ssimg->height == AS_IMAGE_THUMBNAIL_HEIGHT) {
+			helper->width_counterpart = AS_IMAGE_NORMAL_WIDTH;
+			helper->height_counterpart = AS_IMAGE_NORMAL_HEIGHT;
+		} else {
+			helper->width_counterpart = AS_IMAGE_THUMBNAIL_WIDTH;
+			helper->height_counterpart = AS_IMAGE_THUMBNAIL_HEIGHT;
+		}
+		helper->width_counterpart *= ssimg->scale;
+		helper->height_counterpart *= ssimg->scale;
+	}
+
+	task = g_task_new (ssimg, ssimg->cancellable, gs_screenshot_image_load_cb, NULL);
+	g_task_set_source_tag (task, gs_screenshot_image_load_pixbuf);
+	g_task_set_task_data (task, helper, (GDestroyNotify) gs_screenshot_image_load_helper_free);
+	g_task_run_in_thread (task, gs_screenshot_image_load_thread_cb);
+}
+
+static void
+as_screenshot_show_image (GsScreenshotImage *ssimg)
+{
+	GdkPixbuf *pixbuf;
+
+	/* shown recently */
+	pixbuf = gs_screenshot_image_cache_lookup (ssimg->cache_key);
+	if (pixbuf != NULL) {
+		g_cancellable_cancel (ssimg->cancellable);
+		gs_screenshot_image_show_pixbuf (ssimg, pixbuf);
+		return;
+	}
+
+	/* the file is there, so treat it as shown while it is decoded */
+	gs_screenshot_image_load_pixbuf (ssimg, NULL);
+	ssimg->showing_image = TRUE;
+}
+
+static void
+gs_screenshot_image_show_blurred (GsScreenshotImage *ssimg,
+				  const gchar *filename_thumb)
+{
+	g_autoptr(AsImage) im = NULL;
+	g_autoptr(GdkPixbuf) pb = NULL;
+
+	/* create an helper which can do the blurring for us */
+	im = as_image_new ();
+	if (!as_image_load_filename (im, filename_thumb, NULL))
+		return;
+	pb = as_image_save_pixbuf (im,
+				   ssimg->width * ssimg->scale,
+				   ssimg->height * ssimg->scale,
+				   AS_IMAGE_SAVE_FLAG_BLUR);
+	if (pb == NULL)
+		return;
+
+	if (g_strcmp0 (ssimg->current_image, "image1") == 0) {
+		gs_image_set_from_pixbuf_with_scale (GTK_IMAGE (ssimg->image1),
+						     pb, (gint) ssimg->scale);
+	} else {
+		gs_image_set_from_pixbuf_with_scale (GTK_IMAGE (ssimg->image2),
+						     pb, (gint) ssimg->scale);
+	}
 }
 
 static void
@@ -209,10 +426,7 @@ gs_screenshot_image_complete_cb (SoupSession *session,
 				 gpointer user_data)
 {
 	g_autoptr(GsScreenshotImage) ssimg = GS_SCREENSHOT_IMAGE (user_data);
-	gboolean ret;
-	g_autoptr(GError) error = NULL;
-	g_autoptr(GdkPixbuf) pixbuf = NULL;
-	g_autoptr(GInputStream) stream = NULL;
+	g_autoptr(GBytes) data = NULL;
 
 	/* return immediately if the message was cancelled or if we're in destruction */
 	if (msg->status_code == SOUP_STATUS_CANCELLED || ssimg->session == NULL)
@@ -237,41 +451,9 @@ gs_screenshot_image_complete_cb (SoupSession *session,
 		return;
 	}
 
-	/* create a buffer with the data */
-	stream = g_memory_input_stream_new_from_data (msg->response_body->data,
-						      msg->response_body->length,
-						      NULL);
-	if (stream == NULL)
-		return;
-
-	/* load the image */
-	pixbuf = gdk_pixbuf_new_from_stream (stream, NULL, NULL);
-	if (pixbuf == NULL) {
-		/* TRANSLATORS: possibly image file corrupt or not an image */
-		gs_screenshot_image_set_error (ssimg, _("Failed to load image"));
-		return;
-	}
-
-	/* is image size destination size unknown or exactly the correct size */
-	if (ssimg->width == G_MAXUINT || ssimg->height == G_MAXUINT ||
-	    (ssimg->width * ssimg->scale == (guint) gdk_pixbuf_get_width (pixbuf) &&
-	     ssimg->height * ssimg->scale == (guint) gdk_pixbuf_get_height (pixbuf))) {
-		ret = g_file_set_contents (ssimg->filename,
-					   msg->response_body->data,
-					   msg->response_body->length,
-					   &error);
-		if (!ret) {
-			gs_screenshot_image_set_error (ssimg, error->message);
-			return;
-		}
-	} else if (!gs_screenshot_image_save_downloaded_img (ssimg, pixbuf,
-							     &error)) {
-		gs_screenshot_image_set_error (ssimg, error->message);
-		return;
-	}
-
-	/* got image, so show */
-	as_screenshot_show_image (ssimg);
+	/* decode and save in a thread, then show */
+	data = g_bytes_new (msg->response_body->data, (gsize) msg->response_body->length);
+	gs_screenshot_image_load_pixbuf (ssimg, data);
 }
 
 void
@@ -385,6 +567,15 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 
 	/* check if the URL points to a local file */
 	url = as_image_get_url (im);
+	g_free (ssimg->cache_key);
+	if (ssimg->width == G_MAXUINT || ssimg->height == G_MAXUINT) {
+		ssimg->cache_key = g_strdup (url);
+	} else {
+		ssimg->cache_key = g_strdup_printf ("%ux%u:%s",
+						    ssimg->width * ssimg->scale,
+						    ssimg->height * ssimg->scale,
+						    url);
+	}
 	if (g_str_has_prefix (url, "file://")) {
 		g_free (ssimg->filename);
 		ssimg->filename = g_strdup (url + 7);
@@ -519,11 +710,14 @@ gs_screenshot_image_destroy (GtkWidget *widget)
 		                             SOUP_STATUS_CANCELLED);
 		g_clear_object (&ssimg->message);
 	}
+	g_cancellable_cancel (ssimg->cancellable);
+	g_clear_object (&ssimg->cancellable);
 	g_clear_object (&ssimg->screenshot);
 	g_clear_object (&ssimg->session);
 	g_clear_object (&ssimg->settings);
 
 	g_clear_pointer (&ssimg->filename, g_free);
+	g_clear_pointer (&ssimg->cache_key, g_free);
 
 	GTK_WIDGET_CLASS (gs_screenshot_image_parent_class)->destroy (widget);
 }
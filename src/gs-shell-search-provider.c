@@ -17,13 +17,18 @@
 
 #include "gs-shell-search-provider-generated.h"
 #include "gs-shell-search-provider.h"
+#include "gs-app-list-private.h"
 #include "gs-common.h"
 
 #define GS_SHELL_SEARCH_PROVIDER_MAX_RESULTS	20
 
+/* enough that the first few keystrokes still leave every match to refine */
+#define GS_SHELL_SEARCH_PROVIDER_MAX_CANDIDATES	500
+
 typedef struct {
 	GsShellSearchProvider *provider;
 	GDBusMethodInvocation *invocation;
+	gchar **terms;
 } PendingSearch;
 
 struct _GsShellSearchProvider {
@@ -35,6 +40,8 @@ struct _GsShellSearchProvider {
 
 	GHashTable *metas_cache;
 	GsAppList *search_results;
+	GsAppList *search_candidates;	/* every match for search_terms, or %NULL if truncated */
+	gchar **search_terms;	/* what search_candidates were found with */
 };
 
 G_DEFINE_TYPE (GsShellSearchProvider, gs_shell_search_provider, G_TYPE_OBJECT)
@@ -43,6 +50,7 @@ static void
 pending_search_free (PendingSearch *search)
 {
 	g_object_unref (search->invocation);
+	g_strfreev (search->terms);
 	g_slice_free (PendingSearch, search);
 }
 
@@ -59,6 +67,29 @@ search_sort_by_kudo_cb (GsApp *app1, GsApp *app2, gpointer user_data)
 	return 0;
 }
 
+/* replies with the first available apps of @list, which are kept in
+ * search_results for GetResultMetas */
+static void
+gs_shell_search_provider_return_results (GsShellSearchProvider *self,
+					 GDBusMethodInvocation *invocation,
+					 GsAppList *list)
+{
+	GVariantBuilder builder;
+
+	gs_app_list_remove_all (self->search_results);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		if (gs_app_get_state (app) != AS_APP_STATE_AVAILABLE)
+			continue;
+		g_variant_builder_add (&builder, "s", gs_app_get_unique_id (app));
+		gs_app_list_add (self->search_results, app);
+		if (gs_app_list_length (self->search_results) >= GS_SHELL_SEARCH_PROVIDER_MAX_RESULTS)
+			break;
+	}
+	g_dbus_method_invocation_return_value (invocation, g_variant_new ("(as)", &builder));
+}
+
 static void
 search_done_cb (GObject *source,
 		GAsyncResult *res,
@@ -66,14 +97,19 @@ search_done_cb (GObject *source,
 {
 	PendingSearch *search = user_data;
 	GsShellSearchProvider *self = search->provider;
-	guint i;
-	GVariantBuilder builder;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GError) error = NULL;
 
-	/* cache no longer valid */
-	gs_app_list_remove_all (self->search_results);
+	list = gs_plugin_loader_job_process_finish (self->plugin_loader, res, &error);
+
+	/* cache no longer valid, unless a subsearch replaced this search */
+	if (list != NULL ||
+	    !g_error_matches (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_CANCELLED)) {
+		gs_app_list_remove_all (self->search_results);
+		g_clear_object (&self->search_candidates);
+		g_clear_pointer (&self->search_terms, g_strfreev);
+	}
 
-	list = gs_plugin_loader_job_process_finish (self->plugin_loader, res, NULL);
 	if (list == NULL) {
 		g_dbus_method_invocation_return_value (search->invocation, g_variant_new ("(as)", NULL));
 		pending_search_free (search);
@@ -81,27 +117,22 @@ search_done_cb (GObject *source,
 		return;	
 	}
 
+	/* a subsearch can only work from the results if none were dropped */
+	if (!gs_app_list_has_flag (list, GS_APP_LIST_FLAG_IS_TRUNCATED))
+		self->search_candidates = gs_app_list_copy (list);
+
 	/* sort by kudos, as there is no ratings data by default */
 	gs_app_list_sort (list, search_sort_by_kudo_cb, NULL);
 
-	g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		GsApp *app = gs_app_list_index (list, i);
-		if (gs_app_get_state (app) != AS_APP_STATE_AVAILABLE)
-			continue;
-		g_variant_builder_add (&builder, "s", gs_app_get_unique_id (app));
-
-		/* cache this in case we need the app in GetResultMetas */
-		gs_app_list_add (self->search_results, app);
-	}
-	g_dbus_method_invocation_return_value (search->invocation, g_variant_new ("(as)", &builder));
+	self->search_terms = g_steal_pointer (&search->terms);
+	gs_shell_search_provider_return_results (self, search->invocation, list);
 
 	pending_search_free (search);
 	g_application_release (g_application_get_default ());
 }
 
 static gchar *
-gs_shell_search_provider_get_app_sort_key (GsApp *app)
+gs_shell_search_provider_get_app_sort_key (GsApp *app, guint match_value)
 {
 	GString *key = g_string_sized_new (64);
 
@@ -126,7 +157,7 @@ gs_shell_search_provider_get_app_sort_key (GsApp *app)
 	}
 
 	/* sort by the search key */
-	g_string_append_printf (key, "%05x:", gs_app_get_match_value (app));
+	g_string_append_printf (key, "%05x:", match_value);
 
 	/* tie-break with id */
 	g_string_append (key, gs_app_get_unique_id (app));
@@ -139,8 +170,8 @@ gs_shell_search_provider_sort_cb (GsApp *app1, GsApp *app2, gpointer user_data)
 {
 	g_autofree gchar *key1 = NULL;
 	g_autofree gchar *key2 = NULL;
-	key1 = gs_shell_search_provider_get_app_sort_key (app1);
-	key2 = gs_shell_search_provider_get_app_sort_key (app2);
+	key1 = gs_shell_search_provider_get_app_sort_key (app1, gs_app_get_match_value (app1));
+	key2 = gs_shell_search_provider_get_app_sort_key (app2, gs_app_get_match_value (app2));
 	return g_strcmp0 (key2, key1);
 }
 
@@ -168,6 +199,7 @@ execute_search (GsShellSearchProvider  *self,
 	pending_search = g_slice_new (PendingSearch);
 	pending_search->provider = self;
 	pending_search->invocation = g_object_ref (invocation);
+	pending_search->terms = g_strdupv (terms);
 
 	g_application_hold (g_application_get_default ());
 	self->cancellable = g_cancellable_new ();
@@ -176,7 +208,7 @@ execute_search (GsShellSearchProvider  *self,
 					 "search", value,
 					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON |
 					                 GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN_HOSTNAME,
-					 "max-results", GS_SHELL_SEARCH_PROVIDER_MAX_RESULTS,
+					 "max-results", GS_SHELL_SEARCH_PROVIDER_MAX_CANDIDATES,
 					 "dedupe-flags", GS_APP_LIST_FILTER_FLAG_PREFER_INSTALLED |
 							 GS_APP_LIST_FILTER_FLAG_KEY_ID_PROVIDES,
 					 NULL);
@@ -201,6 +233,91 @@ handle_get_initial_result_set (GsShellSearchProvider2	*skeleton,
 	return TRUE;
 }
 
+/* returns %TRUE if each of @old_terms is a prefix of the term at the same
+ * position in @terms, so every result of @terms is also a result of
+ * @old_terms; an extra term could match a field the provider cannot see, such
+ * as a keyword or mimetype, so that needs a new search */
+static gboolean
+gs_shell_search_provider_terms_refine (gchar **old_terms, gchar **terms)
+{
+	guint old_len = g_strv_length (old_terms);
+
+	if (old_len == 0 || g_strv_length (terms) != old_len)
+		return FALSE;
+	for (guint i = 0; i < old_len; i++) {
+		g_autofree gchar *old_term = g_utf8_casefold (old_terms[i], -1);
+		g_autofree gchar *term = g_utf8_casefold (terms[i], -1);
+		if (!g_str_has_prefix (term, old_term))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* this mirrors the `~=` operator used by the appstream plugin, which matches
+ * the start of each space-delimited word ignoring any leading punctuation */
+static gboolean
+gs_shell_search_provider_str_matches (const gchar *str, const gchar *term)
+{
+	g_auto(GStrv) words = NULL;
+	g_autofree gchar *term_casefold = NULL;
+
+	if (str == NULL)
+		return FALSE;
+	term_casefold = g_utf8_casefold (term, -1);
+	words = g_strsplit (str, " ", -1);
+	for (guint i = 0; words[i] != NULL; i++) {
+		const gchar *word = words[i];
+		g_autofree gchar *word_casefold = NULL;
+		while (*word != '\0' && !g_ascii_isalnum (*word))
+			word++;
+		word_casefold = g_utf8_casefold (word, -1);
+		if (g_str_has_prefix (word_casefold, term_casefold))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* returns the AsAppSearchMatch bits @term matches in @app, or 0 */
+static guint
+gs_shell_search_provider_app_match_value (GsApp *app, const gchar *term)
+{
+	GPtrArray *sources = gs_app_get_sources (app);
+	guint match_value = 0;
+
+	if (gs_shell_search_provider_str_matches (gs_app_get_name (app), term))
+		match_value |= AS_APP_SEARCH_MATCH_NAME;
+	if (gs_shell_search_provider_str_matches (gs_app_get_summary (app), term))
+		match_value |= AS_APP_SEARCH_MATCH_COMMENT;
+	if (gs_shell_search_provider_str_matches (gs_app_get_id (app), term))
+		match_value |= AS_APP_SEARCH_MATCH_ID;
+	for (guint i = 0; i < sources->len; i++) {
+		if (gs_shell_search_provider_str_matches (g_ptr_array_index (sources, i), term)) {
+			match_value |= AS_APP_SEARCH_MATCH_PKGNAME;
+			break;
+		}
+	}
+
+	/* the plugin matched on something we can't see, such as a keyword
+	 * or mimetype, so keep what it found for the shorter term */
+	if (match_value == 0) {
+		match_value = gs_app_get_match_value (app) & (AS_APP_SEARCH_MATCH_KEYWORD |
+							     AS_APP_SEARCH_MATCH_MIMETYPE |
+							     AS_APP_SEARCH_MATCH_ORIGIN);
+	}
+	return match_value;
+}
+
+static gboolean
+gs_shell_search_provider_subsearch_sort_cb (GsApp *app1, GsApp *app2, gpointer user_data)
+{
+	GHashTable *match_values = user_data;
+	g_autofree gchar *key1 = NULL;
+	g_autofree gchar *key2 = NULL;
+	key1 = gs_shell_search_provider_get_app_sort_key (app1, GPOINTER_TO_UINT (g_hash_table_lookup (match_values, app1)));
+	key2 = gs_shell_search_provider_get_app_sort_key (app2, GPOINTER_TO_UINT (g_hash_table_lookup (match_values, app2)));
+	return g_strcmp0 (key2, key1);
+}
+
 static gboolean
 handle_get_subsearch_result_set (GsShellSearchProvider2	*skeleton,
 				 GDBusMethodInvocation	 *invocation,
@@ -209,9 +326,51 @@ handle_get_subsearch_result_set (GsShellSearchProvider2	*skeleton,
 				 gpointer		       user_data)
 {
 	GsShellSearchProvider *self = user_data;
+	g_autoptr(GHashTable) match_values = NULL;
+	g_autoptr(GsAppList) list = gs_app_list_new ();
 
 	g_debug ("****** GetSubSearchResultSet");
-	execute_search (self, invocation, terms);
+
+	/* the new terms could match apps the cached results do not have */
+	if (self->search_terms == NULL ||
+	    self->search_candidates == NULL ||
+	    !gs_shell_search_provider_terms_refine (self->search_terms, terms)) {
+		execute_search (self, invocation, terms);
+		return TRUE;
+	}
+
+	/* any search still in flight is for older terms */
+	g_cancellable_cancel (self->cancellable);
+	g_clear_object (&self->cancellable);
+
+	/* score every match of the old terms against the new ones; the
+	 * shared apps are not modified as other jobs may be using them */
+	match_values = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (guint i = 0; i < gs_app_list_length (self->search_candidates); i++) {
+		GsApp *app = gs_app_list_index (self->search_candidates, i);
+		guint match_value = 0;
+		for (guint j = 0; terms[j] != NULL; j++) {
+			guint tmp = gs_shell_search_provider_app_match_value (app, terms[j]);
+			if (tmp == 0) {
+				match_value = 0;
+				break;
+			}
+			match_value |= tmp;
+		}
+		if (match_value == 0)
+			continue;
+		g_hash_table_insert (match_values, app, GUINT_TO_POINTER (match_value));
+		gs_app_list_add (list, app);
+	}
+	gs_app_list_sort (list, gs_shell_search_provider_subsearch_sort_cb, match_values);
+	g_set_object (&self->search_candidates, list);
+	g_strfreev (self->search_terms);
+	self->search_terms = g_strdupv (terms);
+
+	/* sort by kudos, as there is no ratings data by default */
+	gs_app_list_sort (list, search_sort_by_kudo_cb, NULL);
+
+	gs_shell_search_provider_return_results (self, invocation, list);
 	return TRUE;
 }
 
@@ -352,6 +511,8 @@ search_provider_dispose (GObject *obj)
 	}
 
 	g_clear_object (&self->search_results);
+	g_clear_object (&self->search_candidates);
+	g_clear_pointer (&self->search_terms, g_strfreev);
 	g_clear_object (&self->plugin_loader);
 	g_clear_object (&self->skeleton);
 